@@ -35,6 +35,9 @@
 
 #include "ccny_rgbd/types.h"
 #include "ccny_rgbd/util.h"
+#include "ccny_rgbd/tiled_feature_detector.h"
+#include "ccny_rgbd/latest_frame_scheduler.h"
+#include "ccny_rgbd/rgbd_frame_factory.h"
 #include "ccny_rgbd/FeatureDetectorConfig.h"
 #include "ccny_rgbd/GftDetectorConfig.h"
 #include "ccny_rgbd/StarDetectorConfig.h"
@@ -106,6 +109,12 @@ class FeatureViewer
     std::string detector_type_;
   
     int queue_size_;  ///< Subscription queue size
+
+    /** @brief If true, frames are processed on a worker thread which
+     * only takes the newest synchronized frame, dropping any older 
+     * ones that arrived while it was busy
+     */
+    bool latest_frame_only_;
   
      /** @brief If true, show an OpenCV window with the features
      * 
@@ -132,6 +141,25 @@ class FeatureViewer
 
     rgbdtools::FeatureDetectorPtr feature_detector_; ///< The feature detector object
 
+    /** @brief Used instead of feature_detector_ when the detector
+     * grid has more than one cell, otherwise NULL
+     */
+    TiledFeatureDetectorPtr tiled_detector_;
+    
+    ThreadPoolPtr tile_pool_; ///< worker threads for tiled feature detection
+
+    /** @brief Serializes detection and the per-detector reconfigure 
+     * callbacks, since detection may run on the scheduler thread. 
+     * Separate from mutex_, which reconfigCallback holds when 
+     * resetDetector fires those callbacks. Lock order: mutex_, then
+     * detector_mutex_
+     */
+    boost::mutex detector_mutex_;
+
+    LatestFrameSchedulerPtr scheduler_; ///< used when latest_frame_only_ is set
+
+    RGBDFrameFactory frame_factory_; ///< builds the frames from the messages
+
     // **** private functions
     
     /** @brief Main callback for RGB, Depth, and CameraInfo messages
@@ -144,6 +172,17 @@ class FeatureViewer
                       const ImageMsg::ConstPtr& depth_msg,
                       const CameraInfoMsg::ConstPtr& info_msg);
 
+    /** @brief Processes a synchronized frame, on the subscriber thread or,
+     * with latest_frame_only_, on the scheduler thread
+     * 
+     * @param rgb_msg RGB message (8UC3)
+     * @param depth_msg Depth message (16UC1, in mm)
+     * @param info_msg CameraInfo message, applies to both RGB and depth images
+     */
+    void processRGBDMessages(const ImageMsg::ConstPtr& rgb_msg,
+                             const ImageMsg::ConstPtr& depth_msg,
+                             const CameraInfoMsg::ConstPtr& info_msg);
+
     /** @brief Initializes all the parameters from the ROS param server
      */
     void initParams();
@@ -174,6 +213,11 @@ class FeatureViewer
      */
     void reconfigCallback(FeatureDetectorConfig& config, uint32_t level);
     
+    /** @brief Creates, updates or removes the tiled detector
+     * for the given detector grid
+     */
+    void configureTiling(int grid_rows, int grid_cols);
+
     /** @brief ROS dynamic reconfigure callback function for GFT
      */
     void gftReconfigCallback(GftDetectorConfig& config, uint32_t level);
@@ -42,6 +42,9 @@
 
 #include "ccny_rgbd/types.h"
 #include "ccny_rgbd/util.h"
+#include "ccny_rgbd/latest_frame_scheduler.h"
+#include "ccny_rgbd/rgbd_frame_factory.h"
+#include "ccny_rgbd/subscriber_counter.h"
 #include "ccny_rgbd/GenerateGraph.h"
 #include "ccny_rgbd/SolveGraph.h"
 #include "ccny_rgbd/AddManualKeyframe.h"
@@ -49,6 +52,7 @@
 #include "ccny_rgbd/PublishKeyframes.h"
 #include "ccny_rgbd/Save.h"
 #include "ccny_rgbd/Load.h"
+#include "ccny_rgbd/GetPath.h"
 
 namespace ccny_rgbd {
 
@@ -173,6 +177,17 @@ class KeyframeMapper
     bool solveGraphSrvCallback(
       SolveGraph::Request& request,
       SolveGraph::Response& response);
+
+    /** @brief ROS callback to get the mapper path, starting at a 
+     * given pose index
+     * 
+     * Use this to get the full path when the mapper_path topic
+     * is windowed, or to resynchronize after the path was
+     * modified by graph solving or loading.
+     */
+    bool getPathSrvCallback(
+      GetPath::Request& request,
+      GetPath::Response& response);
     
   protected:
 
@@ -182,6 +197,12 @@ class KeyframeMapper
     std::string fixed_frame_;     ///< the fixed frame (usually "odom")
     
     int queue_size_;  ///< Subscription queue size
+
+    /** @brief If true, frames are processed on a worker thread which
+     * only takes the newest synchronized frame, dropping any older 
+     * ones that arrived while it was busy
+     */
+    bool latest_frame_only_;
     
     double max_range_;  ///< Maximum threshold for  range (in the z-coordinate of the camera frame)
     double max_stdev_;  ///< Maximum threshold for range (z-coordinate) standard deviation
@@ -200,10 +221,18 @@ class KeyframeMapper
 
   private:
 
+    // declared before the publishers, whose disconnect callbacks use them
+    SubscriberCounter keyframes_subscribers_;  ///< subscribers of the keyframe point clouds
+    SubscriberCounter poses_subscribers_;      ///< subscribers of the keyframe poses
+    SubscriberCounter kf_assoc_subscribers_;   ///< subscribers of the keyframe associations
+    SubscriberCounter path_subscribers_;       ///< subscribers of the keyframe path
+    SubscriberCounter path_delta_subscribers_; ///< subscribers of the new keyframe path poses
+
     ros::Publisher keyframes_pub_;    ///< ROS publisher for the keyframe point clouds
     ros::Publisher poses_pub_;        ///< ROS publisher for the keyframe poses
     ros::Publisher kf_assoc_pub_;     ///< ROS publisher for the keyframe associations
     ros::Publisher path_pub_;         ///< ROS publisher for the keyframe path
+    ros::Publisher path_delta_pub_;   ///< ROS publisher for the new keyframe path poses
     
     /** @brief ROS service to generate the graph correpondences */
     ros::ServiceServer generate_graph_service_;
@@ -232,6 +261,9 @@ class KeyframeMapper
     /** @brief ROS service to add a manual keyframe */
     ros::ServiceServer add_manual_keyframe_service_;
 
+    /** @brief ROS service to get the full path */
+    ros::ServiceServer get_path_service_;
+
     tf::TransformListener tf_listener_; ///< ROS transform listener
 
     /** @brief Image transport for RGB message subscription */
@@ -259,6 +291,8 @@ class KeyframeMapper
     double kf_angle_eps_; ///< angular distance threshold between keyframes
     bool octomap_with_color_; ///< whetehr to save Octomaps with color info      
     double max_map_z_;   ///< maximum z (in fixed frame) when exporting maps.
+    int path_window_size_; ///< number of most recent poses in the path topic (0 for all)
+    int path_decimation_;  ///< publish the path topic every n-th frame
           
     // state vars
     bool manual_add_;   ///< flag indicating whetehr a manual add has been requested
@@ -271,6 +305,27 @@ class KeyframeMapper
     rgbdtools::KeyframeAssociationVector associations_; ///< keyframe associations that form the graph
     
     PathMsg path_msg_;    /// < contains a vector of positions of the camera (not base) pose
+    int path_delta_index_; ///< index of the first pose not yet sent on the delta topic
+
+    LatestFrameSchedulerPtr scheduler_; ///< used when latest_frame_only_ is set
+
+    RGBDFrameFactory frame_factory_; ///< builds the frames from the messages
+
+    /** @brief Serializes frame processing and the service callbacks,
+     * which run on different threads when latest_frame_only_ is set
+     */
+    boost::mutex mutex_;
+
+    /** @brief Processes a synchronized frame, on the subscriber thread or,
+     * with latest_frame_only_, on the scheduler thread
+     * 
+     * @param rgb_msg RGB message (8UC3)
+     * @param depth_msg Depth message (16UC1, in mm)
+     * @param info_msg CameraInfo message, applies to both RGB and depth images
+     */
+    void processRGBDMessages(const ImageMsg::ConstPtr& rgb_msg,
+                             const ImageMsg::ConstPtr& depth_msg,
+                             const CameraInfoMsg::ConstPtr& info_msg);
     
     /** @brief processes an incoming RGBD frame with a given pose,
      * and determines whether a keyframe should be inserted
@@ -306,9 +361,14 @@ class KeyframeMapper
      */
     void publishKeyframePoses();
     
-    /** @brief Publishes all the path message
+    /** @brief Publishes the path message, or its most recent
+     * poses if path_window_size_ is set
      */
     void publishPath();
+
+    /** @brief Publishes the poses added to the path since the last call
+     */
+    void publishPathDelta();
     
     /** @brief Save the full map to disk as pcd
      * @param path path to save the map to
@@ -0,0 +1,94 @@
+/**
+ *  @file multi_visual_odometry.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ * 
+ *  @section LICENSE
+ * 
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_MULTI_VISUAL_ODOMETRY_H
+#define CCNY_RGBD_MULTI_VISUAL_ODOMETRY_H
+
+#include <vector>
+#include <string>
+#include <ros/ros.h>
+
+#include "ccny_rgbd/apps/visual_odometry.h"
+#include "ccny_rgbd/thread_pool.h"
+
+namespace ccny_rgbd {
+
+/** @brief Runs one VisualOdometry pipeline per RGB-D camera, in a 
+ * single process, on one shared worker pool.
+ *
+ * For a camera namespace ns, the pipeline subscribes to ns/rgbd/rgb,
+ * ns/rgbd/depth and ns/rgbd/info, publishes its outputs under ns, and 
+ * reads its parameters from the private namespace ~ns. The pipelines 
+ * are independent, so each camera needs its own fixed_frame and 
+ * base_frame parameters.
+ * 
+ * Each pipeline processes only its latest frame, as one pool task at
+ * a time, so the pool size bounds the number of cores in use, and 
+ * a slow camera can not starve the others. The tiled feature detection
+ * of all the pipelines also runs on the pool. Each pipeline publishes
+ * its own status on the diagnostics topic, named after its private 
+ * namespace.
+ */
+class MultiVisualOdometry
+{
+  public:
+
+    /** @brief Constructor from ROS nodehandles
+     * @param nh the public nodehandle
+     * @param nh_private the private nodehandle
+     */  
+    MultiVisualOdometry(const ros::NodeHandle& nh, 
+                        const ros::NodeHandle& nh_private);
+
+    /** @brief Default destructor
+     */
+    virtual ~MultiVisualOdometry();
+
+  private:
+
+    // **** ROS-related
+
+    ros::NodeHandle nh_;          ///< the public nodehandle
+    ros::NodeHandle nh_private_;  ///< the private nodehandle
+
+    // **** parameters
+
+    /** @brief Camera namespaces, separated by spaces, for example 
+     * "camera_front camera_rear"
+     */
+    std::string cameras_;
+
+    int n_threads_;  ///< size of the shared worker pool
+
+    // **** variables
+
+    ThreadPoolPtr pool_;  ///< the shared worker pool
+
+    /** @brief One pipeline per camera
+     */
+    std::vector<boost::shared_ptr<VisualOdometry> > streams_;
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_MULTI_VISUAL_ODOMETRY_H
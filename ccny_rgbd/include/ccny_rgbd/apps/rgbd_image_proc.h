@@ -34,10 +34,60 @@
 
 #include "ccny_rgbd/types.h"
 #include "ccny_rgbd/util.h"
+#include "ccny_rgbd/thread_pool.h"
+#include "ccny_rgbd/depth_registration.h"
+#include "ccny_rgbd/image_msg_pool.h"
+#include "ccny_rgbd/map_cache.h"
+#include "ccny_rgbd/subscriber_counter.h"
 #include "ccny_rgbd/RGBDImageProcConfig.h"
 
 namespace ccny_rgbd {
 
+/** @brief Everything derived from the calibration for one input size
+ * and scale: rectified intrinsics, camera infos, rectification maps,
+ * rectified unwarp coefficients, and the fused depth pass.
+ * 
+ * Immutable once built, so frames can keep using a set while its
+ * replacement is built on another thread.
+ */
+struct RectificationMaps
+{
+  /** @brief The cache file the images below point into, or NULL if
+   * they were computed. Declared first, so it is released last.
+   */
+  MapCachePtr cache;
+  
+  cv::Size size_in;  ///< size of the incoming images
+  double scale;      ///< downsampling scale the maps were built for
+  
+  /** @brief optimal intrinsics after rectification */
+  cv::Mat intr_rect_rgb, intr_rect_depth;
+  
+  /** @brief RGB CameraInfo derived from optimal matrices */
+  CameraInfoMsg rgb_rect_info_msg;
+  
+  /** @brief Depth CameraInfo derived from optimal matrices */
+  CameraInfoMsg depth_rect_info_msg;
+  
+  /** @brief RGB rectification maps */
+  cv::Mat map_rgb_1, map_rgb_2;
+  
+  /** @brief Depth rectification maps */
+  cv::Mat map_depth_1, map_depth_2;
+  
+  /** @brief depth unwarp polynomial coefficient matrices,
+   * after recitfication and resizing
+   */
+  cv::Mat coeff_0_rect, coeff_1_rect, coeff_2_rect;
+  
+  /** @brief Fused depth rectification, unwarping and registration
+   */
+  DepthRegistration depth_registration;
+};
+
+typedef boost::shared_ptr<RectificationMaps> RectificationMapsPtr;
+typedef boost::shared_ptr<const RectificationMaps> RectificationMapsConstPtr;
+
 /** @brief Processes the raw output of OpenNI sensors to create
  * a stream of RGB-D images.
  * 
@@ -48,9 +98,28 @@ namespace ccny_rgbd {
  *  - Performs unwarping on the depth image based on some polynomial model
  *  - Registers the depth image to the RGB image 
  * 
+ * By default, the depth rectification, unwarping and registration run
+ * fused in a single pass (see \ref DepthRegistration). Every stage is
+ * split into row bands, which run on a pool of \ref n_threads_ threads
+ * owned by the app.
+ * 
+ * The rectification maps are built from the first image. When the
+ * scale is changed through dynamic reconfigure, the maps for the new
+ * scale are built on a background thread, and swapped in once ready;
+ * until then, images keep being processed at the old scale.
+ * 
+ * Built maps are cached in a versioned binary file under \ref calib_path_,
+ * keyed by a hash of the calibration files, the camera infos, the image
+ * size and the scale (see \ref MapCache). The file used last is
+ * memory-mapped at startup, so after a restart the first image is
+ * processed without building any maps.
+ * 
  * The app then publishes the resulting pair of RGB and depth images, together
  * with a camera info which has no distortion, and the optimal new camera matrix
- * for both images.
+ * for both images. The images are computed directly into the data of the
+ * published messages, which are recycled through an \ref ImageMsgPool.
+ * Each output is only computed while its topic has subscribers, and
+ * nothing is computed while none of them have.
  */    
 class RGBDImageProc 
 {
@@ -99,6 +168,12 @@ class RGBDImageProc
     CameraInfoSubFilter sub_rgb_info_;   ///< ROS subscriber for rgb camera info
     CameraInfoSubFilter sub_depth_info_; ///< ROS subscriber for depth camera info
     
+    // declared before the publishers, whose disconnect callbacks use them
+    SubscriberCounter rgb_subscribers_;   ///< subscribers of the rgb images
+    SubscriberCounter depth_subscribers_; ///< subscribers of the depth images
+    SubscriberCounter info_subscribers_;  ///< subscribers of the camera info
+    SubscriberCounter cloud_subscribers_; ///< subscribers of the PointCloud
+    
     ImagePublisher rgb_publisher_;      ///< ROS rgb image publisher
     ImagePublisher depth_publisher_;    ///< ROS depth image publisher
     ros::Publisher info_publisher_;     ///< ROS camera info publisher
@@ -114,6 +189,10 @@ class RGBDImageProc
     bool verbose_;             ///< Whether to print the rectification and unwarping messages
     bool unwarp_;             ///< Whether to perform depth unwarping based on polynomial model
     bool publish_cloud_;      ///< Whether to calculate and publish the dense PointCloud
+    bool fused_depth_;        ///< Whether to rectify, unwarp and register the depth in one pass
+    int n_threads_;           ///< Number of threads for the row bands, including the callback thread
+    int msg_pool_size_;       ///< Number of recycled messages per output image topic
+    bool map_cache_;          ///< Whether to cache the rectification maps on disk
     
     /** @brief Downasampling scale (0, 1]. For example, 
      * 2.0 will result in an output image half the size of the input
@@ -129,11 +208,26 @@ class RGBDImageProc
      * from \ref calib_path_ parameter
      */
     std::string calib_warp_filename_;
+    
+    /** @brief folder of the rectification map cache files, derived
+     * from \ref calib_path_ parameter
+     */
+    std::string map_cache_path_;
    
     // **** state variables
     
     bool initialized_;      ///< whether we have initialized from the first image
-    boost::mutex mutex_;    ///< state mutex
+    boost::mutex mutex_;    ///< guards the maps and the reconfigurable params
+    
+    RectificationMapsConstPtr maps_; ///< the current maps, or NULL before the first image
+    bool building_maps_;             ///< whether maps are being built in the background
+    boost::thread map_thread_;       ///< background map builder
+    
+    ThreadPoolPtr pool_;    ///< pool for the row bands, or NULL with a single thread
+    int n_bands_;           ///< number of row bands per stage
+    
+    ImageMsgPool rgb_msg_pool_;   ///< recycled rgb output messages
+    ImageMsgPool depth_msg_pool_; ///< recycled depth output messages
     
     // **** calibration
     
@@ -143,43 +237,85 @@ class RGBDImageProc
      */
     int fit_mode_;        
     
-    cv::Size size_in_; ///< Size of the incoming images. 
-    
     /** @brief depth unwarp polynomial coefficient matrices */
     cv::Mat coeff_0_, coeff_1_, coeff_2_;   
     
-    /** @brief depth unwarp polynomial coefficient matrices,
-     * after recitfication and resizing
-     */
-    cv::Mat coeff_0_rect_, coeff_1_rect_, coeff_2_rect_;  
-    
     /** @brief extrinsic matrix between IR and RGB camera */
     cv::Mat ir2rgb_;    
-   
-    /** @brief optimal intrinsics after rectification */
-    cv::Mat intr_rect_rgb_, intr_rect_depth_;  
     
-    /** @brief RGB CameraInfo derived from optimal matrices */
-    CameraInfoMsg rgb_rect_info_msg_;   
+    /** @brief hash of the calibration files, part of the map cache keys */
+    uint64_t calib_hash_;
     
-    /** @brief Depth CameraInfo derived from optimal matrices */
-    CameraInfoMsg depth_rect_info_msg_; 
+    /** @brief the map cache file used last, mapped at startup, or NULL */
+    MapCachePtr preloaded_map_cache_;
     
-    /** @brief RGB rectification maps */
-    cv::Mat map_rgb_1_,   map_rgb_2_;
-    
-    /** @brief Depth rectification maps */
-    cv::Mat map_depth_1_, map_depth_2_;
-    
-    /** @brief Initializes the rectification maps from CameraInfo 
-     * messages
+    /** @brief Builds the rectification maps from CameraInfo 
+     * messages, or loads them from the map cache. Reads only the
+     * calibration, which is fixed after construction, so it can run
+     * on any thread.
      * 
      * @param rgb_info_msg input camera info for RGB image
      * @param depth_info_msg input camera info for depth image
+     * @param size_in size of the incoming images
+     * @param scale downsampling scale
+     * @param maps the output maps
      */
-    void initMaps(
+    void buildMaps(
       const CameraInfoMsg::ConstPtr& rgb_info_msg,
-      const CameraInfoMsg::ConstPtr& depth_info_msg);
+      const CameraInfoMsg::ConstPtr& depth_info_msg,
+      const cv::Size& size_in,
+      double scale,
+      RectificationMaps& maps) const;
+    
+    /** @brief Computes the rectification maps (the work \ref buildMaps
+     * skips when they are cached). Leaves out the camera infos.
+     */
+    void computeMaps(
+      const CameraInfoMsg::ConstPtr& rgb_info_msg,
+      const CameraInfoMsg::ConstPtr& depth_info_msg,
+      const cv::Size& size_in,
+      double scale,
+      RectificationMaps& maps) const;
+    
+    /** @brief Returns the map cache key of the maps built from the
+     * given inputs and the calibration
+     */
+    uint64_t getMapCacheKey(
+      const CameraInfoMsg::ConstPtr& rgb_info_msg,
+      const CameraInfoMsg::ConstPtr& depth_info_msg,
+      const cv::Size& size_in,
+      double scale) const;
+    
+    /** @brief Returns the path of the map cache file with a given key
+     */
+    std::string getMapCacheFilename(uint64_t key) const;
+    
+    /** @brief Loads the maps computed by \ref computeMaps from the
+     * map cache (from the preloaded file if its key matches)
+     * @return false if there is no valid cache file for the key
+     */
+    bool loadMapCache(uint64_t key, RectificationMaps& maps) const;
+    
+    /** @brief Saves the maps computed by \ref computeMaps to the map cache
+     */
+    bool saveMapCache(uint64_t key, const RectificationMaps& maps) const;
+    
+    /** @brief Maps the cache file used last into \ref preloaded_map_cache_
+     */
+    void preloadMapCache();
+    
+    /** @brief Records the key of the cache file to preload on the next run
+     */
+    void setLastMapCacheKey(uint64_t key) const;
+    
+    /** @brief Builds maps for a new scale (on \ref map_thread_), 
+     * and swaps them in, unless the input size changed meanwhile
+     */
+    void buildMapsInBackground(
+      const CameraInfoMsg::ConstPtr& rgb_info_msg,
+      const CameraInfoMsg::ConstPtr& depth_info_msg,
+      const cv::Size& size_in,
+      double scale);
     
     /** @brief Loads intrinsic and extrinsic calibration 
      * info from files 
@@ -190,6 +326,39 @@ class RGBDImageProc
      */
     bool loadUnwarpCalibration();
 
+    /** @brief Runs band_task(band) for each row band, on the pool
+     * if there is one, and blocks until all the bands are done
+     */
+    void runBands(const ThreadPool::IndexedTask& band_task);
+
+    /** @brief Returns the rows [row_start, row_end) of a band
+     */
+    void getBandRows(int band, int rows, int& row_start, int& row_end) const;
+
+    /** @brief Remaps the rows of one band of a preallocated output image
+     */
+    void remapBand(int band, const cv::Mat& img, cv::Mat& img_rect,
+                   const cv::Mat& map_1, const cv::Mat& map_2,
+                   int interpolation) const;
+
+    /** @brief Unwarps the rows of one band of a rectified depth image,
+     * with rgbdtools
+     */
+    void unwarpBand(int band, const RectificationMaps& maps,
+                    cv::Mat& depth_img_rect) const;
+
+    /** @brief Fills the points of one band of a preallocated, organized
+     * point cloud. Points without depth are NaN.
+     */
+    void buildPointCloudBand(int band, const RectificationMaps& maps,
+                             const cv::Mat& depth_img_rect_reg,
+                             const cv::Mat& rgb_img_rect,
+                             PointCloudT& cloud) const;
+
+    /** @brief Advertises the PointCloud topic, counting its subscribers
+     */
+    void advertiseCloud();
+
     /** @brief ROS dynamic reconfigure callback function
      */
     void reconfigCallback(ProcConfig& config, uint32_t level);
@@ -24,10 +24,12 @@
 #ifndef CCNY_RGBD_RGBD_VISUAL_ODOMETRY_H
 #define CCNY_RGBD_RGBD_VISUAL_ODOMETRY_H
 
+#include <deque>
 #include <ros/ros.h>
 #include <sensor_msgs/PointCloud2.h>
 #include <geometry_msgs/PoseStamped.h>
 #include <visualization_msgs/Marker.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
 #include <tf/transform_listener.h>
 #include <tf/transform_broadcaster.h>
 #include <pcl_ros/point_cloud.h>
@@ -35,6 +37,18 @@
 
 #include "ccny_rgbd/types.h"
 #include "ccny_rgbd/util.h"
+#include "ccny_rgbd/thread_pool.h"
+#include "ccny_rgbd/latest_frame_scheduler.h"
+#include "ccny_rgbd/async_publisher.h"
+#include "ccny_rgbd/rgbd_frame_factory.h"
+#include "ccny_rgbd/tiled_feature_detector.h"
+#include "ccny_rgbd/feature_tracker.h"
+#include "ccny_rgbd/coarse_to_fine.h"
+#include "ccny_rgbd/latency_controller.h"
+#include "ccny_rgbd/incremental_icp_prob_model.h"
+#include "ccny_rgbd/motion_predictor.h"
+#include "ccny_rgbd/diagnostics_writer.h"
+#include "ccny_rgbd/GetPath.h"
 #include "ccny_rgbd/FeatureDetectorConfig.h"
 #include "ccny_rgbd/GftDetectorConfig.h"
 #include "ccny_rgbd/StarDetectorConfig.h"
@@ -57,9 +71,14 @@ class VisualOdometry
     /** @brief Constructor from ROS nodehandles
      * @param nh the public nodehandle
      * @param nh_private the private nodehandle
+     * @param pool optional worker pool shared with other VisualOdometry
+     *        instances. If given, frames are processed on the pool with
+     *        latest-frame-wins scheduling, the tiled feature detection 
+     *        runs on the pool, and pipelining is disabled.
      */  
     VisualOdometry(const ros::NodeHandle& nh, 
-                   const ros::NodeHandle& nh_private);
+                   const ros::NodeHandle& nh_private,
+                   ThreadPoolPtr pool = ThreadPoolPtr());
     
     /** @brief Default destructor
      */
@@ -67,6 +86,37 @@ class VisualOdometry
 
   private:
 
+    /** @brief An RGBD frame travelling through the VO pipeline
+     */
+    struct PipelineFrame
+    {
+      ImageMsg::ConstPtr rgb_msg;       ///< RGB message
+      ImageMsg::ConstPtr depth_msg;     ///< Depth message
+      CameraInfoMsg::ConstPtr info_msg; ///< CameraInfo message
+
+      rgbdtools::RGBDFrame frame; ///< the frame, filled in by the front end
+      rgbdtools::RGBDFrame coarse_frame; ///< the coarse level, with coarse_to_fine_
+
+      ros::WallTime start; ///< time at which the frame was received
+      double d_frame;      ///< frame creation duration (ms)
+      double d_features;   ///< feature detection duration (ms)
+      bool ready;          ///< whether the front end is done with the frame
+    };
+
+    typedef boost::shared_ptr<PipelineFrame> PipelineFramePtr;
+
+    /** @brief The parts of a frame its feature cloud is built from, 
+     * handed to the output thread instead of the cloud
+     */
+    struct FeatureSnapshot
+    {
+      rgbdtools::Header header; ///< header of the frame
+      Vector3fVector kp_means;  ///< keypoint means
+      BoolVector kp_valid;      ///< keypoint validity
+    };
+
+    typedef boost::shared_ptr<FeatureSnapshot> FeatureSnapshotPtr;
+
     // **** ROS-related
 
     ros::NodeHandle nh_;                ///< the public nodehandle
@@ -76,16 +126,25 @@ class VisualOdometry
     ros::Publisher odom_publisher_;           ///< ROS Odometry publisher
     ros::Publisher pose_stamped_publisher_;   ///< ROS pose stamped publisher
     ros::Publisher path_pub_;                 ///< ROS publisher for the VO path
+    ros::Publisher path_delta_pub_;           ///< ROS publisher for the new VO path poses
+
+    /** @brief ROS service to get the full VO path */
+    ros::ServiceServer get_path_service_;
 
     ros::Publisher feature_cloud_publisher_;     
     ros::Publisher feature_cov_publisher_;  
     ros::Publisher model_cloud_publisher_;       
     ros::Publisher model_cov_publisher_;         
+    ros::Publisher diagnostics_publisher_;    ///< ROS publisher for the timing summary
              
-    FILE * diagnostics_file_;           ///< File for time recording statistics
     std::string diagnostics_file_name_; ///< File name for time recording statistics
     bool save_diagnostics_;              ///< indicates whether to save results to file or print to screen
     bool verbose_;                      ///< indicates whether to print diagnostics to screen
+    int diagnostics_window_;            ///< Number of recent frames in the timing summary
+    double diagnostics_period_;         ///< Period of the timing summary (s), 0 to disable
+
+    DiagnosticsWriterPtr diagnostics_writer_; ///< Records timing off the callback thread
+    ros::WallTimer diagnostics_timer_;        ///< Triggers the timing summary
     
     GftDetectorConfigServerPtr gft_config_server_;    ///< ROS dynamic reconfigure server for GFT params
     StarDetectorConfigServerPtr star_config_server_;  ///< ROS dynamic reconfigure server for STAR params
@@ -118,6 +177,20 @@ class VisualOdometry
     bool publish_odom_;       ///< Parameter whether to publish an odom message
     bool publish_pose_;       ///< Parameter whether to publish a pose message
 
+    /** @brief Number of most recent poses published on the path topic.
+     * 0 publishes the full path. The full path is always available
+     * through the get_path service.
+     */
+    int path_window_size_;
+    
+    int path_decimation_;     ///< Publish the path topic every n-th frame
+
+    /** @brief If true, the outputs are constructed and published on a 
+     * separate thread, which gives the tf, odometry, pose and path
+     * outputs priority over the feature and model clouds
+     */
+    bool publish_async_;
+
     bool publish_feature_cloud_;
     bool publish_feature_cov_; 
 
@@ -141,6 +214,14 @@ class VisualOdometry
      */
     std::string reg_type_;
 
+    /** @brief Nearest-neighbor index of the ICPProbModel model
+     * 
+     * Possible values:
+     * - kdtree (default): rgbdtools, k-d tree rebuilt after every frame
+     * - voxel_hash: IncrementalICPProbModel, updated incrementally
+     */
+    std::string index_type_;
+
     /** @brief If true, publish the pcl feature cloud
      * 
      * Note: this might slightly decrease performance
@@ -148,6 +229,53 @@ class VisualOdometry
     bool publish_cloud_; 
     
     int queue_size_;  ///< Subscription queue size
+
+    /** @brief If true, frames are processed on a worker thread which
+     * only takes the newest synchronized frame, dropping any older 
+     * ones that arrived while it was busy
+     */
+    bool latest_frame_only_;
+
+    /** @brief If true, frame creation and feature detection run on
+     * worker threads, overlapping with the registration of earlier frames.
+     * 
+     * Frames are still registered strictly in the order they arrive.
+     */
+    bool pipeline_;
+    
+    int tile_threads_;     ///< Number of worker threads for tiled feature detection
+
+    /** @brief If true, the feature 3D distributions are computed with the
+     * batch SSE kernel, also when detection is not tiled
+     */
+    bool fast_distributions_;
+
+    /** @brief If true, keypoints are tracked from the previous frame 
+     * with optical flow, and the detector only runs when too few 
+     * keypoints are left, or every feature/tracking/detection_period frames
+     */
+    bool tracking_;
+
+    /** @brief If true, features are detected on a downscaled copy of
+     * each frame, which is registered first; a subset of its keypoints, 
+     * refined at full resolution, is then registered starting from 
+     * the coarse estimate. Requires index_type voxel_hash
+     */
+    bool coarse_to_fine_;
+
+    /** @brief If true, the output of the distribution kernel is checked 
+     * against rgbdtools on every frame (slow, for testing only)
+     */
+    bool verify_distributions_;
+    
+    /** @brief If true, the feature count (GFT, ORB), detection threshold
+     * (STAR) and model size are adjusted online to keep the frame 
+     * duration within latency_control/budget
+     */
+    bool latency_control_;
+
+    int pipeline_threads_; ///< Number of front-end worker threads
+    int pipeline_depth_;   ///< Maximum number of frames waiting for registration
     
     // **** variables
 
@@ -160,9 +288,69 @@ class VisualOdometry
 
     boost::shared_ptr<rgbdtools::FeatureDetector> feature_detector_; ///< The feature detector object
 
+    /** @brief Used instead of feature_detector_ when the detector
+     * grid has more than one cell, or when fast_distributions_ is set,
+     * otherwise NULL
+     */
+    TiledFeatureDetectorPtr tiled_detector_;
+
+    /** @brief Tracks the keypoints between detections, when tracking_ 
+     * is set. Guarded by detector_mutex_
+     */
+    FeatureTracker tracker_;
+
+    /** @brief Builds the coarse and fine levels, when coarse_to_fine_ is set
+     */
+    CoarseToFine pyramid_;
+    
+    ThreadPoolPtr tile_pool_; ///< worker threads for tiled feature detection
+
+    /** @brief Serializes detection and detector reconfiguration, since
+     * the front end may run on several threads
+     */
+    boost::mutex detector_mutex_;
+
     rgbdtools::MotionEstimationICPProbModel motion_estimation_; ///< The motion estimation object
+
+    /** @brief The motion estimation object used instead of 
+     * motion_estimation_ when index_type_ is voxel_hash
+     */
+    IncrementalICPProbModel incremental_motion_estimation_;
+
+    bool incremental_model_; ///< whether index_type_ is voxel_hash
+
+    /** @brief Seeds the ICP of incremental_motion_estimation_ with the
+     * motion predicted from the previous frames
+     */
+    MotionPredictor motion_predictor_;
+
+    int n_compared_;            ///< registrations also run without the prediction
+    int n_unpredicted_failed_;  ///< of those, how many failed without the prediction
+
+    /** @brief Adjusts the feature count and model size setpoints.
+     * Guarded by detector_mutex_
+     */
+    LatencyController latency_controller_;
+
+    double star_threshold_; ///< current STAR threshold, scaled by the latency controller
   
     PathMsg path_msg_; ///< contains a vector of positions of the Base frame.
+    int path_delta_index_; ///< index of the first pose not yet sent on the delta topic
+    boost::mutex path_mutex_; ///< guards the path, which the get_path service reads
+
+    LatestFrameSchedulerPtr scheduler_; ///< used when latest_frame_only_ is set
+
+    AsyncPublisherPtr async_publisher_; ///< used when publish_async_ is set
+
+    RGBDFrameFactory frame_factory_; ///< builds the frames from the messages
+
+    // **** pipeline state
+
+    ThreadPoolPtr pipeline_pool_;              ///< front-end worker threads
+    boost::mutex pipeline_mutex_;              ///< guards the pipeline state
+    boost::condition_variable pipeline_cond_;  ///< signals a free pipeline slot
+    std::deque<PipelineFramePtr> pipeline_frames_; ///< frames in flight, in arrival order
+    bool pipeline_registering_;                ///< whether a worker is registering frames
 
     // **** private functions
     
@@ -176,6 +364,68 @@ class VisualOdometry
                       const ImageMsg::ConstPtr& depth_msg,
                       const CameraInfoMsg::ConstPtr& info_msg);
 
+    /** @brief Processes a synchronized frame, on the subscriber thread or,
+     * with latest_frame_only_, on the scheduler thread
+     * 
+     * @param rgb_msg RGB message (8UC3)
+     * @param depth_msg Depth message (16UC1, in mm)
+     * @param info_msg CameraInfo message, applies to both RGB and depth images
+     */
+    void processRGBDMessages(const ImageMsg::ConstPtr& rgb_msg,
+                             const ImageMsg::ConstPtr& depth_msg,
+                             const CameraInfoMsg::ConstPtr& info_msg);
+
+    /** @brief Creates the RGBD frame from the messages and detects its features
+     * 
+     * @param rgb_msg RGB message (8UC3)
+     * @param depth_msg Depth message (16UC1, in mm)
+     * @param info_msg CameraInfo message, applies to both RGB and depth images
+     * @param frame the output frame
+     * @param coarse_frame the output coarse level, with coarse_to_fine_
+     * @param d_frame output frame creation duration (ms)
+     * @param d_features output feature detection duration (ms)
+     */
+    void processFrontEnd(const ImageMsg::ConstPtr& rgb_msg,
+                         const ImageMsg::ConstPtr& depth_msg,
+                         const CameraInfoMsg::ConstPtr& info_msg,
+                         rgbdtools::RGBDFrame& frame,
+                         rgbdtools::RGBDFrame& coarse_frame,
+                         double& d_frame, double& d_features);
+
+    /** @brief Registers a frame, updates f2b_, publishes the outputs
+     * (or hands them to the output thread) and records the diagnostics
+     * 
+     * Must be called once per frame, in the order the frames arrived.
+     * 
+     * @param header header of the incoming message, used to stamp things correctly
+     * @param frame the frame, with features already detected
+     * @param coarse_frame the coarse level, with coarse_to_fine_
+     * @param start time at which the frame was received
+     * @param d_frame frame creation duration (ms)
+     * @param d_features feature detection duration (ms)
+     */
+    void processBackEnd(const std_msgs::Header& header,
+                        rgbdtools::RGBDFrame& frame,
+                        const rgbdtools::RGBDFrame& coarse_frame,
+                        const ros::WallTime& start,
+                        double d_frame, double d_features);
+
+    /** @brief Queues a frame for pipelined processing. Blocks while
+     * the pipeline is full.
+     */
+    void enqueuePipelineFrame(const ImageMsg::ConstPtr& rgb_msg,
+                              const ImageMsg::ConstPtr& depth_msg,
+                              const CameraInfoMsg::ConstPtr& info_msg,
+                              const ros::WallTime& start);
+
+    /** @brief Front-end task executed on the pipeline workers. 
+     * 
+     * Once the frame is ready, the worker registers all the ready 
+     * frames at the head of the pipeline, unless another worker is
+     * already doing so.
+     */
+    void pipelineTask(PipelineFramePtr pipeline_frame);
+
     /** @brief Initializes all the parameters from the ROS param server
      */
     void initParams();
@@ -184,36 +434,87 @@ class VisualOdometry
      */
     void resetDetector();
     
-    /** @brief publishes the f2b_ (fixed-to-base) transform as a tf
+    /** @brief Hands the pose, a snapshot of the features and the model
+     * cloud to the output thread, which builds the messages. The 
+     * snapshot and the model are only taken when they have subscribers,
+     * and the model is only copied when it is the live rgbdtools model.
+     * @param header header of the incoming message, used to stamp things correctly
+     * @param frame the registered frame
+     */
+    void postOutputs(const std_msgs::Header& header,
+                     rgbdtools::RGBDFrame& frame);
+
+    /** @brief Publishes the tf, odometry, path and pose outputs 
+     * which are enabled
+     * @param header header of the incoming message, used to stamp things correctly
+     * @param f2b the fixed-to-base transform
+     */
+    void publishPoseOutputs(const std_msgs::Header& header,
+                            const tf::Transform& f2b);
+
+    /** @brief Builds the feature cloud from the snapshot, and publishes
+     * the clouds, when not NULL
+     */
+    void publishVisualizationOutputs(const FeatureSnapshotPtr& features,
+                                     const PointCloudFeature::Ptr& model_cloud);
+
+    /** @brief publishes the fixed-to-base transform as a tf
      * @param header header of the incoming message, used to stamp things correctly
+     * @param f2b the fixed-to-base transform
      */
-    void publishTf(const std_msgs::Header& header);
+    void publishTf(const std_msgs::Header& header, const tf::Transform& f2b);
     
-    /** @brief publishes the f2b_ (fixed-to-base) transform as an Odom message
+    /** @brief publishes the fixed-to-base transform as an Odom message
      * \todo publish also as PoseWithCovariance
      * @param header header of the incoming message, used to stamp things correctly
+     * @param f2b the fixed-to-base transform
      */
-    void publishOdom(const std_msgs::Header& header); 
+    void publishOdom(const std_msgs::Header& header, const tf::Transform& f2b); 
 
-    /** @brief publishes the f2b_ (fixed-to-base) transform as an pose stamped message
-    * @param header header of the incoming message, used to stamp things correctly
-    */
-    void publishPoseStamped(const std_msgs::Header& header); 
+    /** @brief publishes the fixed-to-base transform as an pose stamped message
+     * @param header header of the incoming message, used to stamp things correctly
+     * @param f2b the fixed-to-base transform
+     */
+    void publishPoseStamped(const std_msgs::Header& header, const tf::Transform& f2b); 
 
-    /** @brief publishes the path of f2b_ (fixed-to-base) transform as an Path message
+    /** @brief appends the fixed-to-base transform to the path, and 
+     * publishes the new poses on the delta topic. Every path_decimation_ frames,
+     * also publishes the (windowed) path.
      * @param header header of the incoming message, used to stamp things correctly
+     * @param f2b the fixed-to-base transform
+     */
+    void publishPath(const std_msgs::Header& header, const tf::Transform& f2b);
+
+    /** @brief ROS callback to get the VO path, starting at a given pose index
+     */
+    bool getPathSrvCallback(
+      GetPath::Request& request,
+      GetPath::Response& response);
+
+    /** @brief Builds the point cloud of the valid features of a frame
      */
-    void publishPath(const std_msgs::Header& header);
+    PointCloudFeature::Ptr getFeatureCloud(rgbdtools::RGBDFrame& frame);
+
+    /** @brief Builds the point cloud of the valid features of a 
+     * snapshot, like rgbdtools::RGBDFrame::constructFeaturePointCloud
+     */
+    PointCloudFeature::Ptr getFeatureCloud(const FeatureSnapshot& features);
+
+    /** @brief Returns the registration model. With the voxel_hash index,
+     * a cloud built for this call; otherwise the live rgbdtools model, 
+     * which the next registration modifies in place
+     */
+    PointCloudFeature::Ptr getModelCloud();
     
     /** @brief Publish the feature point cloud
      * 
      * Note: this might decrease performance
      */
-    void publishFeatureCloud(rgbdtools::RGBDFrame& frame);
+    void publishFeatureCloud(const PointCloudFeature::Ptr& feature_cloud);
 
     void publishFeatureCovariances(rgbdtools::RGBDFrame& frame);
 
-    void publishModelCloud();
+    void publishModelCloud(const PointCloudFeature::Ptr& model_cloud);
 
     void publishModelCovariances();
 
@@ -222,6 +523,16 @@ class VisualOdometry
      */
     bool getBaseToCameraTf(const std_msgs::Header& header);
     
+    /** @brief Creates, updates or removes the tiled detector
+     * for the given detector grid. Call with detector_mutex_ held.
+     */
+    void configureTiling(int grid_rows, int grid_cols);
+
+    /** @brief Checks the feature distributions computed by the kernel
+     * against rgbdtools, and warns if they differ
+     */
+    void verifyDistributions(const rgbdtools::RGBDFrame& frame);
+
     /** @brief ROS dynamic reconfigure callback function for GFT
      */
     void gftReconfigCallback(GftDetectorConfig& config, uint32_t level);
@@ -235,14 +546,56 @@ class VisualOdometry
     void orbReconfigCallback(OrbDetectorConfig& config, uint32_t level);
 
     /**
-     * @brief Saves computed running times to file (or print on screen)
-     * @return 1 if write to file was successful
+     * @brief Queues the computed running times for the diagnostics writer,
+     * which saves them to file and/or prints them on screen
+     * @param header header of the incoming message, used to stamp the record
+     * @param n_iterations ICP iterations, or -1 if not available
+     * @param n_iterations_saved ICP iterations saved by the motion prediction
+     * @param reg_failed whether the registration failed
      */
     void diagnostics(
+      const std_msgs::Header& header,
       int n_features, int n_valid_features, int n_model_pts,
-      double d_frame, double d_features, double d_reg, double d_total);
+      double d_frame, double d_features, double d_reg, double d_total,
+      int n_iterations, int n_iterations_saved, bool reg_failed);
+
+    /** @brief Publishes percentiles of the recent running times
+     */
+    void diagnosticsTimerCallback(const ros::WallTimerEvent& event);
+
+    /** @brief Adds the percentiles of one duration to a status message
+     */
+    void addDurationStats(diagnostic_msgs::DiagnosticStatus& status,
+                          const std::string& name,
+                          const DurationStats& stats);
       
     void configureMotionEstimation();
+
+    /** @brief Reads the feature/tracking parameters, and disables
+     * pipelining, which would run the front end out of order
+     */
+    void configureTracking(double max_range, double max_stdev);
+
+    /** @brief Reads the reg/motion_prediction parameters. The prediction 
+     * is only used with index_type voxel_hash
+     */
+    void configureMotionPrediction();
+
+    /** @brief Reads the reg/coarse_to_fine parameters. Coarse-to-fine 
+     * registration is only used with index_type voxel_hash, and without
+     * feature tracking
+     */
+    void configureCoarseToFine(double max_range, double max_stdev);
+
+    /** @brief Reads the latency_control/ parameters
+     */
+    void configureLatencyControl();
+
+    /** @brief Feeds a frame duration to the latency controller,
+     * and applies any change of its setpoints
+     * @param d_total the total frame duration (ms)
+     */
+    void updateLatencyControl(double d_total);
 };
 
 } // namespace ccny_rgbd
@@ -0,0 +1,93 @@
+/**
+ *  @file async_publisher.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_ASYNC_PUBLISHER_H
+#define CCNY_RGBD_ASYNC_PUBLISHER_H
+
+#include <deque>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+namespace ccny_rgbd {
+
+/** @brief Runs publishing tasks on a dedicated output thread, so that
+ * message construction and serialization stay off the processing thread.
+ *
+ * There are two queues. Pose tasks (tf, odometry, path) are run in the
+ * order they were posted, and are never dropped. Visualization tasks
+ * (clouds, markers) are only run when no pose task is waiting, and only
+ * the newest one is kept: if the output thread falls behind, older
+ * visualization tasks are dropped.
+ */
+class AsyncPublisher
+{
+  public:
+
+    typedef boost::function<void()> Task;
+
+    /** @brief Constructor. Starts the output thread.
+     */
+    AsyncPublisher();
+
+    /** @brief Destructor. Runs the pending pose tasks, discards the
+     * pending visualization task, and joins the output thread.
+     */
+    virtual ~AsyncPublisher();
+
+    /** @brief Queues a pose task
+     */
+    void postPose(const Task& task);
+
+    /** @brief Queues a visualization task, replacing (dropping) any
+     * visualization task which is still pending
+     */
+    void postVisualization(const Task& task);
+
+    /** @brief Returns the number of visualization tasks dropped so far
+     */
+    int getNDropped();
+
+  private:
+
+    std::deque<Task> pose_tasks_; ///< pending pose tasks, in order
+    Task visualization_task_;     ///< pending visualization task, or empty
+
+    int n_dropped_;   ///< number of visualization tasks replaced before running
+    bool stop_;       ///< set when the publisher is shutting down
+
+    boost::mutex mutex_;             ///< guards the queues and counters
+    boost::condition_variable cond_; ///< signals a pending task or shutdown
+    boost::thread worker_;           ///< the output thread
+
+    /** @brief Main loop of the output thread
+     */
+    void workerLoop();
+};
+
+typedef boost::shared_ptr<AsyncPublisher> AsyncPublisherPtr;
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_ASYNC_PUBLISHER_H
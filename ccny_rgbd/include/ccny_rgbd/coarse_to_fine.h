@@ -0,0 +1,103 @@
+/**
+ *  @file coarse_to_fine.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_COARSE_TO_FINE_H
+#define CCNY_RGBD_COARSE_TO_FINE_H
+
+#include <opencv2/opencv.hpp>
+#include <rgbdtools/rgbdtools.h>
+
+#include "ccny_rgbd/feature_distributions.h"
+
+namespace ccny_rgbd {
+
+/** @brief Builds the two levels of the coarse-to-fine registration.
+ *
+ * The feature detector runs on a downscaled copy of the frame (the
+ * coarse level), whose features give a fast first motion estimate.
+ * A subset of the coarse keypoints, spread evenly over the detection
+ * order, is then scaled back to full resolution and refined to
+ * sub-pixel accuracy on the full resolution image (the fine level),
+ * without running the detector again. The fine keypoints get their 3D
+ * distributions from the full resolution depth image.
+ *
+ * All the methods are const, so one object can serve several
+ * front-end threads.
+ */
+class CoarseToFine
+{
+  public:
+
+    /** @brief Default constructor
+     */
+    CoarseToFine();
+
+    /** @brief Sets the scale of the coarse level, in (0, 1]
+     */
+    void setScale(double scale);
+
+    /** @brief Sets the number of keypoints kept at the fine level,
+     * 0 to keep all the valid coarse keypoints
+     */
+    void setNFineFeatures(int n_fine_features) { n_fine_features_ = n_fine_features; }
+
+    /** @brief Sets the half size of the sub-pixel refinement window (pixels)
+     */
+    void setRefineWindow(int refine_window) { refine_window_ = refine_window; }
+
+    void setMaxRange(double max_range) { max_range_ = max_range; }
+    void setMaxStDev(double max_stdev) { max_stdev_ = max_stdev; }
+
+    double getScale() const { return scale_; }
+
+    /** @brief Downscales the images and intrinsics of a frame
+     *
+     * The RGB image is area-averaged. The depth image is subsampled
+     * without interpolation, so no depth is made up across edges and holes.
+     *
+     * @param frame the full resolution frame
+     * @param coarse_frame the output coarse frame, without keypoints
+     */
+    void createCoarseFrame(const rgbdtools::RGBDFrame& frame,
+                           rgbdtools::RGBDFrame& coarse_frame) const;
+
+    /** @brief Sets the keypoints of the full resolution frame from the
+     * valid keypoints of the coarse frame, and computes their distributions
+     * @param coarse_frame the coarse frame, with features detected
+     * @param frame the full resolution frame, whose keypoints are overwritten
+     */
+    void refineFeatures(const rgbdtools::RGBDFrame& coarse_frame,
+                        rgbdtools::RGBDFrame& frame) const;
+
+  private:
+
+    double scale_;         ///< scale of the coarse level
+    int n_fine_features_;  ///< keypoints kept at the fine level, 0 for all
+    int refine_window_;    ///< half size of the refinement window (pixels)
+    double max_range_;     ///< max z of a valid keypoint (meters)
+    double max_stdev_;     ///< max std_dev(z) of a valid keypoint (meters)
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_COARSE_TO_FINE_H
@@ -0,0 +1,185 @@
+/**
+ *  @file depth_registration.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_DEPTH_REGISTRATION_H
+#define CCNY_RGBD_DEPTH_REGISTRATION_H
+
+#include <stdint.h>
+#include <opencv2/opencv.hpp>
+#include <rgbdtools/rgbdtools.h>
+
+#include "ccny_rgbd/thread_pool.h"
+#include "ccny_rgbd/map_cache.h"
+
+namespace ccny_rgbd {
+
+/** @brief Rectifies, unwarps and registers a raw depth image to the
+ * rectified RGB camera in a single pass.
+ *
+ * Replaces the chain of cv::remap (nearest neighbor),
+ * rgbdtools::unwarpDepthImage and rgbdtools::buildRegisteredDepthImage,
+ * which makes three passes over the image and allocates an intermediate
+ * image for each. Here, each rectified depth pixel is looked up in the
+ * raw image through the rectification map, unwarped with the rectified
+ * polynomial coefficients of that pixel, and reprojected into the
+ * registered image. Rectification matches rgbdtools exactly. Unwarping
+ * and reprojection run in single precision, which can move a depth by
+ * 1 mm, or a point by one pixel, where the double precision result lies
+ * on an integer boundary.
+ *
+ * The unwarp coefficients are packed into one float image, with the
+ * c0, c1 and c2 rows of each image row stored back to back (12 bytes per
+ * pixel instead of 24 in three double images), and normalized so that
+ * every fit mode evaluates c0 + z * (c1 + z * c2). The unwarp runs
+ * 4 pixels at a time with SSE2, with a scalar fallback.
+ *
+ * The geometry is fixed between calibrations, so \ref setTransform
+ * precomputes a ray table: for the rectified depth pixel (u, v), the
+ * reprojection of depth z is z * ray(u, v) + t, with t the translation
+ * column of the reprojection. Each row is then registered in three
+ * loops: a gather (rectify and unwarp), a table-driven transform with
+ * no branches, which the compiler can vectorize, and a z-buffered scatter.
+ *
+ * The image is split into row bands, which run in parallel on a
+ * thread pool. Since pixels from different bands can reproject onto
+ * the same registered pixel, the z-buffering (keep the nearest depth)
+ * then uses an atomic compare-and-swap.
+ */
+class DepthRegistration
+{
+  public:
+
+    /** @brief Default constructor. Without a pool, the image is
+     * processed in one band on the calling thread.
+     */
+    DepthRegistration();
+
+    /** @brief Sets the depth rectification map
+     * @param map the CV_16SC2 map from cv::initUndistortRectifyMap,
+     *        with the size of the output images
+     */
+    void setRectificationMap(const cv::Mat& map);
+
+    /** @brief Enables unwarping
+     * @param coeff_0 rectified CV_64FC1 coefficient image
+     * @param coeff_1 rectified CV_64FC1 coefficient image
+     * @param coeff_2 rectified CV_64FC1 coefficient image
+     * @param fit_mode the rgbdtools::DepthFitMode of the coefficients
+     */
+    void setUnwarpCoefficients(const cv::Mat& coeff_0,
+                               const cv::Mat& coeff_1,
+                               const cv::Mat& coeff_2,
+                               int fit_mode);
+
+    /** @brief Disables unwarping
+     */
+    void disableUnwarp();
+
+    /** @brief Sets the reprojection from the rectified depth camera
+     * to the rectified RGB camera, and builds the ray tables. Call
+     * after \ref setRectificationMap, and again when the map size changes.
+     * @param intr_rect_depth rectified depth intrinsics (3x3, CV_64FC1)
+     * @param intr_rect_rgb rectified RGB intrinsics (3x3, CV_64FC1)
+     * @param ir2rgb extrinsics from the IR to the RGB camera
+     *        (at least 3x4, CV_64FC1, translation in mm)
+     */
+    void setTransform(const cv::Mat& intr_rect_depth,
+                      const cv::Mat& intr_rect_rgb,
+                      const cv::Mat& ir2rgb);
+
+    /** @brief Adds the precomputed tables (packed coefficients, ray
+     * tables and the scalars), but not the rectification map, to a set
+     * of named images, to cache them
+     */
+    void getTables(MapCache::MatMap& tables) const;
+
+    /** @brief Restores the tables added by \ref getTables, in place of
+     * \ref setUnwarpCoefficients (or \ref disableUnwarp) and
+     * \ref setTransform. Call after \ref setRectificationMap.
+     * @return false if a table is missing, or does not match the map size
+     */
+    bool setTables(const MapCache::MatMap& tables);
+
+    /** @brief Runs the row bands on a pool
+     * @param pool the pool, or NULL for a single band on the calling thread
+     * @param n_bands the number of row bands
+     */
+    void setPool(ThreadPoolPtr pool, int n_bands);
+
+    /** @brief Unwarps a rectified depth image with the packed
+     * coefficients, without registering it. Same result as the unwarp
+     * stage of \ref process.
+     * @param depth_img_rect the rectified depth image (CV_16UC1, in mm),
+     *        with the size of the coefficient images
+     * @param depth_img_unwarped the output unwarped depth image
+     */
+    void unwarp(const cv::Mat& depth_img_rect, cv::Mat& depth_img_unwarped) const;
+
+    /** @brief Rectifies, unwarps and registers a depth image
+     * @param depth_img the raw depth image (CV_16UC1, in mm)
+     * @param depth_img_reg the output registered depth image,
+     *        with the size of the rectification map. Written in place
+     *        if it already has that size and type.
+     */
+    void process(const cv::Mat& depth_img, cv::Mat& depth_img_reg) const;
+
+  private:
+
+    cv::Mat map_;          ///< CV_16SC2 rectification map
+    /** @brief Packed rectified unwarp coefficients (CV_32FC1, 3 * width
+     * columns): the c0, c1 and c2 values of image row v, in row v
+     */
+    cv::Mat coeff_;
+    bool round_;           ///< round and saturate (*_ZERO fit modes), or truncate
+    bool unwarp_;          ///< whether to unwarp
+
+    /** @brief Ray tables (CV_32FC1, size of the map): the ray
+     * H0 * u + H1 * v + H2 of each pixel, with Hi the columns of the 3x4
+     * reprojection matrix, which maps (u*z, v*z, z, 1) to the RGB image
+     */
+    cv::Mat ray_x_, ray_y_, ray_z_;
+
+    float t_x_, t_y_, t_z_; ///< translation column H3 of the reprojection
+
+    ThreadPoolPtr pool_;   ///< the pool, or NULL
+    int n_bands_;          ///< number of row bands
+
+    /** @brief Processes the rows of one band
+     * @tparam ATOMIC whether other bands may write the output concurrently
+     */
+    template <bool ATOMIC>
+    void processBand(int band,
+                     const cv::Mat& depth_img,
+                     cv::Mat& depth_img_reg) const;
+
+    /** @brief Unwarps one row of depth values in place, rounded like
+     * rgbdtools::unwarpDepthImage. Values of 0 (no depth) stay 0.
+     * @param v the image row
+     * @param z_row the depth values of the row (mm), as floats
+     */
+    void unwarpRow(int v, float* z_row) const;
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_DEPTH_REGISTRATION_H
@@ -0,0 +1,174 @@
+/**
+ *  @file diagnostics_writer.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_DIAGNOSTICS_WRITER_H
+#define CCNY_RGBD_DIAGNOSTICS_WRITER_H
+
+#include <cstdio>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <stdint.h>
+#include <ros/ros.h>
+#include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "ccny_rgbd/util.h"
+#include "ccny_rgbd/ring_buffer.h"
+
+namespace ccny_rgbd {
+
+/** @brief Fixed-size timing record for one processed frame.
+ *
+ * The diagnostics file starts with the 8-byte magic "CCNYVOD\0",
+ * followed by the format version and the record size (both uint32),
+ * followed by the raw records in host byte order.
+ */
+struct DiagnosticsRecord
+{
+  uint32_t frame;            ///< frame counter
+  uint32_t stamp_sec;        ///< header stamp of the frame (seconds)
+  uint32_t stamp_nsec;       ///< header stamp of the frame (nanoseconds)
+  int32_t  n_features;       ///< number of detected features
+  int32_t  n_valid_features; ///< number of features with valid depth
+  int32_t  n_model_pts;      ///< number of points in the registration model
+  float    d_frame;          ///< frame creation duration (ms)
+  float    d_features;       ///< feature detection duration (ms)
+  float    d_reg;            ///< registration duration (ms)
+  float    d_total;          ///< total processing duration (ms)
+  int32_t  n_iterations;     ///< ICP iterations, or -1 if not available
+  int32_t  n_iterations_saved; ///< ICP iterations saved by the motion prediction, or 0
+  int32_t  reg_failed;       ///< 1 if the registration failed, else 0
+};
+
+/** @brief Percentiles of a duration over the rolling window (ms)
+ */
+struct DurationStats
+{
+  double p50;
+  double p95;
+  double p99;
+  double max;
+};
+
+/** @brief Summary of the records in the rolling window
+ */
+struct DiagnosticsSummary
+{
+  int n_records;   ///< number of records in the window
+  int n_dropped;   ///< total records dropped because the buffer was full
+  int n_failed;    ///< number of failed registrations in the window
+
+  double mean_iterations;       ///< mean ICP iterations, or -1 if not available
+  double mean_iterations_saved; ///< mean ICP iterations saved by the motion prediction
+
+  DurationStats frame;
+  DurationStats features;
+  DurationStats reg;
+  DurationStats total;
+};
+
+/** @brief Collects per-frame timing records without blocking the caller.
+ *
+ * Records are pushed into a preallocated lock-free ring buffer. A background
+ * thread drains the buffer, appends the records to a binary file, optionally
+ * prints them to screen, and keeps a rolling window for summary statistics.
+ */
+class DiagnosticsWriter
+{
+  public:
+
+    /** @brief Constructor
+     * @param label prefix for the screen output, for example "VO"
+     * @param detector_type feature detector name for the screen output
+     * @param verbose whether to print each record to screen
+     * @param capacity number of records the ring buffer can hold
+     * @param window_size number of most recent records used for the summary
+     */
+    DiagnosticsWriter(const std::string& label,
+                      const std::string& detector_type,
+                      bool verbose,
+                      int capacity,
+                      int window_size);
+
+    /** @brief Destructor. Writes out the remaining records,
+     * stops the writer thread and closes the file.
+     */
+    virtual ~DiagnosticsWriter();
+
+    /** @brief Opens the binary output file and writes the file header.
+     * Records queued before the file is opened are not saved.
+     * @param filename the file name
+     * @retval true the file was created
+     */
+    bool openFile(const std::string& filename);
+
+    /** @brief Queues a record. Never blocks; the record is dropped
+     * if the writer thread has fallen behind.
+     *
+     * Must only be called by one thread at a time.
+     *
+     * @retval true the record was queued
+     */
+    bool record(const DiagnosticsRecord& record);
+
+    /** @brief Computes percentiles over the records in the rolling window
+     */
+    void getSummary(DiagnosticsSummary& summary);
+
+  private:
+
+    static const uint32_t kFormatVersion = 2;
+
+    std::string label_;       ///< prefix for the screen output
+    std::string detector_type_; ///< detector name for the screen output
+    bool verbose_;            ///< whether to print records to screen
+    int window_size_;         ///< maximum size of the rolling window
+
+    RingBuffer<DiagnosticsRecord> buffer_; ///< records waiting to be written
+    volatile int n_dropped_;  ///< records dropped because the buffer was full
+
+    boost::mutex mutex_;                     ///< guards the file and the window
+    FILE * file_;                            ///< the binary output file, or NULL
+    std::deque<DiagnosticsRecord> window_;   ///< most recent records
+
+    volatile bool stop_;      ///< set when the writer is shutting down
+    boost::thread thread_;    ///< the writer thread
+
+    /** @brief Main loop of the writer thread
+     */
+    void writerLoop();
+
+    /** @brief Writes out all the queued records
+     */
+    void drain();
+
+    void computeStats(std::vector<double>& values, DurationStats& stats);
+};
+
+typedef boost::shared_ptr<DiagnosticsWriter> DiagnosticsWriterPtr;
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_DIAGNOSTICS_WRITER_H
@@ -0,0 +1,114 @@
+/**
+ *  @file feature_distributions.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_FEATURE_DISTRIBUTIONS_H
+#define CCNY_RGBD_FEATURE_DISTRIBUTIONS_H
+
+#include <vector>
+#include <rgbdtools/rgbdtools.h>
+
+#include "ccny_rgbd/types.h"
+
+namespace ccny_rgbd {
+
+/** @brief 3D Gaussian distributions of a set of keypoints,
+ * in structure-of-arrays layout.
+ *
+ * All the arrays have the same size, padded to a multiple of 4.
+ */
+struct FeatureDistributions
+{
+  int n;   ///< number of keypoints (before padding)
+
+  std::vector<float> u;      ///< keypoint column (pixels)
+  std::vector<float> v;      ///< keypoint row (pixels)
+  std::vector<float> z;      ///< mean z (meters), also the z of the mean
+  std::vector<float> var_z;  ///< variance of z (meters^2)
+
+  std::vector<float> x;      ///< mean x (meters)
+  std::vector<float> y;      ///< mean y (meters)
+
+  std::vector<float> s_xx;   ///< covariance elements (meters^2)
+  std::vector<float> s_xy;
+  std::vector<float> s_xz;
+  std::vector<float> s_yy;
+  std::vector<float> s_yz;
+  std::vector<float> s_zz;
+
+  std::vector<unsigned char> valid; ///< 1 if the keypoint has a valid distribution
+
+  /** @brief Resizes all the arrays for n keypoints
+   */
+  void resize(int n);
+};
+
+/** @brief Computes the 3D mean and covariance of each keypoint of a frame
+ *
+ * Batch replacement for rgbdtools::RGBDFrame::computeDistributions,
+ * using the same sensor model: z is a weighted Gaussian mixture over the
+ * 3x3 depth window around the keypoint (weights 4-2-1), with a per-pixel
+ * z standard deviation of 0.001425 * z^2, and the covariance is
+ * propagated through the pinhole projection with 1 pixel^2 of image noise.
+ *
+ * The depth window gathering is scalar; the projection and covariance
+ * propagation run 4 keypoints at a time with SSE.
+ *
+ * @param frame the frame, with 16UC1 depth and detected keypoints
+ * @param max_z maximum z (meters) for a keypoint to be valid
+ * @param max_stdev_z maximum std_dev(z) (meters) for a keypoint to be valid
+ * @param distributions the output distributions, reused between calls
+ */
+void computeFeatureDistributions(
+  const rgbdtools::RGBDFrame& frame,
+  double max_z,
+  double max_stdev_z,
+  FeatureDistributions& distributions);
+
+/** @brief Copies the distributions into the kp_valid, kp_means,
+ * kp_covariances and n_valid_keypoints fields of a frame
+ */
+void copyFeatureDistributions(
+  const FeatureDistributions& distributions,
+  rgbdtools::RGBDFrame& frame);
+
+/** @brief Compares the distributions of a frame against the output of
+ * rgbdtools::RGBDFrame::computeDistributions, which it computes on a copy
+ * of the frame
+ *
+ * @param frame the frame, with distributions already computed
+ * @param max_z maximum z (meters) for a keypoint to be valid
+ * @param max_stdev_z maximum std_dev(z) (meters) for a keypoint to be valid
+ * @param max_mean_error output largest absolute difference of a mean element
+ * @param max_cov_error output largest absolute difference of a covariance element
+ * @return the number of keypoints whose validity differs
+ */
+int compareFeatureDistributions(
+  const rgbdtools::RGBDFrame& frame,
+  double max_z,
+  double max_stdev_z,
+  double& max_mean_error,
+  double& max_cov_error);
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_FEATURE_DISTRIBUTIONS_H
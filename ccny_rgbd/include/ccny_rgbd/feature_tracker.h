@@ -0,0 +1,122 @@
+/**
+ *  @file feature_tracker.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_FEATURE_TRACKER_H
+#define CCNY_RGBD_FEATURE_TRACKER_H
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <rgbdtools/rgbdtools.h>
+
+#include "ccny_rgbd/feature_distributions.h"
+
+namespace ccny_rgbd {
+
+/** @brief Propagates the keypoints of the previous frame into the 
+ * current one with pyramidal Lucas-Kanade optical flow, as a cheaper
+ * replacement for running the feature detector on every frame.
+ *
+ * The caller runs the detector when needsDetection() is true, and 
+ * passes the detected frame to setFrame(); otherwise it calls track().
+ * Detection is needed when fewer than min_features keypoints survived
+ * the tracking, or every detection_period frames.
+ *
+ * The tracked keypoints get their 3D distributions from the batch 
+ * kernel in feature_distributions.h, so the registration sees the same
+ * data as after a detection. Tracked frames carry no descriptors.
+ *
+ * The image pyramid of the previous frame is kept, so each frame's 
+ * pyramid is only built once.
+ */
+class FeatureTracker
+{
+  public:
+
+    /** @brief Default constructor
+     */
+    FeatureTracker();
+
+    void setMinFeatures(int min_features) { min_features_ = min_features; }
+    void setDetectionPeriod(int detection_period) { detection_period_ = detection_period; }
+    void setWindowSize(int window_size) { window_size_ = window_size; }
+    void setMaxLevel(int max_level) { max_level_ = max_level; }
+    void setMaxRange(double max_range) { max_range_ = max_range; }
+    void setMaxStDev(double max_stdev) { max_stdev_ = max_stdev; }
+
+    /** @brief Forgets the previous frame, so the next one is detected
+     */
+    void reset();
+
+    /** @brief Whether the next frame should run the full detection
+     */
+    bool needsDetection() const;
+
+    /** @brief Starts tracking from a frame with freshly detected keypoints
+     */
+    void setFrame(const rgbdtools::RGBDFrame& frame);
+
+    /** @brief Tracks the keypoints of the previous frame into a frame,
+     * and computes their 3D distributions
+     * @param frame the frame, whose keypoints are overwritten
+     */
+    void track(rgbdtools::RGBDFrame& frame);
+
+    /** @brief Returns the number of keypoints tracked into the last frame
+     */
+    int getNTracked() const { return prev_keypoints_.size(); }
+
+  private:
+
+    // **** params
+
+    int min_features_;      ///< detect when fewer keypoints are tracked
+    int detection_period_;  ///< detect at least every this many frames
+    int window_size_;       ///< LK search window size (pixels)
+    int max_level_;         ///< LK pyramid levels above the full image
+    double max_range_;      ///< max z (meters) of a valid keypoint
+    double max_stdev_;      ///< max std_dev(z) (meters) of a valid keypoint
+
+    // **** variables
+
+    int n_tracked_frames_;  ///< frames tracked since the last detection
+
+    std::vector<cv::Mat> prev_pyramid_;        ///< pyramid of the previous frame
+    std::vector<cv::KeyPoint> prev_keypoints_; ///< keypoints of the previous frame
+
+    // buffers reused between frames
+    cv::Mat gray_img_;
+    std::vector<cv::Mat> pyramid_;
+    std::vector<cv::Point2f> prev_points_;
+    std::vector<cv::Point2f> points_;
+    std::vector<unsigned char> status_;
+    std::vector<float> error_;
+    FeatureDistributions distributions_;
+
+    /** @brief Builds the LK pyramid of a frame's image
+     */
+    void buildPyramid(const cv::Mat& rgb_img, std::vector<cv::Mat>& pyramid);
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_FEATURE_TRACKER_H
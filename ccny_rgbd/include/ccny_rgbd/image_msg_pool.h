@@ -0,0 +1,90 @@
+/**
+ *  @file image_msg_pool.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_IMAGE_MSG_POOL_H
+#define CCNY_RGBD_IMAGE_MSG_POOL_H
+
+#include <boost/thread/mutex.hpp>
+#include <opencv2/opencv.hpp>
+
+#include "ccny_rgbd/types.h"
+
+namespace ccny_rgbd {
+
+/** @brief A recycling pool of image messages, so that images can be
+ * computed directly into the data buffer of the message that is
+ * published, without a copy and without a new allocation per frame.
+ *
+ * A message is free again once the pool holds its only reference:
+ * once the publisher is done serializing it, and every (intra-process)
+ * subscriber has dropped it. Messages are never modified while they
+ * are shared. When all the pooled messages are in use and the pool is
+ * full, a new message outside the pool is returned.
+ */
+class ImageMsgPool
+{
+  public:
+
+    /** @brief Constructor
+     * @param max_size max. number of messages kept in the pool
+     */
+    ImageMsgPool(int max_size = 8);
+
+    /** @brief Sets the max. number of messages kept in the pool
+     */
+    void setMaxSize(int max_size);
+
+    /** @brief Returns a free message with the given header, encoding
+     * and size. The contents of the data buffer are undefined.
+     * @param header the message header
+     * @param encoding the message encoding (sensor_msgs::image_encodings)
+     * @param height image height
+     * @param width image width
+     * @param type the OpenCV type of the image, which sets the step
+     * @return the message
+     */
+    ImageMsg::Ptr acquire(const std_msgs::Header& header,
+                          const std::string& encoding,
+                          int height, int width, int type);
+
+    /** @brief Returns a cv::Mat which shares the data buffer of a message
+     * acquired from a pool
+     */
+    static cv::Mat wrap(const ImageMsg::Ptr& msg, int type);
+
+    /** @brief Returns the number of messages allocated by the pool
+     * so far, including the ones outside the pool
+     */
+    int getNAllocated();
+
+  private:
+
+    int max_size_;                    ///< max. number of pooled messages
+    int n_allocated_;                 ///< messages allocated so far
+    std::vector<ImageMsg::Ptr> msgs_; ///< the pooled messages
+    boost::mutex mutex_;              ///< guards msgs_ and n_allocated_
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_IMAGE_MSG_POOL_H
@@ -0,0 +1,302 @@
+/**
+ *  @file incremental_icp_prob_model.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_INCREMENTAL_ICP_PROB_MODEL_H
+#define CCNY_RGBD_INCREMENTAL_ICP_PROB_MODEL_H
+
+#include <list>
+#include <rgbdtools/rgbdtools.h>
+
+#include "ccny_rgbd/types.h"
+#include "ccny_rgbd/util.h"
+#include "ccny_rgbd/voxel_hash_index.h"
+
+namespace ccny_rgbd {
+
+/** @brief ICPProbModel registration with an incrementally 
+ * maintained nearest-neighbor index.
+ *
+ * Same algorithm as rgbdtools::MotionEstimationICPProbModel: the
+ * incoming features are aligned against a persistent model of 3D 
+ * Gaussians with Euclidean ICP, and the model is then updated with
+ * a Kalman filter (features associated by Mahalanobis distance among 
+ * the n nearest model points), or extended with the unassociated 
+ * features, replacing the oldest points once the model is full.
+ *
+ * Instead of rebuilding a k-d tree over the whole model after every 
+ * frame, the model points are kept in a VoxelHashIndex, which is 
+ * updated only for the points that were moved, added or replaced.
+ * Nearest neighbors further than max_search_dist are not considered
+ * for the Mahalanobis association.
+ *
+ * Optionally, the model is a local map over a window of keyframes:
+ * a new keyframe is started whenever the pose has moved far enough
+ * from the previous one, and each new model point belongs to the 
+ * keyframe during which it was added. Only the points of the last 
+ * max_keyframes keyframes, or of the keyframes within max_keyframe_dist
+ * of the current pose, are kept. Whole keyframes are evicted at once, 
+ * and their model slots are reused by later points.
+ */
+class IncrementalICPProbModel: public rgbdtools::MotionEstimation
+{
+  public:
+
+    /** @brief Constructor
+     */
+    IncrementalICPProbModel();
+
+    /** @brief Default destructor
+     */
+    virtual ~IncrementalICPProbModel();
+
+    /** @brief Main function for estimating motion
+     * 
+     * Aligns the frame features against the model, then updates
+     * the model with them.
+     * 
+     * @param frame The RGBD frame, with the feature distributions computed
+     * @param prediction The predicted motion, in the fixed frame, 
+     *        used as the initial ICP guess
+     * @param motion The output motion
+     * @retval true the motion estimation was successful
+     */
+    bool getMotionEstimationImpl(
+      rgbdtools::RGBDFrame& frame,
+      const AffineTransform& prediction,
+      AffineTransform& motion);
+
+    /** @brief Like getMotionEstimation, but with a motion prediction,
+     * and reports whether the registration succeeded
+     * 
+     * @param frame The RGBD frame, with the feature distributions computed
+     * @param prediction The predicted motion, in the fixed frame
+     * @param motion The output motion, identity if the registration failed
+     * @retval true the motion estimation was successful
+     */
+    bool getMotionEstimation(
+      rgbdtools::RGBDFrame& frame,
+      const AffineTransform& prediction,
+      AffineTransform& motion);
+
+    using rgbdtools::MotionEstimation::getMotionEstimation;
+
+    /** @brief Aligns a set of features (in the fixed frame) against the model
+     * @param data_means the feature means, in the fixed frame
+     * @param initial the initial guess for the correction
+     * @param correction the output transform which aligns the features
+     * @param n_iterations the output number of ICP iterations
+     * @retval false not enough correspondences
+     */
+    bool alignICPEuclidean(
+      const Vector3fVector& data_means,
+      const AffineTransform& initial,
+      AffineTransform& correction,
+      int& n_iterations);
+
+    /** @brief Aligns the features of a frame against the model, 
+     * without updating the model, for example to get the initial
+     * guess of a finer registration
+     * @param frame the RGBD frame, with the feature distributions computed
+     * @param initial the initial guess for the correction, in the fixed frame
+     * @param correction the output correction, in the fixed frame
+     * @param n_iterations the output number of ICP iterations
+     * @retval false the model is empty, or not enough correspondences
+     */
+    bool alignFrame(
+      const rgbdtools::RGBDFrame& frame,
+      const AffineTransform& initial,
+      AffineTransform& correction,
+      int& n_iterations);
+
+    /** @brief Updates the model with a set of aligned features,
+     * and updates the index for the changed model points
+     * @param data_means the feature means, in the fixed frame
+     * @param data_covariances the feature covariances, in the fixed frame
+     */
+    void updateModelFromData(
+      const Vector3fVector& data_means,
+      const Matrix3fVector& data_covariances);
+
+    /** @brief Returns the number of points in the model
+     */
+    int getModelSize() const { return model_size_; }
+
+    /** @brief Returns the model means as a point cloud
+     */
+    PointCloudFeature::Ptr getModel();
+
+    /** @brief Sets the maximum model size. If the model is already 
+     * larger, the oldest points are removed.
+     */
+    void setMaxModelSize(int max_model_size);
+
+    void setTfEpsilonLinear(double tf_epsilon_linear);
+    void setTfEpsilonAngular(double tf_epsilon_angular);
+    void setMaxIterations(int max_iterations);
+    void setMinCorrespondences(int min_correspondences);
+    void setNNearestNeighbors(int n_nearest_neighbors);
+    void setMaxCorrespondenceDistEuclidean(double max_corresp_dist_eucl);
+    void setMaxAssociationDistMahalanobis(double max_assoc_dist_mah);
+
+    /** @brief Returns the ICP iterations of the last registration
+     */
+    int getNIterations() const { return n_iterations_; }
+
+    /** @brief When enabled, each registration with a prediction is also
+     * run (without updating the model) from an identity guess, to 
+     * measure the effect of the prediction
+     */
+    void setComparePrediction(bool compare_prediction);
+
+    /** @brief Returns the ICP iterations of the last comparison 
+     * registration (from an identity guess), or -1 if there was none
+     */
+    int getNIterationsUnpredicted() const { return n_iterations_unpredicted_; }
+
+    /** @brief Returns whether the last comparison registration succeeded
+     */
+    bool getUnpredictedResult() const { return unpredicted_result_; }
+
+    /** @brief Limits the model to a window of keyframes, and clears it
+     * @param max_keyframes the number of most recent keyframes kept,
+     *        0 for no limit
+     * @param max_keyframe_dist keyframes whose pose is further than this
+     *        from the current pose are evicted (meters), 0 for no limit
+     * 
+     * With both limits 0 (the default), there are no keyframes, and once 
+     * the model is full, new points replace the oldest ones.
+     */
+    void setKeyframeWindow(int max_keyframes, double max_keyframe_dist);
+
+    /** @brief Sets the motion since the last keyframe after which a new 
+     * keyframe is started
+     * @param kf_dist_eps linear threshold (meters)
+     * @param kf_angle_eps angular threshold (radians)
+     */
+    void setKeyframeThresholds(double kf_dist_eps, double kf_angle_eps);
+
+    /** @brief Returns the number of keyframes in the model window,
+     * 0 without a keyframe window
+     */
+    int getNKeyframes() const { return keyframes_.size(); }
+
+    /** @brief Sets the voxel size of the index (meters)
+     */
+    void setVoxelSize(double voxel_size);
+
+    /** @brief Sets the search distance (meters) for the model points
+     * considered in the Mahalanobis association
+     */
+    void setMaxSearchDist(double max_search_dist);
+
+  private:
+
+    // **** params
+
+    double tf_epsilon_linear_;   ///< linear convergence criteria for ICP
+    double tf_epsilon_angular_;  ///< angular convergence criteria for ICP
+    int max_iterations_;         ///< max ICP iterations
+    int min_correspondences_;    ///< minimum correspondences for ICP to continue
+    int n_nearest_neighbors_;    ///< nearest neighbors considered in the association
+    int max_model_size_;         ///< upper bound for how many features to store in the model
+
+    double max_corresp_dist_eucl_;    ///< max Euclidean distance for an ICP correspondence
+    double max_assoc_dist_mah_sq_;    ///< max squared Mahalanobis distance for an association
+    double max_search_dist_;          ///< max Euclidean distance for an association candidate
+    bool compare_prediction_;         ///< also register from identity, for comparison
+
+    int max_keyframes_;          ///< keyframes kept in the model, 0 for no limit
+    double max_keyframe_dist_;   ///< max distance of a kept keyframe (meters), 0 for no limit
+    double kf_dist_eps_;         ///< linear motion which starts a new keyframe (meters)
+    double kf_angle_eps_;        ///< angular motion which starts a new keyframe (radians)
+
+    /** @brief The model points added while a keyframe was the latest one
+     */
+    struct KeyframeGroup
+    {
+      Vector3f position;   ///< keyframe position, in the fixed frame
+      Matrix3f rotation;   ///< keyframe orientation, in the fixed frame
+      IntVector slots;     ///< model slots of the points
+    };
+
+    typedef std::list<KeyframeGroup> KeyframeGroupList;
+
+    // **** variables
+
+    Vector3fVector means_;        ///< model means, in the fixed frame
+    Matrix3fVector covariances_;  ///< model covariances, in the fixed frame
+
+    VoxelHashIndex index_;   ///< nearest-neighbor index over means_
+    int model_size_;         ///< number of points in the model
+    int model_idx_;          ///< oldest model slot, replaced next once the model is full
+
+    bool windowed_;                 ///< whether there is a keyframe window
+    KeyframeGroupList keyframes_;   ///< keyframes in the window, oldest first
+    IntVector free_slots_;          ///< with a window: unused model slots
+    std::vector<bool> slot_used_;   ///< with a window: whether a slot holds a point
+
+    AffineTransform f2b_;    ///< Fixed frame to Base (moving) frame
+
+    int n_iterations_;              ///< ICP iterations of the last registration
+    int n_iterations_unpredicted_;  ///< ICP iterations from identity, or -1
+    bool unpredicted_result_;       ///< result of the registration from identity
+
+    /** @brief Adds a point to the model, replacing the oldest one 
+     * if the model is full. The replaced point is removed from the
+     * index, but the new point is not inserted.
+     * 
+     * With a keyframe window, the point is added to the latest keyframe,
+     * and the oldest keyframe is evicted if the model is full.
+     * 
+     * @return the model slot of the point, or -1 if it was not added
+     *         (the latest keyframe alone fills the model)
+     */
+    int addToModel(const Vector3f& data_mean, const Matrix3f& data_cov);
+
+    /** @brief Starts a new keyframe if the pose moved far enough from
+     * the latest one, and evicts the keyframes outside the window
+     */
+    void updateKeyframes();
+
+    /** @brief Removes the points of a keyframe from the model and the
+     * index, and frees their slots
+     */
+    void evictKeyframe(KeyframeGroupList::iterator it);
+
+    /** @brief Finds, among the n nearest model points, the one with 
+     * the smallest Mahalanobis distance to a feature
+     * @retval false no model point within max_search_dist_
+     */
+    bool getNNMahalanobis(
+      const Vector3f& data_mean, const Matrix3f& data_cov,
+      int& mah_nn_idx, double& mah_dist_sq,
+      IntVector& indices, FloatVector& dists_sq);
+
+    /** @brief Rebuilds the index from scratch
+     */
+    void rebuildIndex();
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_INCREMENTAL_ICP_PROB_MODEL_H
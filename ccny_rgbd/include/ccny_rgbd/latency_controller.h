@@ -0,0 +1,110 @@
+/**
+ *  @file latency_controller.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_LATENCY_CONTROLLER_H
+#define CCNY_RGBD_LATENCY_CONTROLLER_H
+
+#include <algorithm>
+
+namespace ccny_rgbd {
+
+/** @brief Adjusts the number of features and the registration model
+ * size to keep the per-frame processing time within a budget.
+ *
+ * Every period frames, the mean frame duration is compared against
+ * the budget, and the feature count is scaled by
+ * 1 + gain * (budget / mean - 1), limited to [0.8, 1.25] per step.
+ * The model size is only adjusted once the feature count has hit
+ * its upper limit (when under budget) or its lower limit (when over budget).
+ * Durations within the deadband around the budget cause no change.
+ */
+class LatencyController
+{
+  public:
+
+    /** @brief Default constructor
+     */
+    LatencyController();
+
+    /** @brief Sets the target per-frame duration (ms)
+     */
+    void setBudget(double budget) { budget_ = budget; }
+
+    /** @brief Sets the relative deadband around the budget, for example 0.1
+     */
+    void setDeadband(double deadband) { deadband_ = deadband; }
+
+    /** @brief Sets the proportional gain, in (0, 1]
+     */
+    void setGain(double gain) { gain_ = gain; }
+
+    /** @brief Sets the number of frames between adjustments
+     */
+    void setPeriod(int period) { period_ = std::max(1, period); }
+
+    void setFeatureLimits(int min_features, int max_features);
+    void setModelSizeLimits(int min_model_size, int max_model_size);
+
+    /** @brief Sets the current setpoints, for example after they
+     * were changed through dynamic reconfigure
+     */
+    void setNFeatures(int n_features);
+    void setMaxModelSize(int max_model_size);
+
+    int getNFeatures() const { return n_features_; }
+    int getMaxModelSize() const { return max_model_size_; }
+
+    /** @brief Returns the mean duration of the last complete period (ms)
+     */
+    double getMeanDuration() const { return mean_duration_; }
+
+    /** @brief Adds the duration of a processed frame, and updates the
+     * setpoints at the end of each period
+     * @param duration the frame duration (ms)
+     * @retval true the setpoints changed
+     */
+    bool update(double duration);
+
+  private:
+
+    double budget_;    ///< target frame duration (ms)
+    double deadband_;  ///< relative deadband around the budget
+    double gain_;      ///< proportional gain
+    int period_;       ///< number of frames between adjustments
+
+    int min_features_;    ///< lower limit of the feature count
+    int max_features_;    ///< upper limit of the feature count
+    int min_model_size_;  ///< lower limit of the model size
+    int max_model_size_limit_; ///< upper limit of the model size
+
+    int n_features_;      ///< current feature count setpoint
+    int max_model_size_;  ///< current model size setpoint
+
+    int n_frames_;          ///< frames in the current period
+    double duration_sum_;   ///< sum of durations in the current period
+    double mean_duration_;  ///< mean duration of the last period
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_LATENCY_CONTROLLER_H
@@ -0,0 +1,125 @@
+/**
+ *  @file latest_frame_scheduler.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_LATEST_FRAME_SCHEDULER_H
+#define CCNY_RGBD_LATEST_FRAME_SCHEDULER_H
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "ccny_rgbd/types.h"
+#include "ccny_rgbd/thread_pool.h"
+
+namespace ccny_rgbd {
+
+/** @brief Hands only the newest synchronized RGB-D triple to a
+ * dedicated worker thread, or to a shared thread pool.
+ *
+ * The subscriber callback only stores the triple and returns right away.
+ * If the worker is still busy with an earlier frame, the stored triple 
+ * is replaced, and the older one is dropped. This keeps the processing 
+ * latency bounded by the duration of one frame, rather than letting 
+ * stale frames pile up in the subscription queues.
+ *
+ * With a shared pool, each frame is a separate pool task, and at most 
+ * one task per scheduler is queued or running at a time. Several 
+ * schedulers can then share one pool: their frames are processed in 
+ * order within each stream, and round-robin across streams.
+ */
+class LatestFrameScheduler
+{
+  public:
+
+    typedef boost::function<void(const ImageMsg::ConstPtr&,
+                                 const ImageMsg::ConstPtr&,
+                                 const CameraInfoMsg::ConstPtr&)> Callback;
+
+    /** @brief Constructor. Starts the worker thread.
+     * @param callback called on the worker thread for each processed frame
+     */
+    LatestFrameScheduler(const Callback& callback);
+
+    /** @brief Constructor. Processes the frames on a shared pool.
+     * @param callback called on a pool thread for each processed frame
+     * @param pool the pool, which must outlive the scheduler
+     */
+    LatestFrameScheduler(const Callback& callback, ThreadPoolPtr pool);
+
+    /** @brief Destructor. Discards the pending frame, waits for the 
+     * frame in progress, and joins the worker thread, if there is one.
+     */
+    virtual ~LatestFrameScheduler();
+
+    /** @brief Stores a frame for processing, replacing (dropping) 
+     * any frame which is still pending
+     * @param rgb_msg RGB message (8UC3)
+     * @param depth_msg Depth message (16UC1, in mm)
+     * @param info_msg CameraInfo message, applies to both RGB and depth images
+     */
+    void push(const ImageMsg::ConstPtr& rgb_msg,
+              const ImageMsg::ConstPtr& depth_msg,
+              const CameraInfoMsg::ConstPtr& info_msg);
+
+    /** @brief Returns the number of frames dropped so far
+     */
+    int getNDropped();
+
+    /** @brief Returns the number of frames received so far
+     */
+    int getNReceived();
+
+  private:
+
+    Callback callback_;  ///< the processing callback
+
+    ImageMsg::ConstPtr rgb_msg_;       ///< pending RGB message, or NULL
+    ImageMsg::ConstPtr depth_msg_;     ///< pending depth message
+    CameraInfoMsg::ConstPtr info_msg_; ///< pending CameraInfo message
+
+    int n_received_;  ///< number of frames received
+    int n_dropped_;   ///< number of frames replaced before processing
+    bool stop_;       ///< set when the scheduler is shutting down
+    bool busy_;       ///< with a pool: whether a task is queued or running
+
+    boost::mutex mutex_;             ///< guards the pending frame and counters
+    boost::condition_variable cond_; ///< signals a pending frame, shutdown, or an idle pool task
+    boost::thread worker_;           ///< the worker thread, without a pool
+    ThreadPoolPtr pool_;             ///< the shared pool, or NULL
+
+    /** @brief Main loop of the worker thread
+     */
+    void workerLoop();
+
+    /** @brief Pool task: processes the pending frame, then queues
+     * itself again if another frame arrived in the meantime
+     */
+    void poolTask();
+};
+
+typedef boost::shared_ptr<LatestFrameScheduler> LatestFrameSchedulerPtr;
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_LATEST_FRAME_SCHEDULER_H
@@ -0,0 +1,128 @@
+/**
+ *  @file map_cache.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_MAP_CACHE_H
+#define CCNY_RGBD_MAP_CACHE_H
+
+#include <map>
+#include <string>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+#include <opencv2/opencv.hpp>
+
+namespace ccny_rgbd {
+
+/** @brief A binary file of named images, memory-mapped when loaded.
+ *
+ * Caches data which is expensive to derive, such as rectification maps,
+ * between runs. The file starts with a magic string, the format
+ * \ref VERSION and a 64-bit key, which identifies the inputs the images
+ * were derived from; a file with another version or key is ignored.
+ * The data of each image is 16-byte aligned in the file.
+ *
+ * Loading maps the file privately (copy-on-write): the loaded images
+ * point straight into the mapping, without a copy, and stay valid as
+ * long as the MapCache object. Files are written to a temporary file
+ * first, then renamed, so a process killed while saving never leaves
+ * a truncated cache behind.
+ */
+class MapCache
+{
+  public:
+
+    typedef std::map<std::string, cv::Mat> MatMap;
+
+    /** @brief Version of the file format. Bump it whenever the format,
+     * or the meaning of the cached images, changes.
+     */
+    static const uint32_t VERSION = 1;
+
+    /** @brief Default constructor, with no file loaded
+     */
+    MapCache();
+
+    /** @brief Destructor, unmaps the file
+     */
+    ~MapCache();
+
+    /** @brief Memory-maps a cache file
+     * @param filename the cache file
+     * @param key the expected key
+     * @return true if the file exists, is well-formed, and has the
+     *         current version and the expected key
+     */
+    bool load(const std::string& filename, uint64_t key);
+
+    /** @brief Returns the images of the loaded file
+     */
+    const MatMap& getMats() const { return mats_; }
+
+    /** @brief Returns the key of the loaded file
+     */
+    uint64_t getKey() const { return key_; }
+
+    /** @brief Writes a cache file, creating its folder if needed
+     * @param filename the cache file
+     * @param key the key of the images
+     * @param mats the images (continuous or not, possibly empty)
+     * @return true on success
+     */
+    static bool save(const std::string& filename, uint64_t key,
+                     const MatMap& mats);
+
+    /** @brief 64-bit FNV-1a hash of a buffer
+     * @param data the buffer
+     * @param size the buffer size, in bytes
+     * @param hash the hash to continue from, for hashing several buffers
+     */
+    static uint64_t hash(const void * data, size_t size,
+                         uint64_t hash = 14695981039346656037ULL);
+
+    /** @brief Hashes the contents of a file
+     * @param filename the file
+     * @param hash the hash to continue from, updated
+     * @return false if the file can't be read
+     */
+    static bool hashFile(const std::string& filename, uint64_t& hash);
+
+  private:
+
+    void * data_;   ///< the mapped file, or NULL
+    size_t size_;   ///< size of the mapping, in bytes
+    uint64_t key_;  ///< key of the loaded file
+    MatMap mats_;   ///< the images, pointing into the mapping
+
+    // not copyable: the images point into the mapping
+    MapCache(const MapCache&);
+    MapCache& operator=(const MapCache&);
+
+    /** @brief Unmaps the file and clears the images
+     */
+    void unload();
+};
+
+typedef boost::shared_ptr<MapCache> MapCachePtr;
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_MAP_CACHE_H
@@ -0,0 +1,112 @@
+/**
+ *  @file motion_predictor.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_MOTION_PREDICTOR_H
+#define CCNY_RGBD_MOTION_PREDICTOR_H
+
+#include <string>
+#include <algorithm>
+
+#include "ccny_rgbd/types.h"
+
+namespace ccny_rgbd {
+
+/** @brief Predicts the motion of the next frame from the motion
+ * between the last two frames, using the header stamps.
+ *
+ * The velocity is the last frame-to-frame increment, in the base 
+ * frame. For a new frame dt seconds after the last one, the increment
+ * is scaled (rotation angle and translation) by:
+ *  - constant velocity: dt / dt_last
+ *  - decaying velocity: tau * (1 - exp(-dt / tau)) / dt_last, which
+ *    assumes the velocity decays exponentially with time constant tau
+ *
+ * No prediction is made after a failed registration, or when the 
+ * time between frames exceeds max_dt (for example after dropped frames).
+ */
+class MotionPredictor
+{
+  public:
+
+    enum Mode {NONE = 0, CONSTANT_VELOCITY = 1, DECAYING_VELOCITY = 2};
+
+    /** @brief Default constructor
+     */
+    MotionPredictor();
+
+    /** @brief Sets the mode from its name: "none",
+     * "constant_velocity" or "decaying_velocity"
+     * @retval false invalid name, the mode is set to NONE
+     */
+    bool setMode(const std::string& mode);
+
+    void setMode(Mode mode) { mode_ = mode; }
+    Mode getMode() const { return mode_; }
+
+    /** @brief Sets the velocity time constant (s), for DECAYING_VELOCITY
+     */
+    void setDecayTime(double decay_time) { decay_time_ = std::max(decay_time, 1e-3); }
+
+    /** @brief Sets the maximum time between frames (s) for a prediction
+     */
+    void setMaxDt(double max_dt) { max_dt_ = max_dt; }
+
+    /** @brief Forgets the last poses
+     */
+    void reset();
+
+    /** @brief Predicts the motion from the last pose to the pose 
+     * at a given time
+     * @param stamp the time of the new frame (s)
+     * @param prediction the predicted motion, in the fixed frame
+     *        (new f2b = prediction * last f2b), or identity
+     * @retval true a prediction was made
+     */
+    bool predict(double stamp, AffineTransform& prediction) const;
+
+    /** @brief Adds the pose estimated for a frame
+     * @param stamp the time of the frame (s)
+     * @param f2b the fixed frame to base frame transform
+     * @param valid false if the registration failed
+     */
+    void update(double stamp, const AffineTransform& f2b, bool valid);
+
+  private:
+
+    Mode mode_;          ///< prediction mode
+    double decay_time_;  ///< velocity time constant (s)
+    double max_dt_;      ///< maximum time between frames (s)
+
+    bool initialized_;   ///< whether there is a last pose
+    bool has_velocity_;  ///< whether there is a last increment
+
+    double last_stamp_;  ///< time of the last frame (s)
+    double last_dt_;     ///< time between the last two frames (s)
+
+    AffineTransform last_f2b_;  ///< pose of the last frame
+    AffineTransform delta_;     ///< last increment, in the base frame
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_MOTION_PREDICTOR_H
@@ -0,0 +1,119 @@
+/**
+ *  @file rgbd_frame_factory.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_RGBD_FRAME_FACTORY_H
+#define CCNY_RGBD_RGBD_FRAME_FACTORY_H
+
+#include <vector>
+#include <boost/array.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cv_bridge/cv_bridge.h>
+#include <rgbdtools/rgbdtools.h>
+
+#include "ccny_rgbd/types.h"
+
+namespace ccny_rgbd {
+
+/** @brief Builds RGBDFrames from ROS messages without per-frame 
+ * heap allocations in the steady state.
+ *
+ * Replacement for createRGBDFrameFromROSMessages, meant to be kept
+ * for the lifetime of a node:
+ *  - the intrinsic and distortion matrices are rebuilt only when the 
+ *    content of the camera info changes, and shared between frames
+ *  - 32FC1 depth images are converted into a small pool of 16UC1 
+ *    buffers. A buffer is reused once no frame references it anymore,
+ *    so buffers held by keyframes or frames in flight are never 
+ *    overwritten.
+ *  - the frame fields are assigned in place, instead of constructing
+ *    and copying a temporary frame
+ *
+ * The class is thread-safe.
+ */
+class RGBDFrameFactory
+{
+  public:
+
+    /** @brief Constructor
+     * @param max_pool_size maximum number of pooled depth buffers
+     */
+    RGBDFrameFactory(int max_pool_size = 4);
+
+    /** @brief Builds a frame from synchronized ROS messages
+     * @param rgb_msg RGB message (8UC3)
+     * @param depth_msg Depth message (16UC1 in mm, or 32FC1 in m)
+     * @param info_msg CameraInfo message, applies to both RGB and depth images
+     * @param frame the output frame
+     */
+    void createFrame(
+      const ImageMsg::ConstPtr& rgb_msg,
+      const ImageMsg::ConstPtr& depth_msg,
+      const CameraInfoMsg::ConstPtr& info_msg,
+      rgbdtools::RGBDFrame& frame);
+
+    /** @brief Returns the number of depth buffers allocated so far
+     */
+    int getNAllocated();
+
+  private:
+
+    int max_pool_size_;  ///< maximum number of pooled depth buffers
+    int n_allocated_;    ///< number of depth buffers allocated so far
+
+    std::vector<cv::Mat> depth_pool_; ///< pooled 16UC1 depth buffers
+
+    boost::array<double, 9> cached_K_; ///< K of the cached intrinsics
+    std::vector<double> cached_D_;     ///< D of the cached intrinsics
+    cv::Mat intr_; ///< cached intrinsic matrix, shared between frames
+    cv::Mat dist_; ///< cached distortion matrix
+
+    boost::mutex mutex_; ///< guards the pool and the intrinsics cache
+
+    /** @brief Returns the cached intrinsic matrix, updating the cache 
+     * if the camera info content changed. Call with mutex_ held.
+     */
+    const cv::Mat& getIntrinsics(const CameraInfoMsg& info_msg);
+
+    /** @brief Returns a 16UC1 buffer of the given size which no frame 
+     * references. Call with mutex_ held.
+     */
+    cv::Mat getDepthBuffer(int rows, int cols);
+};
+
+/** @brief Converts a 32FC1 depth image (meters) into a preallocated 
+ * 16UC1 depth image (mm), 8 pixels at a time with SSE2.
+ *
+ * Same output as rgbdtools::depthImageFloatTo16bit for finite and NaN 
+ * input: values are rounded to the nearest mm and saturated to 
+ * [0, 65535], and NaN becomes 0 (no reading).
+ *
+ * @param depth_img_in the input depth image (32FC1)
+ * @param depth_img_out the output depth image (16UC1), of the same size
+ */
+void depthImageFloatTo16bitFast(
+  const cv::Mat& depth_img_in,
+  cv::Mat& depth_img_out);
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_RGBD_FRAME_FACTORY_H
@@ -0,0 +1,133 @@
+/**
+ *  @file ring_buffer.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_RING_BUFFER_H
+#define CCNY_RGBD_RING_BUFFER_H
+
+#include <vector>
+
+namespace ccny_rgbd {
+
+/** @brief Preallocated, lock-free ring buffer for a single producer
+ * and a single consumer thread.
+ *
+ * The producer and consumer may each be a different thread over time,
+ * as long as the hand-over between threads is itself synchronized.
+ * Neither side ever blocks: push() fails when the buffer is full,
+ * and pop() fails when it is empty.
+ */
+template <typename T>
+class RingBuffer
+{
+  public:
+
+    /** @brief Constructor
+     * @param capacity maximum number of items held in the buffer
+     */
+    RingBuffer(unsigned int capacity):
+      buffer_(capacity + 1),
+      head_(0),
+      tail_(0)
+    {
+
+    }
+
+    /** @brief Appends an item to the buffer (producer side)
+     * @param item the item
+     * @retval true the item was added
+     * @retval false the buffer is full, the item was discarded
+     */
+    bool push(const T& item)
+    {
+      unsigned int head = head_;
+      unsigned int next = increment(head);
+
+      if (next == load(tail_)) return false;
+
+      buffer_[head] = item;
+      store(head_, next);
+      return true;
+    }
+
+    /** @brief Removes the oldest item from the buffer (consumer side)
+     * @param item the removed item
+     * @retval true an item was removed
+     * @retval false the buffer is empty
+     */
+    bool pop(T& item)
+    {
+      unsigned int tail = tail_;
+
+      if (tail == load(head_)) return false;
+
+      item = buffer_[tail];
+      store(tail_, increment(tail));
+      return true;
+    }
+
+    /** @brief Returns the maximum number of items in the buffer
+     */
+    unsigned int capacity() const { return buffer_.size() - 1; }
+
+  private:
+
+    std::vector<T> buffer_; ///< item storage, with one unused slot
+
+    /** @brief index of the next slot to write, only written by the producer.
+     * Padded so the producer and consumer indices sit on different cache lines.
+     */
+    volatile unsigned int head_;
+    char pad_[64];
+
+    /** @brief index of the next slot to read, only written by the consumer
+     */
+    volatile unsigned int tail_;
+
+    unsigned int increment(unsigned int idx) const
+    {
+      return (idx + 1 == buffer_.size()) ? 0 : idx + 1;
+    }
+
+    /** @brief reads an index written by the other side, ordering
+     * the read before any subsequent slot access
+     */
+    static unsigned int load(const volatile unsigned int& idx)
+    {
+      unsigned int value = idx;
+      __sync_synchronize();
+      return value;
+    }
+
+    /** @brief publishes an index to the other side, ordering
+     * any preceding slot access before the write
+     */
+    static void store(volatile unsigned int& idx, unsigned int value)
+    {
+      __sync_synchronize();
+      idx = value;
+    }
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_RING_BUFFER_H
@@ -0,0 +1,77 @@
+/**
+ *  @file subscriber_counter.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_SUBSCRIBER_COUNTER_H
+#define CCNY_RGBD_SUBSCRIBER_COUNTER_H
+
+#include <boost/thread/mutex.hpp>
+
+namespace ccny_rgbd {
+
+/** @brief Counts the subscribers of a publisher, from its connect and
+ * disconnect callbacks, so that an output is only generated while
+ * someone listens to it.
+ *
+ * boost::bind ignores the extra arguments of a call, so the same
+ * counter serves ros::Publisher and image_transport::Publisher:
+ *
+ * @code
+ * pub_ = nh_.advertise<PathMsg>("path", queue_size_,
+ *   boost::bind(&SubscriberCounter::connect, &path_subscribers_),
+ *   boost::bind(&SubscriberCounter::disconnect, &path_subscribers_));
+ * @endcode
+ */
+class SubscriberCounter
+{
+  public:
+
+    /** @brief Default constructor, with no subscribers
+     */
+    SubscriberCounter();
+
+    /** @brief Connect callback: one more subscriber
+     */
+    void connect();
+
+    /** @brief Disconnect callback: one less subscriber
+     */
+    void disconnect();
+
+    /** @brief Back to no subscribers, for when the publisher
+     * is shut down (which does not call the disconnect callbacks)
+     */
+    void reset();
+
+    /** @brief Whether the publisher has any subscribers
+     */
+    bool hasSubscribers();
+
+  private:
+
+    int n_subscribers_;   ///< number of subscribers
+    boost::mutex mutex_;  ///< guards n_subscribers_
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_SUBSCRIBER_COUNTER_H
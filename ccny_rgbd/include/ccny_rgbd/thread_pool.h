@@ -0,0 +1,115 @@
+/**
+ *  @file thread_pool.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_THREAD_POOL_H
+#define CCNY_RGBD_THREAD_POOL_H
+
+#include <deque>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread.hpp>
+
+namespace ccny_rgbd {
+
+/** @brief A fixed-size pool of worker threads which execute
+ * queued tasks in FIFO order.
+ */
+class ThreadPool
+{
+  public:
+
+    typedef boost::function<void()> Task;
+    typedef boost::function<void(int)> IndexedTask;
+
+    /** @brief Constructor
+     * @param n_threads number of worker threads (at least 1)
+     */
+    ThreadPool(int n_threads);
+
+    /** @brief Destructor. Runs any tasks still in the queue,
+     * then joins the worker threads.
+     */
+    virtual ~ThreadPool();
+
+    /** @brief Queues a task for execution on one of the workers
+     * @param task the task
+     */
+    void post(const Task& task);
+
+    /** @brief Runs body(i) for i in [0, n) on the workers, and blocks
+     * until all the calls are done.
+     * 
+     * The calling thread also executes iterations, so it is safe to 
+     * call this from a task running on the same pool.
+     * 
+     * @param n number of iterations
+     * @param body the function to call for each iteration
+     */
+    void parallelFor(int n, const IndexedTask& body);
+
+    /** @brief Returns the number of worker threads
+     */
+    int getNThreads() const { return n_threads_; }
+
+  private:
+
+    /** @brief Shared state of a parallelFor call
+     */
+    struct ParallelForState
+    {
+      int n;             ///< number of iterations
+      IndexedTask body;  ///< the iteration body
+      volatile int next; ///< next iteration to run, claimed atomically
+      int n_done;        ///< number of finished iterations
+
+      boost::mutex mutex;              ///< guards n_done
+      boost::condition_variable cond;  ///< signals all iterations are done
+    };
+
+    typedef boost::shared_ptr<ParallelForState> ParallelForStatePtr;
+
+    int n_threads_;                 ///< number of worker threads
+    bool stop_;                     ///< set when the pool is shutting down
+
+    std::deque<Task> tasks_;        ///< queue of pending tasks
+    boost::mutex mutex_;            ///< guards the task queue
+    boost::condition_variable cond_; ///< signals new tasks or shutdown
+    boost::thread_group workers_;   ///< the worker threads
+
+    /** @brief Main loop of each worker thread
+     */
+    void workerLoop();
+
+    /** @brief Runs iterations of a parallelFor until none are left
+     */
+    static void parallelForWorker(ParallelForStatePtr state);
+};
+
+typedef boost::shared_ptr<ThreadPool> ThreadPoolPtr;
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_THREAD_POOL_H
@@ -0,0 +1,162 @@
+/**
+ *  @file tiled_feature_detector.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_TILED_FEATURE_DETECTOR_H
+#define CCNY_RGBD_TILED_FEATURE_DETECTOR_H
+
+#include <vector>
+#include <string>
+#include <boost/ref.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <opencv2/opencv.hpp>
+#include <rgbdtools/rgbdtools.h>
+
+#include "ccny_rgbd/thread_pool.h"
+#include "ccny_rgbd/feature_distributions.h"
+
+namespace ccny_rgbd {
+
+/** @brief Runs only the keypoint detection step of an rgbdtools
+ * detector, without the image preprocessing and the computation
+ * of the 3D feature distributions.
+ */
+template <typename DetectorT>
+class DetectionOnly: public DetectorT
+{
+  public:
+
+    /** @brief Detects keypoints in a grayscale image
+     * @param frame the frame, whose keypoints are overwritten
+     * @param gray_img the (smoothed) grayscale image of the frame
+     */
+    void detect(rgbdtools::RGBDFrame& frame, const cv::Mat& gray_img)
+    {
+      DetectorT::findFeatures(frame, gray_img);
+    }
+};
+
+/** @brief Detects features by splitting the image into a grid of cells
+ * and running a detector on each cell in parallel.
+ *
+ * Each cell has its own GFT, STAR or ORB detector, with an equal share
+ * of the requested number of features, which spreads the features
+ * evenly over the image. The keypoints are merged in cell order, and
+ * the 3D distributions are computed for the whole frame with the batch
+ * kernel from feature_distributions.h.
+ *
+ * With a 1x1 grid, this is equivalent to rgbdtools::FeatureDetector::findFeatures,
+ * except for the faster distribution computation.
+ *
+ * Not reentrant: findFeatures must not be called from several threads at once.
+ */
+class TiledFeatureDetector
+{
+  public:
+
+    /** @brief Constructor
+     * @param detector_type GFT, STAR or ORB
+     * @param pool the thread pool which runs the cells
+     */
+    TiledFeatureDetector(const std::string& detector_type,
+                         ThreadPoolPtr pool);
+
+    /** @brief Default destructor
+     */
+    virtual ~TiledFeatureDetector();
+
+    /** @brief Detects the keypoints of a frame and computes
+     * their 3D distributions
+     */
+    void findFeatures(rgbdtools::RGBDFrame& frame);
+
+    /** @brief Sets the grid size, and recreates the cell detectors
+     */
+    void setGrid(int grid_rows, int grid_cols);
+
+    int getNCells() const { return grid_rows_ * grid_cols_; }
+
+    /** @brief Sets the total number of features (GFT, ORB),
+     * split equally among the cells
+     */
+    void setNFeatures(int n_features);
+
+    /** @brief Sets the minimum distance between features (GFT, STAR)
+     */
+    void setMinDistance(double min_distance);
+
+    /** @brief Sets the detection threshold (STAR, ORB)
+     */
+    void setThreshold(double threshold);
+
+    void setSmooth(int smooth) { smooth_ = smooth; }
+    void setMaxRange(double max_range) { max_range_ = max_range; }
+    void setMaxStDev(double max_stdev) { max_stdev_ = max_stdev; }
+
+    double getMaxRange() const { return max_range_; }
+    double getMaxStDev() const { return max_stdev_; }
+
+  private:
+
+    typedef boost::function<void(rgbdtools::RGBDFrame&, const cv::Mat&)> DetectFunction;
+
+    std::string detector_type_; ///< GFT, STAR or ORB
+    ThreadPoolPtr pool_;        ///< runs the cells in parallel
+
+    int grid_rows_;     ///< number of cell rows
+    int grid_cols_;     ///< number of cell columns
+
+    int n_features_;        ///< total number of features (GFT, ORB)
+    double min_distance_;   ///< minimum distance between features (GFT, STAR)
+    double threshold_;      ///< detection threshold (STAR, ORB)
+    int smooth_;            ///< smoothing window half-size
+    double max_range_;      ///< maximum z-depth of valid features
+    double max_stdev_;      ///< maximum std_dev(z) of valid features
+
+    std::vector<boost::shared_ptr<rgbdtools::FeatureDetector> > cell_detectors_;  ///< one detector per cell
+    std::vector<DetectFunction> cell_detect_;  ///< detection step of each cell detector
+    std::vector<rgbdtools::RGBDFrame> cell_frames_; ///< per-cell detection output
+
+    FeatureDistributions distributions_; ///< kernel buffers, reused between frames
+
+    /** @brief Pushes the current detector parameters to all the cells
+     */
+    void configureCells();
+
+    /** @brief Detects the keypoints of a single cell
+     */
+    void detectCell(int cell_idx,
+                    const rgbdtools::RGBDFrame& frame,
+                    const cv::Mat& gray_img);
+
+    /** @brief Returns the image region of a cell
+     */
+    cv::Rect getCellRect(int cell_idx, int width, int height) const;
+};
+
+typedef boost::shared_ptr<TiledFeatureDetector> TiledFeatureDetectorPtr;
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_TILED_FEATURE_DETECTOR_H
@@ -24,7 +24,10 @@
 #ifndef CCNY_RGBD_RGBD_UTIL_H
 #define CCNY_RGBD_RGBD_UTIL_H
 
+#include <map>
+#include <string>
 #include <ros/ros.h>
+#include <boost/lexical_cast.hpp>
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
 #include <tf/transform_datatypes.h>
@@ -164,6 +167,47 @@ void convertMatToCameraInfo(
  */
 double getMsDuration(const ros::WallTime& start);
 
+/** @brief Returns a percentile of a set of values, using the
+ * nearest-rank method
+ * 
+ * @param sorted_values the values, sorted in ascending order
+ * @param percentile the percentile, in [0, 100]
+ * @return the percentile value, or 0 if there are no values
+ */
+double getPercentile(
+  const std::vector<double>& sorted_values, 
+  double percentile);
+
+/** @brief Benchmark command-line options, by name (without the "--")
+ */
+typedef std::map<std::string, std::string> OptionMap;
+
+/** @brief Parses "--option value" pairs from the command line
+ * 
+ * @param argc the argument count
+ * @param argv the arguments
+ * @param first index of the first option in argv
+ * @param options output map of the options
+ * @return false if an argument isn't a "--option value" pair
+ */
+bool parseOptions(int argc, char** argv, int first, OptionMap& options);
+
+/** @brief Returns the value of an option, or a default if it's not set
+ * 
+ * Throws boost::bad_lexical_cast if the value can't be converted to T.
+ */
+template <typename T>
+T getOption(const OptionMap& options, const std::string& key, const T& default_value)
+{
+  OptionMap::const_iterator it = options.find(key);
+  if (it == options.end()) return default_value;
+  return boost::lexical_cast<T>(it->second);
+}
+
+/** @brief Returns a random number, uniform in [0, 1]
+ */
+double uniform();
+
 void createRGBDFrameFromROSMessages(
   const ImageMsg::ConstPtr& rgb_msg,
   const ImageMsg::ConstPtr& depth_msg,
@@ -185,6 +229,19 @@ void pathROSToEigenAffine(
   const PathMsg& path_msg,
   AffineTransformVector& path);
 
+/** @brief Copies the header and the poses of a path message, starting
+ * from a given pose index, into another path message.
+ * 
+ * @param path_msg the input path
+ * @param start_index index of the first pose to copy. If it is past
+ *        the end of the path, the output has no poses.
+ * @param segment_msg the output path
+ */
+void getPathSegment(
+  const PathMsg& path_msg,
+  int start_index,
+  PathMsg& segment_msg);
+
 } // namespace ccny_rgbd
 
 #endif // CCNY_RGBD_RGBD_UTIL_H
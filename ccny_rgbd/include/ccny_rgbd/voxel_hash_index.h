@@ -0,0 +1,121 @@
+/**
+ *  @file voxel_hash_index.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_VOXEL_HASH_INDEX_H
+#define CCNY_RGBD_VOXEL_HASH_INDEX_H
+
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <stdint.h>
+#include <boost/unordered_map.hpp>
+
+#include "ccny_rgbd/types.h"
+
+namespace ccny_rgbd {
+
+/** @brief Nearest-neighbor index over a set of 3D points, with
+ * incremental insertion and removal.
+ *
+ * Points are bucketed into a hashed grid of cubic voxels. The index only
+ * stores point ids; the point coordinates are kept by the caller, and 
+ * passed to the queries. Queries search shells of voxels of increasing
+ * size around the query point, so the result is exact (the same as a 
+ * k-d tree) within the given search distance.
+ */
+class VoxelHashIndex
+{
+  public:
+
+    /** @brief Constructor
+     * @param voxel_size the voxel edge length (meters)
+     */
+    VoxelHashIndex(double voxel_size = 0.15);
+
+    /** @brief Sets the voxel edge length, and clears the index
+     */
+    void setVoxelSize(double voxel_size);
+
+    double getVoxelSize() const { return voxel_size_; }
+
+    /** @brief Removes all the points
+     */
+    void clear();
+
+    /** @brief Returns the number of points in the index
+     */
+    int size() const { return n_points_; }
+
+    /** @brief Adds a point
+     * @param id the point id
+     * @param point the point coordinates
+     */
+    void insert(int id, const Vector3f& point);
+
+    /** @brief Removes a point
+     * @param id the point id
+     * @param point the point coordinates, as they were inserted
+     * @retval false the point was not found
+     */
+    bool remove(int id, const Vector3f& point);
+
+    /** @brief Finds the k nearest points to a query point
+     * 
+     * @param query the query point
+     * @param points the coordinates of all the points, by id
+     * @param k the number of neighbors
+     * @param max_dist only points within this distance are returned (meters)
+     * @param ids output ids of the neighbors, nearest first
+     * @param dists_sq output squared distances of the neighbors
+     * @return the number of neighbors found, at most k
+     */
+    int nearestKSearch(const Vector3f& query,
+                       const Vector3fVector& points,
+                       int k,
+                       double max_dist,
+                       IntVector& ids,
+                       FloatVector& dists_sq) const;
+
+  private:
+
+    typedef uint64_t VoxelKey;
+    typedef boost::unordered_map<VoxelKey, IntVector> VoxelMap;
+
+    double voxel_size_;     ///< voxel edge length (meters)
+    double voxel_size_inv_; ///< 1 / voxel_size_
+    int n_points_;          ///< number of points in the index
+
+    VoxelMap voxels_;       ///< point ids, by voxel
+
+    /** @brief Returns the integer voxel coordinate of a point coordinate
+     */
+    int getVoxelCoordinate(float x) const;
+
+    /** @brief Packs the voxel coordinates into a hash key (21 bits each)
+     */
+    static VoxelKey getKey(int vx, int vy, int vz);
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_VOXEL_HASH_INDEX_H
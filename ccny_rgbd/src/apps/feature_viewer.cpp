@@ -55,6 +55,13 @@ FeatureViewer::FeatureViewer(
     "feature/covariances", 1);
   
   // **** subscribers
+
+  if (latest_frame_only_)
+  {
+    ROS_INFO("Processing only the latest frame");
+    scheduler_.reset(new LatestFrameScheduler(boost::bind(
+      &FeatureViewer::processRGBDMessages, this, _1, _2, _3)));
+  }
   
   ImageTransport rgb_it(nh_);
   ImageTransport depth_it(nh_);
@@ -72,6 +79,13 @@ FeatureViewer::FeatureViewer(
 
 FeatureViewer::~FeatureViewer()
 {
+  if (scheduler_)
+  {
+    ROS_INFO("Dropped %d of %d frames", 
+      scheduler_->getNDropped(), scheduler_->getNReceived());
+    scheduler_.reset();
+  }
+
   ROS_INFO("Destroying RGBD Feature Viewer"); 
 
   //delete feature_detector_;
@@ -81,6 +95,8 @@ void FeatureViewer::initParams()
 { 
   if (!nh_private_.getParam ("queue_size", queue_size_))
     queue_size_ = 5;
+  if (!nh_private_.getParam ("latest_frame_only", latest_frame_only_))
+    latest_frame_only_ = false;
   if (!nh_private_.getParam ("feature/detector_type", detector_type_))
     detector_type_ = "GFT";
   if (!nh_private_.getParam ("feature/show_keypoints", show_keypoints_))
@@ -93,6 +109,8 @@ void FeatureViewer::initParams()
 
 void FeatureViewer::resetDetector()
 {  
+  tiled_detector_.reset();
+
   gft_config_server_.reset();
   star_config_server_.reset();
   orb_config_server_.reset();
@@ -151,6 +169,17 @@ void FeatureViewer::RGBDCallback(
   const ImageMsg::ConstPtr& rgb_msg,
   const ImageMsg::ConstPtr& depth_msg,
   const CameraInfoMsg::ConstPtr& info_msg)
+{
+  if (scheduler_)
+    scheduler_->push(rgb_msg, depth_msg, info_msg);
+  else
+    processRGBDMessages(rgb_msg, depth_msg, info_msg);
+}
+
+void FeatureViewer::processRGBDMessages(
+  const ImageMsg::ConstPtr& rgb_msg,
+  const ImageMsg::ConstPtr& depth_msg,
+  const CameraInfoMsg::ConstPtr& info_msg)
 {
   mutex_.lock();
   
@@ -158,10 +187,17 @@ void FeatureViewer::RGBDCallback(
 
   // create frame
   rgbdtools::RGBDFrame frame;
-  createRGBDFrameFromROSMessages(rgb_msg, depth_msg, info_msg, frame); 
+  frame_factory_.createFrame(rgb_msg, depth_msg, info_msg, frame);
 
   // find features
-  feature_detector_->findFeatures(frame);
+  {
+    boost::mutex::scoped_lock lock(detector_mutex_);
+
+    if (tiled_detector_)
+      tiled_detector_->findFeatures(frame);
+    else
+      feature_detector_->findFeatures(frame);
+  }
  
   ros::WallTime end = ros::WallTime::now();
   
@@ -178,8 +214,17 @@ void FeatureViewer::RGBDCallback(
 
   double d_total = 1000.0 * (end - start).toSec();
 
-  printf("[FV %d] %s[%d][%d]: TOTAL %3.1f\n",
-    frame_count_, detector_type_.c_str(), n_features, n_valid_features, d_total);
+  if (scheduler_)
+  {
+    printf("[FV %d] %s[%d][%d]: TOTAL %3.1f DROPPED %d\n",
+      frame_count_, detector_type_.c_str(), n_features, n_valid_features, d_total,
+      scheduler_->getNDropped());
+  }
+  else
+  {
+    printf("[FV %d] %s[%d][%d]: TOTAL %3.1f\n",
+      frame_count_, detector_type_.c_str(), n_features, n_valid_features, d_total);
+  }
 
   frame_count_++;
   
@@ -288,6 +333,13 @@ void FeatureViewer::reconfigCallback(FeatureDetectorConfig& config, uint32_t lev
   feature_detector_->setSmooth(config.smooth);
   feature_detector_->setMaxRange(config.max_range);
   feature_detector_->setMaxStDev(config.max_stdev);
+
+  if (tiled_detector_)
+  {
+    tiled_detector_->setSmooth(config.smooth);
+    tiled_detector_->setMaxRange(config.max_range);
+    tiled_detector_->setMaxStDev(config.max_stdev);
+  }
   
   publish_cloud_ = config.publish_cloud;
   publish_covariances_ = config.publish_covariances;
@@ -296,31 +348,88 @@ void FeatureViewer::reconfigCallback(FeatureDetectorConfig& config, uint32_t lev
   mutex_.unlock();
 }
 
+void FeatureViewer::configureTiling(int grid_rows, int grid_cols)
+{
+  if (grid_rows * grid_cols <= 1)
+  {
+    tiled_detector_.reset();
+    return;
+  }
+
+  if (!tile_pool_)
+  {
+    // read here, since the reconfigure callbacks can fire before initParams()
+    int tile_threads;
+    if (!nh_private_.getParam ("feature/tile_threads", tile_threads))
+      tile_threads = boost::thread::hardware_concurrency();
+
+    tile_pool_.reset(new ThreadPool(tile_threads));
+  }
+
+  if (!tiled_detector_)
+  {
+    ROS_INFO("Using tiled %s detection", detector_type_.c_str());
+    tiled_detector_.reset(new TiledFeatureDetector(detector_type_, tile_pool_));
+    tiled_detector_->setSmooth(feature_detector_->getSmooth());
+    tiled_detector_->setMaxRange(feature_detector_->getMaxRange());
+    tiled_detector_->setMaxStDev(feature_detector_->getMaxStDev());
+  }
+
+  tiled_detector_->setGrid(grid_rows, grid_cols);
+}
+
 void FeatureViewer::gftReconfigCallback(GftDetectorConfig& config, uint32_t level)
 {
+  boost::mutex::scoped_lock lock(detector_mutex_);
+
   rgbdtools::GftDetectorPtr gft_detector = 
     boost::static_pointer_cast<rgbdtools::GftDetector>(feature_detector_);
     
   gft_detector->setNFeatures(config.n_features);
   gft_detector->setMinDistance(config.min_distance); 
+
+  configureTiling(config.grid_rows, config.grid_cols);
+  if (tiled_detector_)
+  {
+    tiled_detector_->setNFeatures(config.n_features);
+    tiled_detector_->setMinDistance(config.min_distance);
+  }
 }
 
 void FeatureViewer::starReconfigCallback(StarDetectorConfig& config, uint32_t level)
 {
+  boost::mutex::scoped_lock lock(detector_mutex_);
+
   rgbdtools::StarDetectorPtr star_detector = 
     boost::static_pointer_cast<rgbdtools::StarDetector>(feature_detector_);
     
   star_detector->setThreshold(config.threshold);
   star_detector->setMinDistance(config.min_distance); 
+
+  configureTiling(config.grid_rows, config.grid_cols);
+  if (tiled_detector_)
+  {
+    tiled_detector_->setThreshold(config.threshold);
+    tiled_detector_->setMinDistance(config.min_distance);
+  }
 }
     
 void FeatureViewer::orbReconfigCallback(OrbDetectorConfig& config, uint32_t level)
 {
+  boost::mutex::scoped_lock lock(detector_mutex_);
+
   rgbdtools::OrbDetectorPtr orb_detector = 
     boost::static_pointer_cast<rgbdtools::OrbDetector>(feature_detector_);
     
   orb_detector->setThreshold(config.threshold);
   orb_detector->setNFeatures(config.n_features);
+
+  configureTiling(config.grid_rows, config.grid_cols);
+  if (tiled_detector_)
+  {
+    tiled_detector_->setThreshold(config.threshold);
+    tiled_detector_->setNFeatures(config.n_features);
+  }
 }
 
 } //namespace ccny_rgbd
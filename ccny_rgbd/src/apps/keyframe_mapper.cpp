@@ -30,7 +30,8 @@ KeyframeMapper::KeyframeMapper(
   const ros::NodeHandle& nh_private):
   nh_(nh), 
   nh_private_(nh_private),
-  rgbd_frame_index_(0)
+  rgbd_frame_index_(0),
+  path_delta_index_(0)
 {
   ROS_INFO("Starting RGBD Keyframe Mapper");
    
@@ -38,16 +39,28 @@ KeyframeMapper::KeyframeMapper(
   
   initParams();
   
-  // **** publishers
+  // **** publishers: outputs are only generated while they have subscribers
   
   keyframes_pub_ = nh_.advertise<PointCloudT>(
-    "keyframes", queue_size_);
+    "keyframes", queue_size_,
+    boost::bind(&SubscriberCounter::connect,    &keyframes_subscribers_),
+    boost::bind(&SubscriberCounter::disconnect, &keyframes_subscribers_));
   poses_pub_ = nh_.advertise<visualization_msgs::Marker>( 
-    "keyframe_poses", queue_size_);
+    "keyframe_poses", queue_size_,
+    boost::bind(&SubscriberCounter::connect,    &poses_subscribers_),
+    boost::bind(&SubscriberCounter::disconnect, &poses_subscribers_));
   kf_assoc_pub_ = nh_.advertise<visualization_msgs::Marker>( 
-    "keyframe_associations", queue_size_);
+    "keyframe_associations", queue_size_,
+    boost::bind(&SubscriberCounter::connect,    &kf_assoc_subscribers_),
+    boost::bind(&SubscriberCounter::disconnect, &kf_assoc_subscribers_));
   path_pub_ = nh_.advertise<PathMsg>( 
-    "mapper_path", queue_size_);
+    "mapper_path", queue_size_,
+    boost::bind(&SubscriberCounter::connect,    &path_subscribers_),
+    boost::bind(&SubscriberCounter::disconnect, &path_subscribers_));
+  path_delta_pub_ = nh_.advertise<PathMsg>( 
+    "mapper_path_delta", queue_size_,
+    boost::bind(&SubscriberCounter::connect,    &path_delta_subscribers_),
+    boost::bind(&SubscriberCounter::disconnect, &path_delta_subscribers_));
   
   // **** services
   
@@ -69,9 +82,18 @@ KeyframeMapper::KeyframeMapper(
     "generate_graph", &KeyframeMapper::generateGraphSrvCallback, this);
    solve_graph_service_ = nh_.advertiseService(
     "solve_graph", &KeyframeMapper::solveGraphSrvCallback, this);
+  get_path_service_ = nh_.advertiseService(
+    "get_mapper_path", &KeyframeMapper::getPathSrvCallback, this);
  
   // **** subscribers
 
+  if (latest_frame_only_)
+  {
+    ROS_INFO("Processing only the latest frame");
+    scheduler_.reset(new LatestFrameScheduler(boost::bind(
+      &KeyframeMapper::processRGBDMessages, this, _1, _2, _3)));
+  }
+
   ImageTransport rgb_it(nh_);
   ImageTransport depth_it(nh_);
 
@@ -88,7 +110,12 @@ KeyframeMapper::KeyframeMapper(
 
 KeyframeMapper::~KeyframeMapper()
 {
-
+  if (scheduler_)
+  {
+    ROS_INFO("Dropped %d of %d frames", 
+      scheduler_->getNDropped(), scheduler_->getNReceived());
+    scheduler_.reset();
+  }
 }
 
 void KeyframeMapper::initParams()
@@ -99,6 +126,8 @@ void KeyframeMapper::initParams()
     verbose = false;
   if (!nh_private_.getParam ("queue_size", queue_size_))
     queue_size_ = 5;
+  if (!nh_private_.getParam ("latest_frame_only", latest_frame_only_))
+    latest_frame_only_ = false;
   if (!nh_private_.getParam ("fixed_frame", fixed_frame_))
     fixed_frame_ = "/odom";
   if (!nh_private_.getParam ("pcd_map_res", pcd_map_res_))
@@ -117,6 +146,13 @@ void KeyframeMapper::initParams()
     max_stdev_  = 0.03;
   if (!nh_private_.getParam ("max_map_z", max_map_z_))
     max_map_z_ = std::numeric_limits<double>::infinity();
+  if (!nh_private_.getParam ("path/window_size", path_window_size_))
+    path_window_size_ = 0;
+  if (!nh_private_.getParam ("path/decimation", path_decimation_))
+    path_decimation_ = 1;
+
+  path_window_size_ = std::max(0, path_window_size_);
+  path_decimation_  = std::max(1, path_decimation_);
    
   // configure graph detection 
     
@@ -147,6 +183,23 @@ void KeyframeMapper::RGBDCallback(
   const ImageMsg::ConstPtr& depth_msg,
   const CameraInfoMsg::ConstPtr& info_msg)
 {
+  if (scheduler_)
+    scheduler_->push(rgb_msg, depth_msg, info_msg);
+  else
+    processRGBDMessages(rgb_msg, depth_msg, info_msg);
+}
+
+void KeyframeMapper::processRGBDMessages(
+  const ImageMsg::ConstPtr& rgb_msg,
+  const ImageMsg::ConstPtr& depth_msg,
+  const CameraInfoMsg::ConstPtr& info_msg)
+{
+  if (scheduler_ && scheduler_->getNDropped() > 0)
+  {
+    ROS_INFO_THROTTLE(10.0, "[Mapper] Dropped %d of %d frames",
+      scheduler_->getNDropped(), scheduler_->getNReceived());
+  }
+
   tf::StampedTransform transform;
 
   const ros::Time& time = rgb_msg->header.stamp;
@@ -162,16 +215,19 @@ void KeyframeMapper::RGBDCallback(
     return;
   }
   
+  boost::mutex::scoped_lock lock(mutex_);
+
   // create a new frame and increment the counter
   rgbdtools::RGBDFrame frame;
-  createRGBDFrameFromROSMessages(rgb_msg, depth_msg, info_msg, frame); 
+  frame_factory_.createFrame(rgb_msg, depth_msg, info_msg, frame);
   frame.index = rgbd_frame_index_;
   rgbd_frame_index_++;
   
   bool result = processFrame(frame, eigenAffineFromTf(transform));
   if (result) publishKeyframeData(keyframes_.size() - 1);
   
-  publishPath();
+  publishPathDelta();
+  if (path_msg_.poses.size() % path_decimation_ == 0) publishPath();
 }
 
 
@@ -240,6 +296,8 @@ bool KeyframeMapper::publishKeyframeSrvCallback(
   PublishKeyframe::Request& request,
   PublishKeyframe::Response& response)
 {
+  boost::mutex::scoped_lock lock(mutex_);
+
   int kf_idx = request.id;
   
   if (kf_idx >= 0 && kf_idx < (int)keyframes_.size())
@@ -259,7 +317,9 @@ bool KeyframeMapper::publishKeyframeSrvCallback(
 bool KeyframeMapper::publishKeyframesSrvCallback(
   PublishKeyframes::Request& request,
   PublishKeyframes::Response& response)
-{ 
+{
+  boost::mutex::scoped_lock lock(mutex_);
+ 
   bool found_match = false;
 
   // regex matching - try match the request string against each
@@ -291,6 +351,8 @@ bool KeyframeMapper::publishKeyframesSrvCallback(
 
 void KeyframeMapper::publishKeyframeData(int i)
 {
+  if (!keyframes_subscribers_.hasSubscribers()) return;
+
   rgbdtools::RGBDKeyframe& keyframe = keyframes_[i];
 
   // construct a cloud from the images
@@ -308,6 +370,8 @@ void KeyframeMapper::publishKeyframeData(int i)
 
 void KeyframeMapper::publishKeyframeAssociations()
 {
+  if (!kf_assoc_subscribers_.hasSubscribers()) return;
+
   visualization_msgs::Marker marker;
   marker.header.stamp = ros::Time::now();
   marker.header.frame_id = fixed_frame_;
@@ -369,6 +433,8 @@ void KeyframeMapper::publishKeyframeAssociations()
 
 void KeyframeMapper::publishKeyframePoses()
 {
+  if (!poses_subscribers_.hasSubscribers()) return;
+
   for(unsigned int kf_idx = 0; kf_idx < keyframes_.size(); ++kf_idx)
   {
     publishKeyframePose(kf_idx);
@@ -377,6 +443,8 @@ void KeyframeMapper::publishKeyframePoses()
 
 void KeyframeMapper::publishKeyframePose(int i)
 {
+  if (!poses_subscribers_.hasSubscribers()) return;
+
   rgbdtools::RGBDKeyframe& keyframe = keyframes_[i];
 
   // **** publish camera pose
@@ -449,6 +517,8 @@ bool KeyframeMapper::saveKeyframesSrvCallback(
   Save::Request& request,
   Save::Response& response)
 {
+  boost::mutex::scoped_lock lock(mutex_);
+
   std::string filepath = request.filename;
  
   ROS_INFO("Saving keyframes...");
@@ -470,6 +540,8 @@ bool KeyframeMapper::loadKeyframesSrvCallback(
   Load::Request& request,
   Load::Response& response)
 {
+  boost::mutex::scoped_lock lock(mutex_);
+
   std::string filepath = request.filename;
   
   ROS_INFO("Loading keyframes...");
@@ -490,6 +562,8 @@ bool KeyframeMapper::savePcdMapSrvCallback(
   Save::Request& request,
   Save::Response& response)
 {
+  boost::mutex::scoped_lock lock(mutex_);
+
   ROS_INFO("Saving map as pcd...");
   const std::string& path = request.filename; 
   bool result = savePcdMap(path);
@@ -504,6 +578,8 @@ bool KeyframeMapper::saveOctomapSrvCallback(
   Save::Request& request,
   Save::Response& response)
 {
+  boost::mutex::scoped_lock lock(mutex_);
+
   ROS_INFO("Saving map as Octomap...");
   const std::string& path = request.filename;
   bool result = saveOctomap(path);
@@ -518,6 +594,8 @@ bool KeyframeMapper::addManualKeyframeSrvCallback(
   AddManualKeyframe::Request& request,
   AddManualKeyframe::Response& response)
 {
+  boost::mutex::scoped_lock lock(mutex_);
+
   manual_add_ = true;
 
   return true;
@@ -527,6 +605,8 @@ bool KeyframeMapper::generateGraphSrvCallback(
   GenerateGraph::Request& request,
   GenerateGraph::Response& response)
 {
+  boost::mutex::scoped_lock lock(mutex_);
+
   associations_.clear();
   graph_detector_.generateKeyframeAssociations(keyframes_, associations_);
 
@@ -542,6 +622,8 @@ bool KeyframeMapper::solveGraphSrvCallback(
   SolveGraph::Request& request,
   SolveGraph::Response& response)
 {
+  boost::mutex::scoped_lock lock(mutex_);
+
   ros::WallTime start = ros::WallTime::now();
   
   // Graph solving: keyframe positions only, path is interpolated
@@ -816,7 +898,48 @@ void KeyframeMapper::buildColorOctomap(octomap::ColorOcTree& tree)
 void KeyframeMapper::publishPath()
 {
   path_msg_.header.frame_id = fixed_frame_; 
-  path_pub_.publish(path_msg_);
+
+  if (!path_subscribers_.hasSubscribers()) return;
+
+  if (path_window_size_ == 0)
+  {
+    path_pub_.publish(path_msg_);
+  }
+  else
+  {
+    PathMsg::Ptr window_msg = boost::make_shared<PathMsg>();
+    int start_index = (int)path_msg_.poses.size() - path_window_size_;
+    getPathSegment(path_msg_, start_index, *window_msg);
+    path_pub_.publish(window_msg);
+  }
+}
+
+void KeyframeMapper::publishPathDelta()
+{
+  path_msg_.header.frame_id = fixed_frame_; 
+
+  if (path_delta_subscribers_.hasSubscribers())
+  {
+    PathMsg::Ptr delta_msg = boost::make_shared<PathMsg>();
+    getPathSegment(path_msg_, path_delta_index_, *delta_msg);
+    path_delta_pub_.publish(delta_msg);
+  }
+  
+  path_delta_index_ = path_msg_.poses.size();
+}
+
+bool KeyframeMapper::getPathSrvCallback(
+  GetPath::Request& request,
+  GetPath::Response& response)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+
+  int start_index = std::min(
+    request.start_index, (uint32_t)path_msg_.poses.size());
+
+  path_msg_.header.frame_id = fixed_frame_; 
+  getPathSegment(path_msg_, start_index, response.path);
+  return true;
 }
 
 bool KeyframeMapper::savePath(const std::string& filepath)
@@ -920,6 +1043,9 @@ bool KeyframeMapper::loadPath(const std::string& filepath)
   }
     
   file.close();
+
+  // the loaded poses are not sent as a delta
+  path_delta_index_ = path_msg_.poses.size();
   return true;
 }
 
@@ -0,0 +1,92 @@
+/**
+ *  @file multi_visual_odometry.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ * 
+ *  @section LICENSE
+ * 
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/apps/multi_visual_odometry.h"
+
+#include <sstream>
+
+namespace ccny_rgbd {
+
+MultiVisualOdometry::MultiVisualOdometry(
+  const ros::NodeHandle& nh, 
+  const ros::NodeHandle& nh_private):
+  nh_(nh), 
+  nh_private_(nh_private)
+{
+  ROS_INFO("Starting RGBD Multi-camera Visual Odometry");
+
+  // **** parameters
+
+  if (!nh_private_.getParam ("cameras", cameras_))
+    cameras_ = "";
+  if (!nh_private_.getParam ("n_threads", n_threads_))
+    n_threads_ = 2;
+
+  std::vector<std::string> namespaces;
+  std::istringstream stream(cameras_);
+  std::string ns;
+  while (stream >> ns) namespaces.push_back(ns);
+
+  if (namespaces.empty())
+  {
+    ROS_ERROR("No camera namespaces given in ~cameras");
+    return;
+  }
+
+  // **** pool and pipelines
+
+  pool_.reset(new ThreadPool(n_threads_));
+
+  for (unsigned int i = 0; i < namespaces.size(); ++i)
+  {
+    // VisualOdometry subscribes to absolute topic names: 
+    // remap them into the camera namespace
+    ros::M_string remappings;
+    remappings["/rgbd/rgb"]   = "rgbd/rgb";
+    remappings["/rgbd/depth"] = "rgbd/depth";
+    remappings["/rgbd/info"]  = "rgbd/info";
+
+    // keep all the statuses on one diagnostics topic
+    remappings["diagnostics"] = nh_.resolveName("diagnostics");
+
+    ros::NodeHandle nh_camera(nh_, namespaces[i], remappings);
+    ros::NodeHandle nh_private_camera(nh_private_, namespaces[i]);
+
+    ROS_INFO("Camera %d: %s", i, nh_camera.getNamespace().c_str());
+
+    streams_.push_back(boost::make_shared<VisualOdometry>(
+      nh_camera, nh_private_camera, pool_));
+  }
+
+  ROS_INFO("Running %d cameras on %d threads", 
+    (int)streams_.size(), pool_->getNThreads());
+}
+
+MultiVisualOdometry::~MultiVisualOdometry()
+{
+  // the pipelines finish their pool tasks before the pool goes away
+  streams_.clear();
+  pool_.reset();
+}
+
+} // namespace ccny_rgbd
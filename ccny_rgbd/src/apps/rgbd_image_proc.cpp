@@ -23,6 +23,10 @@
 
 #include "ccny_rgbd/apps/rgbd_image_proc.h"
 
+#include <cstdio>
+#include <limits>
+#include <fstream>
+
 namespace ccny_rgbd {
 
 RGBDImageProc::RGBDImageProc(
@@ -32,7 +36,7 @@ RGBDImageProc::RGBDImageProc(
   rgb_image_transport_(nh_),
   depth_image_transport_(nh_), 
   config_server_(nh_private_),
-  size_in_(0,0)
+  building_maps_(false)
 { 
   // parameters 
   if (!nh_private_.getParam ("queue_size", queue_size_))
@@ -45,6 +49,14 @@ RGBDImageProc::RGBDImageProc(
     verbose_ = false;
   if (!nh_private_.getParam("publish_cloud", publish_cloud_))
     publish_cloud_ = true;
+  if (!nh_private_.getParam("fused_depth", fused_depth_))
+    fused_depth_ = true;
+  if (!nh_private_.getParam("n_threads", n_threads_))
+    n_threads_ = boost::thread::hardware_concurrency();
+  if (!nh_private_.getParam("msg_pool_size", msg_pool_size_))
+    msg_pool_size_ = 8;
+  if (!nh_private_.getParam("map_cache", map_cache_))
+    map_cache_ = true;
   if (!nh_private_.getParam("calib_path", calib_path_))
   {
     std::string home_path = getenv("HOME");
@@ -53,6 +65,7 @@ RGBDImageProc::RGBDImageProc(
 
   calib_extr_filename_ = calib_path_ + "/extr.yml";
   calib_warp_filename_ = calib_path_ + "/warp.yml";
+  map_cache_path_      = calib_path_ + "/map_cache";
   
   // load calibration (extrinsics, depth unwarp params) from files
   loadCalibration();
@@ -66,17 +79,44 @@ RGBDImageProc::RGBDImageProc(
     }
   }
   
-  // publishers
+  // the calibration files are part of the map cache keys
+  calib_hash_ = MapCache::hash(NULL, 0);
+  MapCache::hashFile(calib_extr_filename_, calib_hash_);
+  if (unwarp_)
+    MapCache::hashFile(calib_warp_filename_, calib_hash_);
+  
+  if (map_cache_)
+    preloadMapCache();
+  
+  // row bands: a few per thread, for load balancing. The
+  // callback thread runs bands too.
+  if (n_threads_ > 1)
+  {
+    pool_.reset(new ThreadPool(n_threads_ - 1));
+    n_bands_ = 4 * n_threads_;
+  }
+  else
+    n_bands_ = 1;
+  
+  rgb_msg_pool_.setMaxSize(msg_pool_size_);
+  depth_msg_pool_.setMaxSize(msg_pool_size_);
+  
+  // publishers: outputs are only computed while they have subscribers
   rgb_publisher_   = rgb_image_transport_.advertise(
-    "rgbd/rgb", queue_size_);
+    "rgbd/rgb", queue_size_,
+    boost::bind(&SubscriberCounter::connect,    &rgb_subscribers_),
+    boost::bind(&SubscriberCounter::disconnect, &rgb_subscribers_));
   depth_publisher_ = depth_image_transport_.advertise(
-    "rgbd/depth", queue_size_);
+    "rgbd/depth", queue_size_,
+    boost::bind(&SubscriberCounter::connect,    &depth_subscribers_),
+    boost::bind(&SubscriberCounter::disconnect, &depth_subscribers_));
   info_publisher_  = nh_.advertise<CameraInfoMsg>(
-    "rgbd/info", queue_size_);
+    "rgbd/info", queue_size_,
+    boost::bind(&SubscriberCounter::connect,    &info_subscribers_),
+    boost::bind(&SubscriberCounter::disconnect, &info_subscribers_));
 
   if(publish_cloud_)
-    cloud_publisher_ = nh_.advertise<PointCloudT>(
-          "rgbd/cloud", queue_size_);
+    advertiseCloud();
 
   // dynamic reconfigure
   ProcConfigServer::CallbackType f = boost::bind(&RGBDImageProc::reconfigCallback, this, _1, _2);
@@ -103,6 +143,9 @@ RGBDImageProc::RGBDImageProc(
 RGBDImageProc::~RGBDImageProc()
 {
   ROS_INFO("Destroying RGBDImageProc"); 
+  
+  // a background map build still uses the calibration
+  map_thread_.join();
 }
 
 bool RGBDImageProc::loadCalibration()
@@ -143,13 +186,64 @@ bool RGBDImageProc::loadUnwarpCalibration()
   return true;
 }
 
-void RGBDImageProc::initMaps(
+void RGBDImageProc::buildMaps(
   const CameraInfoMsg::ConstPtr& rgb_info_msg,
-  const CameraInfoMsg::ConstPtr& depth_info_msg)
+  const CameraInfoMsg::ConstPtr& depth_info_msg,
+  const cv::Size& size_in,
+  double scale,
+  RectificationMaps& maps) const
 { 
-  boost::mutex::scoped_lock(mutex_);
+  maps.size_in = size_in;
+  maps.scale   = scale;
+  
+  // **** from the cache, if they were built before from the same inputs
+  if (map_cache_)
+  {
+    uint64_t key = getMapCacheKey(rgb_info_msg, depth_info_msg, size_in, scale);
+    
+    if (loadMapCache(key, maps))
+    {
+      ROS_INFO("Loaded rectification maps (scale %.2f) from %s", 
+        scale, getMapCacheFilename(key).c_str());
+    }
+    else
+    {
+      computeMaps(rgb_info_msg, depth_info_msg, size_in, scale, maps);
+      
+      if (!saveMapCache(key, maps))
+        ROS_WARN("Could not write %s", getMapCacheFilename(key).c_str());
+    }
+    
+    setLastMapCacheKey(key);
+  }
+  else
+    computeMaps(rgb_info_msg, depth_info_msg, size_in, scale, maps);
   
-  ROS_INFO("Initializing rectification maps");
+  maps.depth_registration.setPool(pool_, n_bands_);
+  
+  // **** save new intrinsics as camera models
+  cv::Size size_out = maps.map_rgb_1.size();
+  
+  maps.rgb_rect_info_msg.header = rgb_info_msg->header;
+  maps.rgb_rect_info_msg.width  = size_out.width;
+  maps.rgb_rect_info_msg.height = size_out.height;  
+
+  maps.depth_rect_info_msg.header = depth_info_msg->header;
+  maps.depth_rect_info_msg.width  = size_out.width;
+  maps.depth_rect_info_msg.height = size_out.height;  
+  
+  convertMatToCameraInfo(maps.intr_rect_rgb,   maps.rgb_rect_info_msg);
+  convertMatToCameraInfo(maps.intr_rect_depth, maps.depth_rect_info_msg);  
+}
+
+void RGBDImageProc::computeMaps(
+  const CameraInfoMsg::ConstPtr& rgb_info_msg,
+  const CameraInfoMsg::ConstPtr& depth_info_msg,
+  const cv::Size& size_in,
+  double scale,
+  RectificationMaps& maps) const
+{ 
+  ROS_INFO("Initializing rectification maps (scale %.2f)", scale);
   
   // **** get OpenCV matrices from CameraInfo messages
   cv::Mat intr_rgb, intr_depth;
@@ -161,12 +255,12 @@ void RGBDImageProc::initMaps(
   // **** sizes 
   double alpha = 0.0;
     
-  if (size_in_.width  != (int)rgb_info_msg->width || 
-      size_in_.height != (int)rgb_info_msg->height)
+  if (size_in.width  != (int)rgb_info_msg->width || 
+      size_in.height != (int)rgb_info_msg->height)
   {
     ROS_WARN("Image size does not match CameraInfo size. Rescaling.");
-    double w_factor = (double)size_in_.width  / (double)rgb_info_msg->width;
-    double h_factor = (double)size_in_.height / (double)rgb_info_msg->height;
+    double w_factor = (double)size_in.width  / (double)rgb_info_msg->width;
+    double h_factor = (double)size_in.height / (double)rgb_info_msg->height;
     
     intr_rgb.at<double>(0,0) *= w_factor;
     intr_rgb.at<double>(1,1) *= h_factor;   
@@ -180,44 +274,191 @@ void RGBDImageProc::initMaps(
   }
   
   cv::Size size_out;
-  size_out.height = size_in_.height * scale_;
-  size_out.width  = size_in_.width  * scale_;
+  size_out.height = size_in.height * scale;
+  size_out.width  = size_in.width  * scale;
    
   // **** get optimal camera matrices
-  intr_rect_rgb_ = cv::getOptimalNewCameraMatrix(
-    intr_rgb, dist_rgb, size_in_, alpha, size_out);
+  maps.intr_rect_rgb = cv::getOptimalNewCameraMatrix(
+    intr_rgb, dist_rgb, size_in, alpha, size_out);
  
-  intr_rect_depth_ = cv::getOptimalNewCameraMatrix(
-    intr_depth, dist_depth, size_in_, alpha, size_out);
+  maps.intr_rect_depth = cv::getOptimalNewCameraMatrix(
+    intr_depth, dist_depth, size_in, alpha, size_out);
       
   // **** create undistortion maps
   cv::initUndistortRectifyMap(
-    intr_rgb, dist_rgb, cv::Mat(), intr_rect_rgb_, 
-    size_out, CV_16SC2, map_rgb_1_, map_rgb_2_);
+    intr_rgb, dist_rgb, cv::Mat(), maps.intr_rect_rgb, 
+    size_out, CV_16SC2, maps.map_rgb_1, maps.map_rgb_2);
   
   cv::initUndistortRectifyMap(
-    intr_depth, dist_depth, cv::Mat(), intr_rect_depth_, 
-    size_out, CV_16SC2, map_depth_1_, map_depth_2_);  
+    intr_depth, dist_depth, cv::Mat(), maps.intr_rect_depth, 
+    size_out, CV_16SC2, maps.map_depth_1, maps.map_depth_2);  
   
   // **** rectify the coefficient images
   if(unwarp_)
   {
-    cv::remap(coeff_0_, coeff_0_rect_, map_depth_1_, map_depth_2_,  cv::INTER_NEAREST);
-    cv::remap(coeff_1_, coeff_1_rect_, map_depth_1_, map_depth_2_,  cv::INTER_NEAREST);
-    cv::remap(coeff_2_, coeff_2_rect_, map_depth_1_, map_depth_2_,  cv::INTER_NEAREST);
+    cv::remap(coeff_0_, maps.coeff_0_rect, maps.map_depth_1, maps.map_depth_2,  cv::INTER_NEAREST);
+    cv::remap(coeff_1_, maps.coeff_1_rect, maps.map_depth_1, maps.map_depth_2,  cv::INTER_NEAREST);
+    cv::remap(coeff_2_, maps.coeff_2_rect, maps.map_depth_1, maps.map_depth_2,  cv::INTER_NEAREST);
   }
 
-  // **** save new intrinsics as camera models
-  rgb_rect_info_msg_.header = rgb_info_msg->header;
-  rgb_rect_info_msg_.width  = size_out.width;
-  rgb_rect_info_msg_.height = size_out.height;  
+  // **** fused depth pass: same nearest neighbor lookups as the
+  // rectification of the coefficient images above
+  maps.depth_registration.setRectificationMap(maps.map_depth_1);
+  maps.depth_registration.setTransform(
+    maps.intr_rect_depth, maps.intr_rect_rgb, ir2rgb_);
+  
+  if (unwarp_)
+    maps.depth_registration.setUnwarpCoefficients(
+      maps.coeff_0_rect, maps.coeff_1_rect, maps.coeff_2_rect, fit_mode_);
+  else
+    maps.depth_registration.disableUnwarp();
+}
+
+/** @brief Continues a hash with the parts of a CameraInfo the maps depend on
+ */
+static uint64_t hashCameraInfo(
+  const CameraInfoMsg::ConstPtr& info_msg, uint64_t hash)
+{
+  uint32_t size[2] = { info_msg->width, info_msg->height };
+  uint32_t d_size = info_msg->D.size();
+  
+  hash = MapCache::hash(size, sizeof(size), hash);
+  hash = MapCache::hash(&info_msg->K[0], 9 * sizeof(double), hash);
+  hash = MapCache::hash(&d_size, sizeof(d_size), hash);
+  if (d_size > 0)
+    hash = MapCache::hash(&info_msg->D[0], d_size * sizeof(double), hash);
+  
+  return hash;
+}
 
-  depth_rect_info_msg_.header = depth_info_msg->header;
-  depth_rect_info_msg_.width  = size_out.width;
-  depth_rect_info_msg_.height = size_out.height;  
+uint64_t RGBDImageProc::getMapCacheKey(
+  const CameraInfoMsg::ConstPtr& rgb_info_msg,
+  const CameraInfoMsg::ConstPtr& depth_info_msg,
+  const cv::Size& size_in,
+  double scale) const
+{
+  uint32_t version = MapCache::VERSION;
+  int32_t values[3] = { size_in.width, size_in.height, unwarp_ ? 1 : 0 };
+  
+  uint64_t key = calib_hash_;
+  key = MapCache::hash(&version, sizeof(version), key);
+  key = MapCache::hash(values, sizeof(values), key);
+  key = MapCache::hash(&scale, sizeof(scale), key);
+  key = hashCameraInfo(rgb_info_msg, key);
+  key = hashCameraInfo(depth_info_msg, key);
+  
+  return key;
+}
+
+std::string RGBDImageProc::getMapCacheFilename(uint64_t key) const
+{
+  char filename[64];
+  sprintf(filename, "/rect_maps_%016llx.bin", (unsigned long long)key);
+  return map_cache_path_ + filename;
+}
+
+bool RGBDImageProc::loadMapCache(uint64_t key, RectificationMaps& maps) const
+{
+  // the file preloaded at startup, or a new mapping
+  MapCachePtr cache = preloaded_map_cache_;
+  
+  if (!cache || cache->getKey() != key)
+  {
+    cache = boost::make_shared<MapCache>();
+    if (!cache->load(getMapCacheFilename(key), key)) return false;
+  }
+  
+  // a copy, so that missing images read as empty
+  MapCache::MatMap mats = cache->getMats();
+  
+  maps.intr_rect_rgb   = mats["intr_rect_rgb"];
+  maps.intr_rect_depth = mats["intr_rect_depth"];
+  maps.map_rgb_1       = mats["map_rgb_1"];
+  maps.map_rgb_2       = mats["map_rgb_2"];
+  maps.map_depth_1     = mats["map_depth_1"];
+  maps.map_depth_2     = mats["map_depth_2"];
+  maps.coeff_0_rect    = mats["coeff_0_rect"];
+  maps.coeff_1_rect    = mats["coeff_1_rect"];
+  maps.coeff_2_rect    = mats["coeff_2_rect"];
+  
+  if (maps.intr_rect_rgb.size()   != cv::Size(3, 3) ||
+      maps.intr_rect_depth.size() != cv::Size(3, 3) ||
+      maps.map_rgb_1.empty() || maps.map_depth_1.empty())
+    return false;
+  
+  maps.depth_registration.setRectificationMap(maps.map_depth_1);
+  if (!maps.depth_registration.setTables(mats)) return false;
+  
+  maps.cache = cache;
+  return true;
+}
+
+bool RGBDImageProc::saveMapCache(
+  uint64_t key, const RectificationMaps& maps) const
+{
+  MapCache::MatMap mats;
+  
+  mats["intr_rect_rgb"]   = maps.intr_rect_rgb;
+  mats["intr_rect_depth"] = maps.intr_rect_depth;
+  mats["map_rgb_1"]       = maps.map_rgb_1;
+  mats["map_rgb_2"]       = maps.map_rgb_2;
+  mats["map_depth_1"]     = maps.map_depth_1;
+  mats["map_depth_2"]     = maps.map_depth_2;
+  mats["coeff_0_rect"]    = maps.coeff_0_rect;
+  mats["coeff_1_rect"]    = maps.coeff_1_rect;
+  mats["coeff_2_rect"]    = maps.coeff_2_rect;
+  
+  maps.depth_registration.getTables(mats);
+  
+  return MapCache::save(getMapCacheFilename(key), key, mats);
+}
+
+void RGBDImageProc::preloadMapCache()
+{
+  std::ifstream last_file((map_cache_path_ + "/last").c_str());
+  
+  unsigned long long key;
+  if (!(last_file >> std::hex >> key)) return;
+  
+  MapCachePtr cache = boost::make_shared<MapCache>();
+  
+  if (cache->load(getMapCacheFilename(key), key))
+  {
+    ROS_INFO("Mapped %s", getMapCacheFilename(key).c_str());
+    preloaded_map_cache_ = cache;
+  }
+}
+
+void RGBDImageProc::setLastMapCacheKey(uint64_t key) const
+{
+  // best effort: a missing or stale record only costs the preload
+  std::ofstream last_file((map_cache_path_ + "/last").c_str());
+  last_file << std::hex << (unsigned long long)key << std::endl;
+}
+
+void RGBDImageProc::buildMapsInBackground(
+  const CameraInfoMsg::ConstPtr& rgb_info_msg,
+  const CameraInfoMsg::ConstPtr& depth_info_msg,
+  const cv::Size& size_in,
+  double scale)
+{
+  ros::WallTime start = ros::WallTime::now();
+  
+  RectificationMapsPtr maps = boost::make_shared<RectificationMaps>();
+  buildMaps(rgb_info_msg, depth_info_msg, size_in, scale, *maps);
+  
+  boost::mutex::scoped_lock lock(mutex_);
   
-  convertMatToCameraInfo(intr_rect_rgb_,   rgb_rect_info_msg_);
-  convertMatToCameraInfo(intr_rect_depth_, depth_rect_info_msg_);  
+  // the image size may have changed in the meantime, in which case
+  // the callback has already built maps for the new size
+  if (maps_ && maps_->size_in == size_in)
+  {
+    maps_ = maps;
+    ROS_INFO("Rectification maps (scale %.2f) swapped in after %.1f ms",
+      scale, getMsDuration(start));
+  }
+  
+  building_maps_ = false;
 }
 
 void RGBDImageProc::RGBDCallback(
@@ -226,8 +467,6 @@ void RGBDImageProc::RGBDCallback(
   const CameraInfoMsg::ConstPtr& rgb_info_msg,
   const CameraInfoMsg::ConstPtr& depth_info_msg)
 {  
-  boost::mutex::scoped_lock(mutex_);
-  
   // for profiling
   double dur_unwarp, dur_rectify, dur_reproject, dur_cloud, dur_allocate; 
   
@@ -239,18 +478,52 @@ void RGBDImageProc::RGBDCallback(
     return;
   }
   
-  // **** initialize if needed
-  if (size_in_.height != (int)rgb_msg->height ||
-      size_in_.width  != (int)rgb_msg->width)
-  {
-    ROS_INFO("Initializing");
+  // **** only the outputs somebody listens to
+  bool publish_rgb   = rgb_subscribers_.hasSubscribers();
+  bool publish_depth = depth_subscribers_.hasSubscribers();
+  bool publish_info  = info_subscribers_.hasSubscribers();
+  bool publish_cloud = cloud_subscribers_.hasSubscribers();
+  
+  // **** get the current maps, and the state shared with the
+  // reconfigure callback. Everything else runs without the lock.
+  cv::Size size_in((int)rgb_msg->width, (int)rgb_msg->height);
+  RectificationMapsConstPtr maps;
+  ros::Publisher cloud_publisher; // reassigned by the reconfigure callback
   
-    size_in_.height = (int)rgb_msg->height;
-    size_in_.width  = (int)rgb_msg->width;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    
+    publish_cloud = publish_cloud && publish_cloud_;
+    
+    if (!publish_rgb && !publish_depth && !publish_info && !publish_cloud) 
+      return;
+    
+    if (!maps_ || maps_->size_in != size_in)
+    {
+      // no maps usable for this image size: build them now
+      ROS_INFO("Initializing");
+      RectificationMapsPtr new_maps = boost::make_shared<RectificationMaps>();
+      buildMaps(rgb_info_msg, depth_info_msg, size_in, scale_, *new_maps);
+      maps_ = new_maps;
+    }
+    else if (maps_->scale != scale_ && !building_maps_)
+    {
+      // new scale: keep going with the old maps until the new ones are built
+      building_maps_ = true;
+      map_thread_.join();
+      map_thread_ = boost::thread(boost::bind(
+        &RGBDImageProc::buildMapsInBackground, this,
+        rgb_info_msg, depth_info_msg, size_in, scale_));
+    }
     
-    initMaps(rgb_info_msg, depth_info_msg);
+    maps = maps_;
+    cloud_publisher = cloud_publisher_;
   }
   
+  // the cloud needs both images
+  bool build_rgb   = publish_rgb   || publish_cloud;
+  bool build_depth = publish_depth || publish_cloud;
+  
   // **** convert ros images to opencv Mat
   cv_bridge::CvImageConstPtr rgb_ptr   = cv_bridge::toCvShare(rgb_msg);
   cv_bridge::CvImageConstPtr depth_ptr = cv_bridge::toCvShare(depth_msg);
@@ -262,99 +535,268 @@ void RGBDImageProc::RGBDCallback(
   //cv::imshow("Depth", depth_img);
   //cv::waitKey(1);
   
+  // **** allocate the output messages, from the pools. The rectified
+  // rgb and registered depth images are computed directly into them.
+  ros::WallTime start_allocate = ros::WallTime::now();
+  
+  cv::Size size_out = maps->map_rgb_1.size();
+  
+  ImageMsg::Ptr rgb_out_msg, depth_out_msg;
+  cv::Mat rgb_img_rect, depth_img_rect_reg;
+  
+  if (build_rgb)
+  {
+    rgb_out_msg = rgb_msg_pool_.acquire(
+      rgb_msg->header, rgb_msg->encoding, 
+      size_out.height, size_out.width, rgb_img.type());
+    rgb_img_rect = ImageMsgPool::wrap(rgb_out_msg, rgb_img.type());
+  }
+  if (build_depth)
+  {
+    depth_out_msg = depth_msg_pool_.acquire(
+      depth_msg->header, depth_msg->encoding, 
+      size_out.height, size_out.width, depth_img.type());
+    depth_img_rect_reg = ImageMsgPool::wrap(depth_out_msg, depth_img.type());
+  }
+  
+  dur_allocate = getMsDuration(start_allocate); 
+  
   // **** rectify
   ros::WallTime start_rectify = ros::WallTime::now();
-  cv::Mat rgb_img_rect, depth_img_rect;
-  cv::remap(rgb_img, rgb_img_rect, map_rgb_1_, map_rgb_2_, cv::INTER_LINEAR);
-  cv::remap(depth_img, depth_img_rect, map_depth_1_, map_depth_2_,  cv::INTER_NEAREST);
+  cv::Mat depth_img_rect;
+  if (build_rgb)
+  {
+    runBands(boost::bind(&RGBDImageProc::remapBand, this, _1,
+      boost::cref(rgb_img), boost::ref(rgb_img_rect),
+      boost::cref(maps->map_rgb_1), boost::cref(maps->map_rgb_2), (int)cv::INTER_LINEAR));
+  }
+  if (build_depth && !fused_depth_)
+  {
+    depth_img_rect.create(maps->map_depth_1.size(), depth_img.type());
+    runBands(boost::bind(&RGBDImageProc::remapBand, this, _1,
+      boost::cref(depth_img), boost::ref(depth_img_rect),
+      boost::cref(maps->map_depth_1), boost::cref(maps->map_depth_2), (int)cv::INTER_NEAREST));
+  }
   dur_rectify = getMsDuration(start_rectify);
   
   //cv::imshow("RGB Rect", rgb_img_rect);
   //cv::imshow("Depth Rect", depth_img_rect);
   //cv::waitKey(1);
   
-  // **** unwarp 
-  if (unwarp_) 
-  {    
-    ros::WallTime start_unwarp = ros::WallTime::now();
-    rgbdtools::unwarpDepthImage(
-      depth_img_rect, coeff_0_rect_, coeff_1_rect_, coeff_2_rect_, fit_mode_);
-    dur_unwarp = getMsDuration(start_unwarp);
+  if (!build_depth)
+  {
+    dur_reproject = 0.0;
+    dur_unwarp = 0.0;
+  }
+  else if (fused_depth_)
+  {
+    // **** rectify, unwarp and reproject the depth in one pass
+    ros::WallTime start_reproject = ros::WallTime::now();
+    maps->depth_registration.process(depth_img, depth_img_rect_reg);
+    dur_reproject = getMsDuration(start_reproject);
+    dur_unwarp = 0.0;
+  }
+  else
+  {
+    // **** unwarp 
+    if (unwarp_) 
+    {    
+      ros::WallTime start_unwarp = ros::WallTime::now();
+      runBands(boost::bind(&RGBDImageProc::unwarpBand, this, _1,
+        boost::cref(*maps), boost::ref(depth_img_rect)));
+      dur_unwarp = getMsDuration(start_unwarp);
+    }
+    else dur_unwarp = 0.0;
+    
+    // **** reproject (single-threaded: points scatter across bands)
+    ros::WallTime start_reproject = ros::WallTime::now();
+    cv::Mat depth_img_legacy_reg;
+    rgbdtools::buildRegisteredDepthImage(
+      maps->intr_rect_depth, maps->intr_rect_rgb, ir2rgb_, 
+      depth_img_rect, depth_img_legacy_reg);
+    depth_img_legacy_reg.copyTo(depth_img_rect_reg);
+    dur_reproject = getMsDuration(start_reproject);
   }
-  else dur_unwarp = 0.0;
-  
-  // **** reproject
-  ros::WallTime start_reproject = ros::WallTime::now();
-  cv::Mat depth_img_rect_reg;
-  rgbdtools::buildRegisteredDepthImage(
-    intr_rect_depth_, intr_rect_rgb_, ir2rgb_, depth_img_rect, depth_img_rect_reg);
-  dur_reproject = getMsDuration(start_reproject);
 
   // **** point cloud
-  if (publish_cloud_)
+  if (publish_cloud)
   {
     ros::WallTime start_cloud = ros::WallTime::now();
     PointCloudT::Ptr cloud_ptr;
     cloud_ptr.reset(new PointCloudT());
-    rgbdtools::buildPointCloud(
-      depth_img_rect_reg, rgb_img_rect, intr_rect_rgb_, *cloud_ptr);
+    cloud_ptr->points.resize(rgb_img_rect.cols * rgb_img_rect.rows);
+    cloud_ptr->width  = rgb_img_rect.cols;
+    cloud_ptr->height = rgb_img_rect.rows;
+    runBands(boost::bind(&RGBDImageProc::buildPointCloudBand, this, _1,
+      boost::cref(*maps), boost::cref(depth_img_rect_reg), 
+      boost::cref(rgb_img_rect), boost::ref(*cloud_ptr)));
+    cloud_ptr->is_dense = false;
     // The point cloud timestamp, int usec.
     cloud_ptr->header.stamp = rgb_info_msg->header.stamp.toNSec() * 1e-3;
     cloud_ptr->header.frame_id = rgb_info_msg->header.frame_id;
-    cloud_publisher_.publish(cloud_ptr);
+    cloud_publisher.publish(cloud_ptr);
     dur_cloud = getMsDuration(start_cloud);
   }
   else dur_cloud = 0.0;
   
-  // **** allocate registered rgb image
-  ros::WallTime start_allocate = ros::WallTime::now();
-
-  cv_bridge::CvImage cv_img_rgb(rgb_msg->header, rgb_msg->encoding, rgb_img_rect);
-  ImageMsg::Ptr rgb_out_msg = cv_img_rgb.toImageMsg();
-
-  // **** allocate registered depth image
-  cv_bridge::CvImage cv_img_depth(depth_msg->header, depth_msg->encoding, depth_img_rect_reg);
-  ImageMsg::Ptr depth_out_msg = cv_img_depth.toImageMsg();
-  
-  // **** update camera info (single, since both images are in rgb frame)
-  rgb_rect_info_msg_.header = rgb_info_msg->header;
-  
-  dur_allocate = getMsDuration(start_allocate); 
+  // **** camera info (single, since both images are in rgb frame)
+  CameraInfoMsg::Ptr info_out_msg = 
+    boost::make_shared<CameraInfoMsg>(maps->rgb_rect_info_msg);
+  info_out_msg->header = rgb_info_msg->header;
 
   // **** print diagnostics
   
   double dur_total = dur_rectify + dur_reproject + dur_unwarp + dur_cloud + dur_allocate;
   if(verbose_)
   {
-    ROS_INFO("Rect %.1f Reproj %.1f Unwarp %.1f Cloud %.1f Alloc %.1f Total %.1f ms",
+    ROS_INFO("Rect %.1f Reproj %.1f Unwarp %.1f Cloud %.1f Alloc %.1f Total %.1f ms (%d threads, %d bands)",
              dur_rectify, dur_reproject,  dur_unwarp, dur_cloud, dur_allocate,
-             dur_total);
+             dur_total, n_threads_, n_bands_);
   }
   // **** publish
-  rgb_publisher_.publish(rgb_out_msg);
-  depth_publisher_.publish(depth_out_msg);
-  info_publisher_.publish(rgb_rect_info_msg_);
+  if (publish_rgb)   rgb_publisher_.publish(rgb_out_msg);
+  if (publish_depth) depth_publisher_.publish(depth_out_msg);
+  if (publish_info)  info_publisher_.publish(info_out_msg);
+}
+
+void RGBDImageProc::advertiseCloud()
+{
+  cloud_publisher_ = nh_.advertise<PointCloudT>(
+    "rgbd/cloud", queue_size_,
+    boost::bind(&SubscriberCounter::connect,    &cloud_subscribers_),
+    boost::bind(&SubscriberCounter::disconnect, &cloud_subscribers_));
+}
+
+void RGBDImageProc::runBands(const ThreadPool::IndexedTask& band_task)
+{
+  if (pool_) 
+    pool_->parallelFor(n_bands_, band_task);
+  else
+    band_task(0);
+}
+
+void RGBDImageProc::getBandRows(
+  int band, int rows, int& row_start, int& row_end) const
+{
+  row_start = (band       * rows) / n_bands_;
+  row_end   = ((band + 1) * rows) / n_bands_;
+}
+
+void RGBDImageProc::remapBand(
+  int band, const cv::Mat& img, cv::Mat& img_rect,
+  const cv::Mat& map_1, const cv::Mat& map_2,
+  int interpolation) const
+{
+  int row_start, row_end;
+  getBandRows(band, img_rect.rows, row_start, row_end);
+  if (row_start == row_end) return;
+  
+  // the output ROI has the size and type of the map band, 
+  // so remap writes into it without reallocating
+  cv::Mat img_rect_band = img_rect.rowRange(row_start, row_end);
+  cv::remap(img, img_rect_band, 
+    map_1.rowRange(row_start, row_end), map_2.rowRange(row_start, row_end),
+    interpolation);
+}
+
+void RGBDImageProc::unwarpBand(
+  int band, const RectificationMaps& maps, cv::Mat& depth_img_rect) const
+{
+  int row_start, row_end;
+  getBandRows(band, depth_img_rect.rows, row_start, row_end);
+  if (row_start == row_end) return;
+  
+  cv::Mat depth_img_rect_band = depth_img_rect.rowRange(row_start, row_end);
+  cv::Mat coeff_0_band = maps.coeff_0_rect.rowRange(row_start, row_end);
+  cv::Mat coeff_1_band = maps.coeff_1_rect.rowRange(row_start, row_end);
+  cv::Mat coeff_2_band = maps.coeff_2_rect.rowRange(row_start, row_end);
+  
+  uchar* band_data = depth_img_rect_band.data;
+  
+  rgbdtools::unwarpDepthImage(depth_img_rect_band,
+    coeff_0_band, coeff_1_band, coeff_2_band, fit_mode_);
+  
+  // in case the unwarp assigned a new image instead of writing in place
+  if (depth_img_rect_band.data != band_data)
+  {
+    cv::Mat depth_img_rect_roi = depth_img_rect.rowRange(row_start, row_end);
+    depth_img_rect_band.copyTo(depth_img_rect_roi);
+  }
+}
+
+void RGBDImageProc::buildPointCloudBand(
+  int band, const RectificationMaps& maps, 
+  const cv::Mat& depth_img_rect_reg,
+  const cv::Mat& rgb_img_rect,
+  PointCloudT& cloud) const
+{
+  int row_start, row_end;
+  getBandRows(band, depth_img_rect_reg.rows, row_start, row_end);
+  
+  const int w = depth_img_rect_reg.cols;
+  
+  // the depth is registered to the rgb image, so the rgb intrinsics apply
+  const float cx = maps.intr_rect_rgb.at<double>(0, 2);
+  const float cy = maps.intr_rect_rgb.at<double>(1, 2);
+  const float fx_inv = 1.0 / maps.intr_rect_rgb.at<double>(0, 0);
+  const float fy_inv = 1.0 / maps.intr_rect_rgb.at<double>(1, 1);
+  
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  
+  for (int v = row_start; v < row_end; ++v)
+  {
+    const uint16_t* depth_row = depth_img_rect_reg.ptr<uint16_t>(v);
+    const cv::Vec3b* rgb_row = rgb_img_rect.ptr<cv::Vec3b>(v);
+    
+    for (int u = 0; u < w; ++u)
+    {
+      PointT& p = cloud.points[v * w + u];
+      
+      uint16_t z_raw = depth_row[u];
+      
+      if (z_raw != 0)
+      {
+        float z = z_raw * 0.001f; // mm to m
+        p.x = z * (u - cx) * fx_inv;
+        p.y = z * (v - cy) * fy_inv;
+        p.z = z;
+      }
+      else
+      {
+        p.x = nan;
+        p.y = nan;
+        p.z = nan;
+      }
+      
+      const cv::Vec3b& color = rgb_row[u];
+      p.r = color[2];
+      p.g = color[1];
+      p.b = color[0];
+    }
+  }
 }
 
 void RGBDImageProc::reconfigCallback(ProcConfig& config, uint32_t level)
 {
-  boost::mutex::scoped_lock(mutex_);
+  boost::mutex::scoped_lock lock(mutex_);
   bool old_publish_cloud = publish_cloud_;
       publish_cloud_ = config.publish_cloud;
   if(!old_publish_cloud && publish_cloud_)
   {
-    cloud_publisher_ = nh_.advertise<PointCloudT>(
-        "rgbd/cloud", queue_size_);
+    advertiseCloud();
   }
   else
   {
     if(old_publish_cloud && !publish_cloud_)
+    {
       cloud_publisher_.shutdown();
+      cloud_subscribers_.reset();
+    }
   }
 
 
+  // the next image callback starts building maps for the new scale
   scale_ = config.scale;
-  size_in_ = cv::Size(0,0); // force a reinitialization on the next image callback
   ROS_INFO("Resampling scale set to %.2f", scale_);
 }
 
@@ -27,22 +27,68 @@ namespace ccny_rgbd {
   
 VisualOdometry::VisualOdometry(
   const ros::NodeHandle& nh, 
-  const ros::NodeHandle& nh_private):
+  const ros::NodeHandle& nh_private,
+  ThreadPoolPtr pool):
   nh_(nh), 
   nh_private_(nh_private),
   initialized_(false),
-  frame_count_(0)
+  frame_count_(0),
+  n_compared_(0),
+  n_unpredicted_failed_(0),
+  star_threshold_(0.0),
+  path_delta_index_(0),
+  pipeline_registering_(false)
 {
   ROS_INFO("Starting RGBD Visual Odometry");
 
+  // the tiled detector picks up the shared pool in initParams
+  tile_pool_ = pool;
+
   // **** initialize ROS parameters
   
   initParams();
 
+  if (pool && pipeline_)
+  {
+    ROS_WARN("Pipelining is not available with a shared pool, disabling");
+    pipeline_ = false;
+  }
+
   // **** inititialize state variables
   
   f2b_.setIdentity();
 
+  // **** output thread
+
+  if (publish_async_)
+  {
+    ROS_INFO("Publishing the outputs on a separate thread");
+    async_publisher_.reset(new AsyncPublisher());
+  }
+
+  // **** pipeline workers
+
+  if (pipeline_)
+  {
+    ROS_INFO("Pipelining enabled with %d front-end threads", pipeline_threads_);
+    pipeline_depth_ = std::max(1, pipeline_depth_);
+    pipeline_pool_.reset(new ThreadPool(pipeline_threads_));
+  }
+
+  if (pool)
+  {
+    ROS_INFO("Processing the latest frame on a shared pool of %d threads",
+      pool->getNThreads());
+    scheduler_.reset(new LatestFrameScheduler(boost::bind(
+      &VisualOdometry::processRGBDMessages, this, _1, _2, _3), pool));
+  }
+  else if (latest_frame_only_)
+  {
+    ROS_INFO("Processing only the latest frame");
+    scheduler_.reset(new LatestFrameScheduler(boost::bind(
+      &VisualOdometry::processRGBDMessages, this, _1, _2, _3)));
+  }
+
   // **** publishers
 
   odom_publisher_ = nh_.advertise<OdomMsg>(
@@ -51,6 +97,8 @@ VisualOdometry::VisualOdometry(
     "pose", queue_size_);
   path_pub_ = nh_.advertise<PathMsg>(
     "path", queue_size_);
+  path_delta_pub_ = nh_.advertise<PathMsg>(
+    "path_delta", queue_size_);
     
   feature_cloud_publisher_ = nh_.advertise<PointCloudFeature>(
     "feature/cloud", 1);
@@ -61,7 +109,24 @@ VisualOdometry::VisualOdometry(
     "model/cloud", 1);
   model_cov_publisher_ = nh_.advertise<visualization_msgs::Marker>(
     "model/covariances", 1);
+
+  diagnostics_publisher_ = nh_.advertise<diagnostic_msgs::DiagnosticArray>(
+    "diagnostics", 1);
+
+  // **** timers
+
+  if (diagnostics_period_ > 0.0)
+  {
+    diagnostics_timer_ = nh_.createWallTimer(
+      ros::WallDuration(diagnostics_period_),
+      &VisualOdometry::diagnosticsTimerCallback, this);
+  }
   
+  // **** services
+
+  get_path_service_ = nh_.advertiseService(
+    "get_path", &VisualOdometry::getPathSrvCallback, this);
+
   // **** subscribers
   
   ImageTransport rgb_it(nh_);
@@ -80,7 +145,22 @@ VisualOdometry::VisualOdometry(
 
 VisualOdometry::~VisualOdometry()
 {
-  fclose(diagnostics_file_);
+  // finish any frames in flight before tearing down
+  if (scheduler_)
+  {
+    ROS_INFO("Dropped %d of %d frames", 
+      scheduler_->getNDropped(), scheduler_->getNReceived());
+    scheduler_.reset();
+  }
+  pipeline_pool_.reset();
+
+  // publish the remaining poses while the publishers are still there
+  async_publisher_.reset();
+
+  // write out the remaining diagnostics and close the file
+  diagnostics_timer_.stop();
+  diagnostics_writer_.reset();
+
   ROS_INFO("Destroying RGBD Visual Odometry"); 
 }
 
@@ -94,12 +174,32 @@ void VisualOdometry::initParams()
     publish_odom_ = true;
   if (!nh_private_.getParam ("publish_pose", publish_pose_))
     publish_pose_ = true;
+  if (!nh_private_.getParam ("publish_async", publish_async_))
+    publish_async_ = false;
+  if (!nh_private_.getParam ("path/window_size", path_window_size_))
+    path_window_size_ = 0;
+  if (!nh_private_.getParam ("path/decimation", path_decimation_))
+    path_decimation_ = 1;
+
+  path_window_size_ = std::max(0, path_window_size_);
+  path_decimation_  = std::max(1, path_decimation_);
   if (!nh_private_.getParam ("fixed_frame", fixed_frame_))
     fixed_frame_ = "/odom";
   if (!nh_private_.getParam ("base_frame", base_frame_))
     base_frame_ = "/camera_link";
   if (!nh_private_.getParam ("queue_size", queue_size_))
     queue_size_ = 5;
+  if (!nh_private_.getParam ("latest_frame_only", latest_frame_only_))
+    latest_frame_only_ = false;
+
+  // pipeline params
+
+  if (!nh_private_.getParam ("pipeline", pipeline_))
+    pipeline_ = false;
+  if (!nh_private_.getParam ("pipeline_threads", pipeline_threads_))
+    pipeline_threads_ = 2;
+  if (!nh_private_.getParam ("pipeline_depth", pipeline_depth_))
+    pipeline_depth_ = 3;
 
   // detector params
   
@@ -109,6 +209,17 @@ void VisualOdometry::initParams()
     publish_feature_cov_ = false;
   if (!nh_private_.getParam ("feature/detector_type", detector_type_))
     detector_type_ = "GFT";
+  if (!nh_private_.getParam ("feature/tile_threads", tile_threads_))
+    tile_threads_ = boost::thread::hardware_concurrency();
+  if (!nh_private_.getParam ("feature/fast_distributions", fast_distributions_))
+    fast_distributions_ = false;
+  if (!nh_private_.getParam ("feature/verify_distributions", verify_distributions_))
+    verify_distributions_ = false;
+  if (!nh_private_.getParam ("feature/tracking/enabled", tracking_))
+    tracking_ = false;
+
+  // before the detector, whose reconfigure callbacks update the controller
+  configureLatencyControl();
   
   resetDetector();
   
@@ -125,10 +236,20 @@ void VisualOdometry::initParams()
   feature_detector_->setSmooth(smooth);
   feature_detector_->setMaxRange(max_range);
   feature_detector_->setMaxStDev(max_stdev);
+
+  if (tiled_detector_)
+  {
+    tiled_detector_->setSmooth(smooth);
+    tiled_detector_->setMaxRange(max_range);
+    tiled_detector_->setMaxStDev(max_stdev);
+  }
+
+  if (tracking_) configureTracking(max_range, max_stdev);
   
   // registration params
   
   configureMotionEstimation();
+  configureCoarseToFine(max_range, max_stdev);
 
   // diagnostic params
 
@@ -137,37 +258,36 @@ void VisualOdometry::initParams()
   if (!nh_private_.getParam("save_diagnostics", save_diagnostics_))
     save_diagnostics_ = false;
   if (!nh_private_.getParam("diagnostics_file_name", diagnostics_file_name_))
-    diagnostics_file_name_ = "diagnostics.csv";
-  
-  if(save_diagnostics_)
-  {
-    diagnostics_file_ = fopen(diagnostics_file_name_.c_str(), "w");
+    diagnostics_file_name_ = "diagnostics.bin";
+  if (!nh_private_.getParam("diagnostics_window", diagnostics_window_))
+    diagnostics_window_ = 300;
+  if (!nh_private_.getParam("diagnostics_period", diagnostics_period_))
+    diagnostics_period_ = 1.0;
 
-    if (diagnostics_file_ == NULL)
-    {
-      ROS_ERROR("Can't create diagnostic file %s\n", diagnostics_file_name_.c_str());
-      return;
-    }
+  // the ring buffer holds a few seconds worth of frames, in case 
+  // the writer thread gets delayed by the file system
+  diagnostics_writer_.reset(new DiagnosticsWriter(
+    "VO", detector_type_, verbose_, 256, diagnostics_window_));
 
-    // print header
-    fprintf(diagnostics_file_, "%s, %s, %s, %s, %s, %s, %s, %s\n",
-      "Frame id",
-      "Frame dur.",
-      "All features", "Valid features",
-      "Feat extr. dur.",
-      "Model points", "Registration dur.",
-      "Total dur.");
-  }
+  if(save_diagnostics_)
+    diagnostics_writer_->openFile(diagnostics_file_name_);
 }
 
-void VisualOdometry::configureMotionEstimation()
+/** @brief Reads the reg/ICPProbModel parameters shared by both 
+ * model implementations, and applies them
+ * @return the maximum model size
+ */
+template <typename T>
+static int configureICPProbModel(
+  const ros::NodeHandle& nh_private,
+  T& motion_estimation)
 {
   int motion_constraint;
 
-  if (!nh_private_.getParam ("reg/motion_constraint", motion_constraint))
+  if (!nh_private.getParam ("reg/motion_constraint", motion_constraint))
     motion_constraint = 0;
 
-  motion_estimation_.setMotionConstraint(motion_constraint);
+  motion_estimation.setMotionConstraint(motion_constraint);
 
   double tf_epsilon_linear;
   double tf_epsilon_angular;
@@ -178,40 +298,302 @@ void VisualOdometry::configureMotionEstimation()
   double max_assoc_dist_mah;
   int n_nearest_neighbors;   
 
-  if (!nh_private_.getParam ("reg/ICPProbModel/tf_epsilon_linear", tf_epsilon_linear))
+  if (!nh_private.getParam ("reg/ICPProbModel/tf_epsilon_linear", tf_epsilon_linear))
     tf_epsilon_linear = 1e-4; // 1 mm
-  if (!nh_private_.getParam ("reg/ICPProbModel/tf_epsilon_angular", tf_epsilon_angular))
+  if (!nh_private.getParam ("reg/ICPProbModel/tf_epsilon_angular", tf_epsilon_angular))
     tf_epsilon_angular = 1.7e-3; // 1 deg
-  if (!nh_private_.getParam ("reg/ICPProbModel/max_iterations", max_iterations))
+  if (!nh_private.getParam ("reg/ICPProbModel/max_iterations", max_iterations))
     max_iterations = 10;
-  if (!nh_private_.getParam ("reg/ICPProbModel/min_correspondences", min_correspondences))
+  if (!nh_private.getParam ("reg/ICPProbModel/min_correspondences", min_correspondences))
     min_correspondences = 15;
-  if (!nh_private_.getParam ("reg/ICPProbModel/max_model_size", max_model_size))
+  if (!nh_private.getParam ("reg/ICPProbModel/max_model_size", max_model_size))
     max_model_size = 3000;
-  if (!nh_private_.getParam ("reg/ICPProbModel/max_corresp_dist_eucl", max_corresp_dist_eucl))
+  if (!nh_private.getParam ("reg/ICPProbModel/max_corresp_dist_eucl", max_corresp_dist_eucl))
     max_corresp_dist_eucl = 0.15;
-  if (!nh_private_.getParam ("reg/ICPProbModel/max_assoc_dist_mah", max_assoc_dist_mah))
+  if (!nh_private.getParam ("reg/ICPProbModel/max_assoc_dist_mah", max_assoc_dist_mah))
     max_assoc_dist_mah = 10.0;
-  if (!nh_private_.getParam ("reg/ICPProbModel/n_nearest_neighbors", n_nearest_neighbors))
+  if (!nh_private.getParam ("reg/ICPProbModel/n_nearest_neighbors", n_nearest_neighbors))
     n_nearest_neighbors = 4;      
     
+  motion_estimation.setTfEpsilonLinear(tf_epsilon_linear);
+  motion_estimation.setTfEpsilonAngular(tf_epsilon_angular);
+  motion_estimation.setMaxIterations(max_iterations);
+  motion_estimation.setMinCorrespondences(min_correspondences);
+  motion_estimation.setMaxModelSize(max_model_size);
+  motion_estimation.setMaxCorrespondenceDistEuclidean(max_corresp_dist_eucl);
+  motion_estimation.setMaxAssociationDistMahalanobis(max_assoc_dist_mah);
+  motion_estimation.setNNearestNeighbors(n_nearest_neighbors);
+
+  return max_model_size;
+}
+
+void VisualOdometry::configureMotionEstimation()
+{
+  if (!nh_private_.getParam ("reg/ICPProbModel/index_type", index_type_))
+    index_type_ = "kdtree";
   if (!nh_private_.getParam ("reg/ICPProbModel/publish_model_cloud", publish_model_cloud_))
     publish_model_cloud_ = false;
   if (!nh_private_.getParam ("reg/ICPProbModel/publish_model_covariances", publish_model_cov_))
     publish_model_cov_ = false; 
-    
-  motion_estimation_.setTfEpsilonLinear(tf_epsilon_linear);
-  motion_estimation_.setTfEpsilonAngular(tf_epsilon_angular);
-  motion_estimation_.setMaxIterations(max_iterations);
-  motion_estimation_.setMinCorrespondences(min_correspondences);
-  motion_estimation_.setMaxModelSize(max_model_size);
-  motion_estimation_.setMaxCorrespondenceDistEuclidean(max_corresp_dist_eucl);
-  motion_estimation_.setMaxAssociationDistMahalanobis(max_assoc_dist_mah);
-  motion_estimation_.setNNearestNeighbors(n_nearest_neighbors);
+
+  int max_model_size;
+
+  int max_keyframes;
+  double max_keyframe_dist;
+
+  if (!nh_private_.getParam ("reg/ICPProbModel/window/max_keyframes", max_keyframes))
+    max_keyframes = 0;
+  if (!nh_private_.getParam ("reg/ICPProbModel/window/max_keyframe_dist", max_keyframe_dist))
+    max_keyframe_dist = 0.0;
+
+  if (index_type_ == "voxel_hash")
+  {
+    double voxel_size, max_search_dist;
+    double kf_dist_eps, kf_angle_eps;
+
+    if (!nh_private_.getParam ("reg/ICPProbModel/voxel_size", voxel_size))
+      voxel_size = 0.15;
+    if (!nh_private_.getParam ("reg/ICPProbModel/max_search_dist", max_search_dist))
+      max_search_dist = 0.5;
+    if (!nh_private_.getParam ("reg/ICPProbModel/window/kf_dist_eps", kf_dist_eps))
+      kf_dist_eps = 0.25;
+    if (!nh_private_.getParam ("reg/ICPProbModel/window/kf_angle_eps", kf_angle_eps))
+      kf_angle_eps = 0.35; // 20 deg
+
+    incremental_model_ = true;
+    incremental_motion_estimation_.setVoxelSize(voxel_size);
+    incremental_motion_estimation_.setMaxSearchDist(max_search_dist);
+    incremental_motion_estimation_.setKeyframeWindow(max_keyframes, max_keyframe_dist);
+    incremental_motion_estimation_.setKeyframeThresholds(kf_dist_eps, kf_angle_eps);
+    max_model_size = configureICPProbModel(nh_private_, incremental_motion_estimation_);
+
+    if (max_keyframes > 0 || max_keyframe_dist > 0.0)
+    {
+      ROS_INFO("Model window: %d keyframes, %.2f m (0 = no limit)", 
+        max_keyframes, max_keyframe_dist);
+    }
+  }
+  else
+  {
+    if (index_type_ != "kdtree")
+      ROS_FATAL("%s is not a valid index type! Using kdtree", index_type_.c_str());
+
+    if (max_keyframes > 0 || max_keyframe_dist > 0.0)
+      ROS_WARN("The model keyframe window requires index_type voxel_hash, disabling");
+
+    incremental_model_ = false;
+    max_model_size = configureICPProbModel(nh_private_, motion_estimation_);
+  }
+
+  configureMotionPrediction();
+
+  // rgbdtools can't shrink a full model, so pin the model size
+  if (latency_control_ && !incremental_model_)
+  {
+    ROS_WARN("Latency control of the model size requires index_type voxel_hash, disabling");
+    latency_controller_.setModelSizeLimits(max_model_size, max_model_size);
+  }
+
+  latency_controller_.setMaxModelSize(max_model_size);
+}
+
+void VisualOdometry::configureMotionPrediction()
+{
+  std::string mode;
+  double decay_time, max_dt;
+  bool compare;
+
+  if (!nh_private_.getParam ("reg/motion_prediction/mode", mode))
+    mode = "none";
+  if (!nh_private_.getParam ("reg/motion_prediction/decay_time", decay_time))
+    decay_time = 0.5;
+  if (!nh_private_.getParam ("reg/motion_prediction/max_dt", max_dt))
+    max_dt = 0.2;
+  if (!nh_private_.getParam ("reg/motion_prediction/compare", compare))
+    compare = false;
+
+  if (!motion_predictor_.setMode(mode))
+    ROS_FATAL("%s is not a valid motion prediction mode! Using none", mode.c_str());
+
+  // rgbdtools ignores the prediction
+  if (motion_predictor_.getMode() != MotionPredictor::NONE && !incremental_model_)
+  {
+    ROS_WARN("Motion prediction requires index_type voxel_hash, disabling");
+    motion_predictor_.setMode(MotionPredictor::NONE);
+  }
+
+  motion_predictor_.setDecayTime(decay_time);
+  motion_predictor_.setMaxDt(max_dt);
+  incremental_motion_estimation_.setComparePrediction(compare);
+
+  if (motion_predictor_.getMode() != MotionPredictor::NONE)
+    ROS_INFO("Motion prediction: %s", mode.c_str());
+}
+
+void VisualOdometry::configureCoarseToFine(double max_range, double max_stdev)
+{
+  double scale;
+  int fine_features, refine_window;
+
+  if (!nh_private_.getParam ("reg/coarse_to_fine/enabled", coarse_to_fine_))
+    coarse_to_fine_ = false;
+  if (!nh_private_.getParam ("reg/coarse_to_fine/scale", scale))
+    scale = 0.5;
+  if (!nh_private_.getParam ("reg/coarse_to_fine/fine_features", fine_features))
+    fine_features = 150;
+  if (!nh_private_.getParam ("reg/coarse_to_fine/refine_window", refine_window))
+    refine_window = 3;
+
+  if (!coarse_to_fine_) return;
+
+  // the coarse alignment needs IncrementalICPProbModel::alignFrame
+  if (!incremental_model_)
+  {
+    ROS_WARN("Coarse-to-fine registration requires index_type voxel_hash, disabling");
+    coarse_to_fine_ = false;
+    return;
+  }
+
+  if (tracking_)
+  {
+    ROS_WARN("Coarse-to-fine registration is not available with feature tracking, disabling");
+    coarse_to_fine_ = false;
+    return;
+  }
+
+  pyramid_.setScale(scale);
+  pyramid_.setNFineFeatures(fine_features);
+  pyramid_.setRefineWindow(refine_window);
+  pyramid_.setMaxRange(max_range);
+  pyramid_.setMaxStDev(max_stdev);
+
+  ROS_INFO("Coarse-to-fine registration: scale %.2f, %d fine features", 
+    pyramid_.getScale(), fine_features);
+}
+
+void VisualOdometry::configureTracking(double max_range, double max_stdev)
+{
+  int min_features, detection_period, window_size, max_level;
+
+  if (!nh_private_.getParam ("feature/tracking/min_features", min_features))
+    min_features = 150;
+  if (!nh_private_.getParam ("feature/tracking/detection_period", detection_period))
+    detection_period = 10;
+  if (!nh_private_.getParam ("feature/tracking/window_size", window_size))
+    window_size = 21;
+  if (!nh_private_.getParam ("feature/tracking/max_level", max_level))
+    max_level = 3;
+
+  tracker_.setMinFeatures(min_features);
+  tracker_.setDetectionPeriod(detection_period);
+  tracker_.setWindowSize(window_size);
+  tracker_.setMaxLevel(max_level);
+  tracker_.setMaxRange(max_range);
+  tracker_.setMaxStDev(max_stdev);
+
+  // tracking needs the frames one at a time, in order
+  if (pipeline_)
+  {
+    ROS_WARN("Pipelining is not available with feature tracking, disabling");
+    pipeline_ = false;
+  }
+
+  ROS_INFO("Feature tracking enabled, detecting every %d frames, "
+    "or below %d features", detection_period, min_features);
+}
+
+void VisualOdometry::configureLatencyControl()
+{
+  double budget, deadband, gain;
+  int period, min_features, max_features, min_model_size, max_model_size;
+
+  if (!nh_private_.getParam ("latency_control/enabled", latency_control_))
+    latency_control_ = false;
+  if (!nh_private_.getParam ("latency_control/budget", budget))
+    budget = 33.0; // ms
+  if (!nh_private_.getParam ("latency_control/deadband", deadband))
+    deadband = 0.1;
+  if (!nh_private_.getParam ("latency_control/gain", gain))
+    gain = 0.5;
+  if (!nh_private_.getParam ("latency_control/period", period))
+    period = 10;
+  if (!nh_private_.getParam ("latency_control/min_features", min_features))
+    min_features = 100;
+  if (!nh_private_.getParam ("latency_control/max_features", max_features))
+    max_features = 1000;
+  if (!nh_private_.getParam ("latency_control/min_model_size", min_model_size))
+    min_model_size = 1000;
+  if (!nh_private_.getParam ("latency_control/max_model_size", max_model_size))
+    max_model_size = 10000;
+
+  latency_controller_.setBudget(budget);
+  latency_controller_.setDeadband(deadband);
+  latency_controller_.setGain(gain);
+  latency_controller_.setPeriod(period);
+  latency_controller_.setFeatureLimits(min_features, max_features);
+  latency_controller_.setModelSizeLimits(min_model_size, max_model_size);
+
+  if (latency_control_)
+    ROS_INFO("Latency control enabled, with a budget of %.1f ms", budget);
+}
+
+void VisualOdometry::updateLatencyControl(double d_total)
+{
+  {
+    boost::mutex::scoped_lock lock(detector_mutex_);
+
+    int old_n_features = latency_controller_.getNFeatures();
+    if (!latency_controller_.update(d_total)) return;
+    int n_features = latency_controller_.getNFeatures();
+
+    if (n_features != old_n_features)
+    {
+      if (detector_type_ == "ORB")
+      {
+        rgbdtools::OrbDetectorPtr orb_detector = 
+          boost::static_pointer_cast<rgbdtools::OrbDetector>(feature_detector_);
+        orb_detector->setNFeatures(n_features);
+        if (tiled_detector_) tiled_detector_->setNFeatures(n_features);
+      }
+      else if (detector_type_ == "STAR")
+      {
+        // STAR has no feature count: scale the threshold the opposite way
+        star_threshold_ *= (double)old_n_features / (double)n_features;
+        star_threshold_ = std::min(std::max(star_threshold_, 1.0), 100.0);
+
+        rgbdtools::StarDetectorPtr star_detector = 
+          boost::static_pointer_cast<rgbdtools::StarDetector>(feature_detector_);
+        star_detector->setThreshold(star_threshold_);
+        if (tiled_detector_) tiled_detector_->setThreshold(star_threshold_);
+      }
+      else
+      {
+        rgbdtools::GftDetectorPtr gft_detector = 
+          boost::static_pointer_cast<rgbdtools::GftDetector>(feature_detector_);
+        gft_detector->setNFeatures(n_features);
+        if (tiled_detector_) tiled_detector_->setNFeatures(n_features);
+      }
+    }
+  }
+
+  int max_model_size = latency_controller_.getMaxModelSize();
+
+  if (incremental_model_)
+    incremental_motion_estimation_.setMaxModelSize(max_model_size);
+
+  if (verbose_)
+  {
+    ROS_INFO("[VO] Latency control: mean %.1f ms, features %d, max model size %d",
+      latency_controller_.getMeanDuration(), 
+      latency_controller_.getNFeatures(), max_model_size);
+  }
 }
 
 void VisualOdometry::resetDetector()
 {  
+  tiled_detector_.reset();
+  tracker_.reset();
+
   gft_config_server_.reset();
   star_config_server_.reset();
   orb_config_server_.reset();
@@ -270,6 +652,17 @@ void VisualOdometry::RGBDCallback(
   const ImageMsg::ConstPtr& rgb_msg,
   const ImageMsg::ConstPtr& depth_msg,
   const CameraInfoMsg::ConstPtr& info_msg)
+{
+  if (scheduler_)
+    scheduler_->push(rgb_msg, depth_msg, info_msg);
+  else
+    processRGBDMessages(rgb_msg, depth_msg, info_msg);
+}
+
+void VisualOdometry::processRGBDMessages(
+  const ImageMsg::ConstPtr& rgb_msg,
+  const ImageMsg::ConstPtr& depth_msg,
+  const CameraInfoMsg::ConstPtr& info_msg)
 {
   ros::WallTime start = ros::WallTime::now();
 
@@ -282,40 +675,152 @@ void VisualOdometry::RGBDCallback(
     if (!initialized_) return;
 
     motion_estimation_.setBaseToCameraTf(eigenAffineFromTf(b2c_));
+    incremental_motion_estimation_.setBaseToCameraTf(eigenAffineFromTf(b2c_));
+  }
+
+  if (pipeline_)
+  {
+    enqueuePipelineFrame(rgb_msg, depth_msg, info_msg, start);
+    return;
   }
 
+  // **** create frame and find features *******************************
+
+  rgbdtools::RGBDFrame frame, coarse_frame;
+  double d_frame, d_features;
+  processFrontEnd(rgb_msg, depth_msg, info_msg, 
+                  frame, coarse_frame, d_frame, d_features);
+
+  // **** registration, outputs and diagnostics ************************
+
+  processBackEnd(rgb_msg->header, frame, coarse_frame, 
+                 start, d_frame, d_features);
+}
+
+void VisualOdometry::processFrontEnd(
+  const ImageMsg::ConstPtr& rgb_msg,
+  const ImageMsg::ConstPtr& depth_msg,
+  const CameraInfoMsg::ConstPtr& info_msg,
+  rgbdtools::RGBDFrame& frame,
+  rgbdtools::RGBDFrame& coarse_frame,
+  double& d_frame, double& d_features)
+{
   // **** create frame *************************************************
 
   ros::WallTime start_frame = ros::WallTime::now();
-  rgbdtools::RGBDFrame frame;
-  createRGBDFrameFromROSMessages(rgb_msg, depth_msg, info_msg, frame); 
+  frame_factory_.createFrame(rgb_msg, depth_msg, info_msg, frame);
   ros::WallTime end_frame = ros::WallTime::now();
 
   // **** find features ************************************************
 
   ros::WallTime start_features = ros::WallTime::now();
-  feature_detector_->findFeatures(frame);
+
+  // with coarse_to_fine_, the detector runs on the coarse level
+  if (coarse_to_fine_) pyramid_.createCoarseFrame(frame, coarse_frame);
+  rgbdtools::RGBDFrame& detection_frame = coarse_to_fine_ ? coarse_frame : frame;
+
+  {
+    boost::mutex::scoped_lock lock(detector_mutex_);
+
+    if (tracking_ && !tracker_.needsDetection())
+      tracker_.track(frame);
+    else
+    {
+      if (tiled_detector_)
+      {
+        tiled_detector_->findFeatures(detection_frame);
+        if (verify_distributions_) verifyDistributions(detection_frame);
+      }
+      else
+        feature_detector_->findFeatures(detection_frame);
+
+      if (tracking_) tracker_.setFrame(frame);
+    }
+  }
+
+  if (coarse_to_fine_) pyramid_.refineFeatures(coarse_frame, frame);
+
   ros::WallTime end_features = ros::WallTime::now();
 
+  d_frame    = 1000.0 * (end_frame    - start_frame   ).toSec();
+  d_features = 1000.0 * (end_features - start_features).toSec();
+}
+
+void VisualOdometry::processBackEnd(
+  const std_msgs::Header& header,
+  rgbdtools::RGBDFrame& frame,
+  const rgbdtools::RGBDFrame& coarse_frame,
+  const ros::WallTime& start,
+  double d_frame, double d_features)
+{
   // **** registration *************************************************
   
   ros::WallTime start_reg = ros::WallTime::now();
-  AffineTransform m = motion_estimation_.getMotionEstimation(frame);
+
+  AffineTransform m;
+  int n_iterations = -1;
+  int n_iterations_saved = 0;
+  bool reg_failed = false;
+
+  if (incremental_model_)
+  {
+    double stamp = header.stamp.toSec();
+
+    AffineTransform prediction;
+    motion_predictor_.predict(stamp, prediction);
+
+    // the coarse level refines the prediction, if it aligns
+    if (coarse_to_fine_)
+    {
+      AffineTransform coarse_correction;
+      int n_iterations_coarse;
+      if (incremental_motion_estimation_.alignFrame(
+            coarse_frame, prediction, coarse_correction, n_iterations_coarse))
+        prediction = coarse_correction;
+    }
+
+    reg_failed = !incremental_motion_estimation_.getMotionEstimation(
+      frame, prediction, m);
+    n_iterations = incremental_motion_estimation_.getNIterations();
+
+    int n_iterations_unpredicted = 
+      incremental_motion_estimation_.getNIterationsUnpredicted();
+    if (n_iterations_unpredicted >= 0)
+    {
+      n_compared_++;
+      n_iterations_saved = n_iterations_unpredicted - n_iterations;
+      if (!incremental_motion_estimation_.getUnpredictedResult()) 
+        n_unpredicted_failed_++;
+    }
+  }
+  else
+    m = motion_estimation_.getMotionEstimation(frame);
+
   tf::Transform motion = tfFromEigenAffine(m);
   f2b_ = motion * f2b_;
+
+  if (incremental_model_)
+    motion_predictor_.update(
+      header.stamp.toSec(), eigenAffineFromTf(f2b_), !reg_failed);
+
   ros::WallTime end_reg = ros::WallTime::now();
 
   // **** publish outputs **********************************************
   
-  if (publish_tf_)    publishTf(rgb_msg->header);
-  if (publish_odom_)  publishOdom(rgb_msg->header);
-  if (publish_path_)  publishPath(rgb_msg->header);
-  if (publish_pose_)  publishPoseStamped(rgb_msg->header);
-  
-  if (publish_feature_cloud_) publishFeatureCloud(frame);
+  if (async_publisher_)
+    postOutputs(header, frame);
+  else
+  {
+    if (publish_tf_)    publishTf(header, f2b_);
+    if (publish_odom_)  publishOdom(header, f2b_);
+    if (publish_path_)  publishPath(header, f2b_);
+    if (publish_pose_)  publishPoseStamped(header, f2b_);
+    
+    if (publish_feature_cloud_) publishFeatureCloud(getFeatureCloud(frame));
+    if (publish_model_cloud_)   publishModelCloud(getModelCloud());
+  }
+
   if (publish_feature_cov_) publishFeatureCovariances(frame);
-  
-  if (publish_model_cloud_) publishModelCloud();
   if (publish_model_cov_)   publishModelCovariances();
 
   // **** print diagnostics *******************************************
@@ -326,56 +831,225 @@ void VisualOdometry::RGBDCallback(
   
   int n_features = frame.keypoints.size();
   int n_valid_features = frame.n_valid_keypoints;
-  int n_model_pts = motion_estimation_.getModelSize();
+  int n_model_pts = incremental_model_ ?
+    incremental_motion_estimation_.getModelSize() :
+    motion_estimation_.getModelSize();
 
-  double d_frame    = 1000.0 * (end_frame    - start_frame   ).toSec();
-  double d_features = 1000.0 * (end_features - start_features).toSec();
   double d_reg      = 1000.0 * (end_reg      - start_reg     ).toSec();
   double d_total    = 1000.0 * (end          - start         ).toSec();
 
-  diagnostics(n_features, n_valid_features, n_model_pts,
-              d_frame, d_features, d_reg, d_total);
+  diagnostics(header, n_features, n_valid_features, n_model_pts,
+              d_frame, d_features, d_reg, d_total,
+              n_iterations, n_iterations_saved, reg_failed);
+
+  if (latency_control_) updateLatencyControl(d_total);
+}
+
+void VisualOdometry::enqueuePipelineFrame(
+  const ImageMsg::ConstPtr& rgb_msg,
+  const ImageMsg::ConstPtr& depth_msg,
+  const CameraInfoMsg::ConstPtr& info_msg,
+  const ros::WallTime& start)
+{
+  PipelineFramePtr pipeline_frame = boost::make_shared<PipelineFrame>();
+  pipeline_frame->rgb_msg   = rgb_msg;
+  pipeline_frame->depth_msg = depth_msg;
+  pipeline_frame->info_msg  = info_msg;
+  pipeline_frame->start     = start;
+  pipeline_frame->ready     = false;
+
+  boost::mutex::scoped_lock lock(pipeline_mutex_);
+
+  // block the subscriber callback while the pipeline is full, so that 
+  // the backlog accumulates in the message queues, like without pipelining
+  while ((int)pipeline_frames_.size() >= pipeline_depth_)
+    pipeline_cond_.wait(lock);
+
+  pipeline_frames_.push_back(pipeline_frame);
+  lock.unlock();
+
+  pipeline_pool_->post(
+    boost::bind(&VisualOdometry::pipelineTask, this, pipeline_frame));
+}
+
+void VisualOdometry::pipelineTask(PipelineFramePtr pipeline_frame)
+{
+  processFrontEnd(
+    pipeline_frame->rgb_msg, pipeline_frame->depth_msg, pipeline_frame->info_msg,
+    pipeline_frame->frame, pipeline_frame->coarse_frame,
+    pipeline_frame->d_frame, pipeline_frame->d_features);
+
+  boost::mutex::scoped_lock lock(pipeline_mutex_);
+  pipeline_frame->ready = true;
+
+  // another worker is registering - it will pick this frame up
+  // once all the frames before it are done
+  if (pipeline_registering_) return;
+  pipeline_registering_ = true;
+
+  // register all ready frames at the head of the queue, in order
+  while (!pipeline_frames_.empty() && pipeline_frames_.front()->ready)
+  {
+    PipelineFramePtr head = pipeline_frames_.front();
+    pipeline_frames_.pop_front();
+    pipeline_cond_.notify_all();
+
+    lock.unlock();
+    processBackEnd(head->rgb_msg->header, head->frame, head->coarse_frame,
+                   head->start, head->d_frame, head->d_features);
+    lock.lock();
+  }
+
+  pipeline_registering_ = false;
 }
 
-void VisualOdometry::publishTf(const std_msgs::Header& header)
+void VisualOdometry::postOutputs(
+  const std_msgs::Header& header,
+  rgbdtools::RGBDFrame& frame)
+{
+  // the tasks get copies of the pose and of the feature means, since 
+  // f2b_ and the frame change again before the output thread gets to 
+  // them. The messages themselves are built on the output thread.
+  if (publish_tf_ || publish_odom_ || publish_path_ || publish_pose_)
+  {
+    async_publisher_->postPose(boost::bind(
+      &VisualOdometry::publishPoseOutputs, this, header, f2b_));
+  }
+
+  FeatureSnapshotPtr features;
+  PointCloudFeature::Ptr model_cloud;
+
+  if (publish_feature_cloud_ && feature_cloud_publisher_.getNumSubscribers() > 0)
+  {
+    features = boost::make_shared<FeatureSnapshot>();
+    features->header   = frame.header;
+    features->kp_means = frame.kp_means;
+    features->kp_valid = frame.kp_valid;
+  }
+
+  if (publish_model_cloud_ && model_cloud_publisher_.getNumSubscribers() > 0)
+  {
+    // the voxel_hash model is already a new cloud; only the live 
+    // rgbdtools model, which the next registration modifies, is copied
+    model_cloud = getModelCloud();
+    if (!incremental_model_)
+      model_cloud = boost::make_shared<PointCloudFeature>(*model_cloud);
+  }
+
+  if (features || model_cloud)
+  {
+    async_publisher_->postVisualization(boost::bind(
+      &VisualOdometry::publishVisualizationOutputs, this, 
+      features, model_cloud));
+  }
+}
+
+void VisualOdometry::publishPoseOutputs(
+  const std_msgs::Header& header,
+  const tf::Transform& f2b)
+{
+  if (publish_tf_)    publishTf(header, f2b);
+  if (publish_odom_)  publishOdom(header, f2b);
+  if (publish_path_)  publishPath(header, f2b);
+  if (publish_pose_)  publishPoseStamped(header, f2b);
+}
+
+void VisualOdometry::publishVisualizationOutputs(
+  const FeatureSnapshotPtr& features,
+  const PointCloudFeature::Ptr& model_cloud)
+{
+  if (features)    publishFeatureCloud(getFeatureCloud(*features));
+  if (model_cloud) publishModelCloud(model_cloud);
+}
+
+void VisualOdometry::publishTf(
+  const std_msgs::Header& header,
+  const tf::Transform& f2b)
 {
   tf::StampedTransform transform_msg(
-   f2b_, header.stamp, fixed_frame_, base_frame_);
+   f2b, header.stamp, fixed_frame_, base_frame_);
   tf_broadcaster_.sendTransform (transform_msg);
 }
 
-void VisualOdometry::publishOdom(const std_msgs::Header& header)
+void VisualOdometry::publishOdom(
+  const std_msgs::Header& header,
+  const tf::Transform& f2b)
 {
   OdomMsg odom;
   odom.header.stamp = header.stamp;
   odom.header.frame_id = fixed_frame_;
-  tf::poseTFToMsg(f2b_, odom.pose.pose);
+  tf::poseTFToMsg(f2b, odom.pose.pose);
   odom_publisher_.publish(odom);
 }
 
-void VisualOdometry::publishPoseStamped(const std_msgs::Header& header)
+void VisualOdometry::publishPoseStamped(
+  const std_msgs::Header& header,
+  const tf::Transform& f2b)
 {
   geometry_msgs::PoseStamped::Ptr pose_stamped_msg;
   pose_stamped_msg = boost::make_shared<geometry_msgs::PoseStamped>();
   pose_stamped_msg->header.stamp    = header.stamp;
   pose_stamped_msg->header.frame_id = fixed_frame_;      
-  tf::poseTFToMsg(f2b_, pose_stamped_msg->pose);
+  tf::poseTFToMsg(f2b, pose_stamped_msg->pose);
   pose_stamped_publisher_.publish(pose_stamped_msg);
 }
 
 
-void VisualOdometry::publishPath(const std_msgs::Header& header)
+void VisualOdometry::publishPath(
+  const std_msgs::Header& header,
+  const tf::Transform& f2b)
 {
+  boost::mutex::scoped_lock lock(path_mutex_);
+
   path_msg_.header.stamp = header.stamp;
   path_msg_.header.frame_id = fixed_frame_;
 
   geometry_msgs::PoseStamped pose_stamped;
   pose_stamped.header.stamp = header.stamp;
   pose_stamped.header.frame_id = fixed_frame_;
-  tf::poseTFToMsg(f2b_, pose_stamped.pose);
+  tf::poseTFToMsg(f2b, pose_stamped.pose);
 
   path_msg_.poses.push_back(pose_stamped);
-  path_pub_.publish(path_msg_);
+  int path_size = path_msg_.poses.size();
+
+  // the new poses only
+  if (path_delta_pub_.getNumSubscribers() > 0)
+  {
+    PathMsg::Ptr delta_msg = boost::make_shared<PathMsg>();
+    getPathSegment(path_msg_, path_delta_index_, *delta_msg);
+    path_delta_pub_.publish(delta_msg);
+  }
+  path_delta_index_ = path_size;
+
+  // the full (or windowed) path, which gets expensive 
+  // to serialize as the path grows
+  if (path_size % path_decimation_ != 0) return;
+  if (path_pub_.getNumSubscribers() == 0) return;
+
+  if (path_window_size_ == 0)
+  {
+    path_pub_.publish(path_msg_);
+  }
+  else
+  {
+    PathMsg::Ptr window_msg = boost::make_shared<PathMsg>();
+    getPathSegment(path_msg_, path_size - path_window_size_, *window_msg);
+    path_pub_.publish(window_msg);
+  }
+}
+
+bool VisualOdometry::getPathSrvCallback(
+  GetPath::Request& request,
+  GetPath::Response& response)
+{
+  boost::mutex::scoped_lock lock(path_mutex_);
+
+  int start_index = std::min(
+    request.start_index, (uint32_t)path_msg_.poses.size());
+
+  path_msg_.header.frame_id = fixed_frame_;
+  getPathSegment(path_msg_, start_index, response.path);
+  return true;
 }
 
 bool VisualOdometry::getBaseToCameraTf(const std_msgs::Header& header)
@@ -400,64 +1074,304 @@ bool VisualOdometry::getBaseToCameraTf(const std_msgs::Header& header)
   return true;
 }
 
+void VisualOdometry::configureTiling(int grid_rows, int grid_cols)
+{
+  if (grid_rows * grid_cols <= 1 && !fast_distributions_)
+  {
+    tiled_detector_.reset();
+    return;
+  }
+
+  if (!tile_pool_)
+    tile_pool_.reset(new ThreadPool(tile_threads_));
+
+  if (!tiled_detector_)
+  {
+    ROS_INFO("Using tiled %s detection (%dx%d)", 
+      detector_type_.c_str(), grid_rows, grid_cols);
+    tiled_detector_.reset(new TiledFeatureDetector(detector_type_, tile_pool_));
+    tiled_detector_->setSmooth(feature_detector_->getSmooth());
+    tiled_detector_->setMaxRange(feature_detector_->getMaxRange());
+    tiled_detector_->setMaxStDev(feature_detector_->getMaxStDev());
+  }
+
+  tiled_detector_->setGrid(grid_rows, grid_cols);
+}
+
+void VisualOdometry::verifyDistributions(const rgbdtools::RGBDFrame& frame)
+{
+  double max_mean_error, max_cov_error;
+  int n_mismatched = compareFeatureDistributions(frame, 
+    tiled_detector_->getMaxRange(), tiled_detector_->getMaxStDev(),
+    max_mean_error, max_cov_error);
+
+  if (n_mismatched > 0 || max_mean_error > 1e-5 || max_cov_error > 1e-7)
+  {
+    ROS_WARN("Feature distributions differ from rgbdtools: "
+      "%d validity mismatches, max mean error %.2e, max cov error %.2e",
+      n_mismatched, max_mean_error, max_cov_error);
+  }
+}
+
 void VisualOdometry::gftReconfigCallback(GftDetectorConfig& config, uint32_t level)
 {
+  boost::mutex::scoped_lock lock(detector_mutex_);
+
   rgbdtools::GftDetectorPtr gft_detector = 
     boost::static_pointer_cast<rgbdtools::GftDetector>(feature_detector_);
     
   gft_detector->setNFeatures(config.n_features);
   gft_detector->setMinDistance(config.min_distance); 
+  latency_controller_.setNFeatures(config.n_features);
+
+  configureTiling(config.grid_rows, config.grid_cols);
+  if (tiled_detector_)
+  {
+    tiled_detector_->setNFeatures(config.n_features);
+    tiled_detector_->setMinDistance(config.min_distance);
+  }
 }
 
 void VisualOdometry::starReconfigCallback(StarDetectorConfig& config, uint32_t level)
 {
+  boost::mutex::scoped_lock lock(detector_mutex_);
+
   rgbdtools::StarDetectorPtr star_detector = 
     boost::static_pointer_cast<rgbdtools::StarDetector>(feature_detector_);
     
   star_detector->setThreshold(config.threshold);
   star_detector->setMinDistance(config.min_distance); 
+  star_threshold_ = config.threshold;
+
+  configureTiling(config.grid_rows, config.grid_cols);
+  if (tiled_detector_)
+  {
+    tiled_detector_->setThreshold(config.threshold);
+    tiled_detector_->setMinDistance(config.min_distance);
+  }
 }
     
 void VisualOdometry::orbReconfigCallback(OrbDetectorConfig& config, uint32_t level)
 {
+  boost::mutex::scoped_lock lock(detector_mutex_);
+
   rgbdtools::OrbDetectorPtr orb_detector = 
     boost::static_pointer_cast<rgbdtools::OrbDetector>(feature_detector_);
     
   orb_detector->setThreshold(config.threshold);
   orb_detector->setNFeatures(config.n_features);
+  latency_controller_.setNFeatures(config.n_features);
+
+  configureTiling(config.grid_rows, config.grid_cols);
+  if (tiled_detector_)
+  {
+    tiled_detector_->setThreshold(config.threshold);
+    tiled_detector_->setNFeatures(config.n_features);
+  }
 }
 
 void VisualOdometry::diagnostics(
+  const std_msgs::Header& header,
   int n_features, int n_valid_features, int n_model_pts,
-  double d_frame, double d_features, double d_reg, double d_total)
+  double d_frame, double d_features, double d_reg, double d_total,
+  int n_iterations, int n_iterations_saved, bool reg_failed)
+{
+  DiagnosticsRecord record;
+  record.frame            = frame_count_;
+  record.stamp_sec        = header.stamp.sec;
+  record.stamp_nsec       = header.stamp.nsec;
+  record.n_features       = n_features;
+  record.n_valid_features = n_valid_features;
+  record.n_model_pts      = n_model_pts;
+  record.d_frame          = d_frame;
+  record.d_features       = d_features;
+  record.d_reg            = d_reg;
+  record.d_total          = d_total;
+  record.n_iterations     = n_iterations;
+  record.n_iterations_saved = n_iterations_saved;
+  record.reg_failed       = reg_failed ? 1 : 0;
+
+  // file output and printing happen on the writer thread
+  diagnostics_writer_->record(record);
+}
+
+void VisualOdometry::diagnosticsTimerCallback(const ros::WallTimerEvent& event)
 {
-  if(save_diagnostics_ && diagnostics_file_ != NULL)
+  if (diagnostics_publisher_.getNumSubscribers() == 0) return;
+
+  DiagnosticsSummary summary;
+  diagnostics_writer_->getSummary(summary);
+
+  diagnostic_msgs::DiagnosticStatus status;
+  status.name = nh_private_.getNamespace() + ": timing";
+  status.hardware_id = detector_type_;
+  status.level = diagnostic_msgs::DiagnosticStatus::OK;
+  status.message = "OK";
+
+  if (summary.n_records == 0)
   {
-    // print to file
-    fprintf(diagnostics_file_, "%d, %2.1f, %d, %3.1f, %d, %4.1f, %4.1f\n",
-      frame_count_,
-      d_frame,
-      n_valid_features, d_features,
-      n_model_pts, d_reg,
-      d_total);
+    status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+    status.message = "No frames processed";
   }
-  if (verbose_)
+
+  char value[32];
+  diagnostic_msgs::KeyValue kv;
+
+  sprintf(value, "%d", summary.n_records);
+  kv.key = "Frames in window";
+  kv.value = value;
+  status.values.push_back(kv);
+
+  sprintf(value, "%d", summary.n_dropped);
+  kv.key = "Dropped records";
+  kv.value = value;
+  status.values.push_back(kv);
+
+  if (scheduler_)
+  {
+    sprintf(value, "%d", scheduler_->getNDropped());
+    kv.key = "Dropped frames";
+    kv.value = value;
+    status.values.push_back(kv);
+
+    sprintf(value, "%d", scheduler_->getNReceived());
+    kv.key = "Received frames";
+    kv.value = value;
+    status.values.push_back(kv);
+  }
+
+  if (async_publisher_)
+  {
+    sprintf(value, "%d", async_publisher_->getNDropped());
+    kv.key = "Dropped visualizations";
+    kv.value = value;
+    status.values.push_back(kv);
+  }
+
+  if (incremental_model_ && incremental_motion_estimation_.getNKeyframes() > 0)
+  {
+    sprintf(value, "%d", incremental_motion_estimation_.getNKeyframes());
+    kv.key = "Model keyframes";
+    kv.value = value;
+    status.values.push_back(kv);
+  }
+
+  if (summary.mean_iterations >= 0.0)
+  {
+    sprintf(value, "%d", summary.n_failed);
+    kv.key = "Failed registrations";
+    kv.value = value;
+    status.values.push_back(kv);
+
+    sprintf(value, "%.2f", summary.mean_iterations);
+    kv.key = "ICP iterations (mean)";
+    kv.value = value;
+    status.values.push_back(kv);
+  }
+
+  if (n_compared_ > 0)
+  {
+    sprintf(value, "%.2f", summary.mean_iterations_saved);
+    kv.key = "ICP iterations saved (mean)";
+    kv.value = value;
+    status.values.push_back(kv);
+
+    sprintf(value, "%d of %d", n_unpredicted_failed_, n_compared_);
+    kv.key = "Failed registrations w/o prediction (total)";
+    kv.value = value;
+    status.values.push_back(kv);
+  }
+
+  addDurationStats(status, "Frame dur.",        summary.frame);
+  addDurationStats(status, "Feat extr. dur.",   summary.features);
+  addDurationStats(status, "Registration dur.", summary.reg);
+  addDurationStats(status, "Total dur.",        summary.total);
+
+  diagnostic_msgs::DiagnosticArray::Ptr array_msg = 
+    boost::make_shared<diagnostic_msgs::DiagnosticArray>();
+  array_msg->header.stamp = ros::Time::now();
+  array_msg->status.push_back(status);
+  diagnostics_publisher_.publish(array_msg);
+}
+
+void VisualOdometry::addDurationStats(
+  diagnostic_msgs::DiagnosticStatus& status,
+  const std::string& name,
+  const DurationStats& stats)
+{
+  char value[32];
+  diagnostic_msgs::KeyValue kv;
+
+  sprintf(value, "%.1f", stats.p50);
+  kv.key = name + " p50 (ms)";
+  kv.value = value;
+  status.values.push_back(kv);
+
+  sprintf(value, "%.1f", stats.p95);
+  kv.key = name + " p95 (ms)";
+  kv.value = value;
+  status.values.push_back(kv);
+
+  sprintf(value, "%.1f", stats.p99);
+  kv.key = name + " p99 (ms)";
+  kv.value = value;
+  status.values.push_back(kv);
+
+  sprintf(value, "%.1f", stats.max);
+  kv.key = name + " max (ms)";
+  kv.value = value;
+  status.values.push_back(kv);
+}
+
+PointCloudFeature::Ptr VisualOdometry::getFeatureCloud(
+  rgbdtools::RGBDFrame& frame)
+{
+  PointCloudFeature::Ptr feature_cloud = 
+    boost::make_shared<PointCloudFeature>(); 
+  frame.constructFeaturePointCloud(*feature_cloud);   
+  return feature_cloud;
+}
+
+PointCloudFeature::Ptr VisualOdometry::getFeatureCloud(
+  const FeatureSnapshot& features)
+{
+  PointCloudFeature::Ptr feature_cloud = 
+    boost::make_shared<PointCloudFeature>(); 
+  feature_cloud->points.reserve(features.kp_means.size());
+
+  for (unsigned int kp_idx = 0; kp_idx < features.kp_means.size(); ++kp_idx)
   {
-    // print to screen
-    ROS_INFO("[VO %d] %s[%d]: %.1f Reg[%d]: %.1f TOT: %.1f\n",
-      frame_count_,
-      detector_type_.c_str(), n_valid_features, d_features,
-      n_model_pts, d_reg,
-      d_total);
+    if (!features.kp_valid[kp_idx]) continue;
+
+    const Vector3f& kp_mean = features.kp_means[kp_idx];
+    feature_cloud->points.push_back(
+      PointFeature(kp_mean(0, 0), kp_mean(1, 0), kp_mean(2, 0)));
   }
 
-  return;
+  feature_cloud->header.frame_id = features.header.frame_id;
+  feature_cloud->header.seq      = features.header.seq;
+  feature_cloud->header.stamp    = 
+    features.header.stamp.sec * 1000000ULL + features.header.stamp.nsec / 1000;
+
+  feature_cloud->width    = feature_cloud->points.size();
+  feature_cloud->height   = 1;
+  feature_cloud->is_dense = true;
+
+  return feature_cloud;
 }
 
-void VisualOdometry::publishFeatureCloud(rgbdtools::RGBDFrame& frame)
+PointCloudFeature::Ptr VisualOdometry::getModelCloud()
+{
+  PointCloudFeature::Ptr model_cloud_ptr = incremental_model_ ?
+    incremental_motion_estimation_.getModel() :
+    motion_estimation_.getModel();
+  model_cloud_ptr->header.frame_id = fixed_frame_;
+  return model_cloud_ptr;
+}
+
+void VisualOdometry::publishFeatureCloud(
+  const PointCloudFeature::Ptr& feature_cloud)
 {
-  PointCloudFeature feature_cloud; 
-  frame.constructFeaturePointCloud(feature_cloud);   
   feature_cloud_publisher_.publish(feature_cloud);
 }
 
@@ -466,11 +1380,10 @@ void VisualOdometry::publishFeatureCovariances(rgbdtools::RGBDFrame& frame)
   ///< @TODO publish feature covariances
 }
 
-void VisualOdometry::publishModelCloud()
+void VisualOdometry::publishModelCloud(
+  const PointCloudFeature::Ptr& model_cloud)
 {
-  PointCloudFeature::Ptr model_cloud_ptr = motion_estimation_.getModel();
-  model_cloud_ptr->header.frame_id = fixed_frame_;
-  model_cloud_publisher_.publish(model_cloud_ptr);
+  model_cloud_publisher_.publish(model_cloud);
 }
 
 void VisualOdometry::publishModelCovariances()
@@ -0,0 +1,98 @@
+/**
+ *  @file async_publisher.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/async_publisher.h"
+
+namespace ccny_rgbd {
+
+AsyncPublisher::AsyncPublisher():
+  n_dropped_(0),
+  stop_(false)
+{
+  worker_ = boost::thread(boost::bind(&AsyncPublisher::workerLoop, this));
+}
+
+AsyncPublisher::~AsyncPublisher()
+{
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_all();
+  worker_.join();
+}
+
+void AsyncPublisher::postPose(const Task& task)
+{
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    pose_tasks_.push_back(task);
+  }
+  cond_.notify_one();
+}
+
+void AsyncPublisher::postVisualization(const Task& task)
+{
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (visualization_task_) n_dropped_++;
+    visualization_task_ = task;
+  }
+  cond_.notify_one();
+}
+
+int AsyncPublisher::getNDropped()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return n_dropped_;
+}
+
+void AsyncPublisher::workerLoop()
+{
+  while(true)
+  {
+    Task task;
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      while (pose_tasks_.empty() && !visualization_task_ && !stop_)
+        cond_.wait(lock);
+
+      // pose tasks first, and all of them, also when shutting down
+      if (!pose_tasks_.empty())
+      {
+        task.swap(pose_tasks_.front());
+        pose_tasks_.pop_front();
+      }
+      else if (stop_)
+        return;
+      else
+        task.swap(visualization_task_);
+    }
+
+    task();
+  }
+}
+
+} // namespace ccny_rgbd
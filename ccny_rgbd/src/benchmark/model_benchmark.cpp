@@ -0,0 +1,316 @@
+/**
+ *  @file model_benchmark.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @brief Micro-benchmark of the ICPProbModel registration against the
+ * model size, for the two nearest-neighbor indices.
+ *
+ * Runs a synthetic sequence (a camera moving through a random point
+ * scene, observing noisy 3D features) through 
+ * rgbdtools::MotionEstimationICPProbModel (k-d tree rebuilt every frame)
+ * and IncrementalICPProbModel (incremental voxel hash), for each model
+ * size. Reports the registration latency once the model is full, and 
+ * the final position error.
+ *
+ * Usage: model_benchmark [--option value ...]
+ *
+ * Run with an invalid option (for example --help) for the list of options.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+#include <boost/lexical_cast.hpp>
+#include <rgbdtools/rgbdtools.h>
+
+#include "ccny_rgbd/types.h"
+#include "ccny_rgbd/util.h"
+#include "ccny_rgbd/incremental_icp_prob_model.h"
+
+namespace ccny_rgbd {
+
+/** @brief Result of one benchmark run
+ */
+struct ModelBenchmarkResult
+{
+  std::vector<double> reg;  ///< registration durations once the model is full (ms)
+  int model_size;           ///< final model size
+  double position_error;    ///< final position error (m)
+};
+
+void printUsage()
+{
+  printf("Usage: model_benchmark [--option value ...]\n\n");
+  printf("Options (defaults in brackets):\n");
+  printf("  --model_sizes          comma-separated max. model sizes [3000,5000,20000]\n");
+  printf("  --n_frames             frames per run [800]\n");
+  printf("  --n_features           features per frame [400]\n");
+  printf("  --noise                feature position noise std. dev., m [0.003]\n");
+  printf("  --density              scene points per m of corridor [1500]\n");
+  printf("  --voxel_size           voxel_hash voxel size, m [0.15]\n");
+  printf("  --max_search_dist      voxel_hash association search distance, m [0.5]\n");
+  printf("  --seed                 random seed [1]\n");
+}
+
+double gaussian(double std_dev)
+{
+  // Box-Muller
+  double u1 = std::max(uniform(), 1e-12);
+  double u2 = uniform();
+  return std_dev * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+bool compareX(const Vector3f& a, const Vector3f& b)
+{
+  return a(0) < b(0);
+}
+
+/** @brief Random points on the walls, floor and ceiling of a long 
+ * corridor along x, sorted by x
+ */
+void createScene(int n_points, double length, Vector3fVector& scene)
+{
+  scene.resize(n_points);
+
+  for (int i = 0; i < n_points; ++i)
+  {
+    float x = uniform() * length;
+    float a = uniform() * 2.0 - 1.0;
+    Vector3f point;
+
+    switch (i % 4)
+    {
+      case 0:  point = Vector3f(x, -1.5, a * 1.5); break;
+      case 1:  point = Vector3f(x,  1.5, a * 1.5); break;
+      case 2:  point = Vector3f(x, a * 1.5, -1.5); break;
+      default: point = Vector3f(x, a * 1.5,  1.5); break;
+    }
+
+    scene[i] = point;
+  }
+
+  std::sort(scene.begin(), scene.end(), compareX);
+}
+
+/** @brief Pose of the camera (z forward, along the corridor) at a frame
+ */
+AffineTransform getGroundTruthPose(int frame_idx)
+{
+  AffineTransform pose;
+  pose = Eigen::Translation3f(0.02 * frame_idx, 0.0, 0.0) *
+         Eigen::AngleAxisf(0.05 * sin(0.05 * frame_idx), Vector3f::UnitZ()) *
+         Eigen::AngleAxisf(M_PI / 2.0, Vector3f::UnitY());
+  return pose;
+}
+
+/** @brief Creates a frame with the distributions of n_features random
+ * scene points near the camera, in the camera frame
+ */
+void createFrame(
+  const Vector3fVector& scene,
+  double length,
+  const AffineTransform& pose,
+  int n_features,
+  double noise,
+  rgbdtools::RGBDFrame& frame)
+{
+  AffineTransform pose_inv = pose.inverse();
+
+  // the scene points within 2 m ahead of the camera
+  double x_min = pose.translation()(0);
+  int begin = (int)(scene.size() * x_min / length);
+  int end   = (int)(scene.size() * (x_min + 2.0) / length);
+  end = std::min(end, (int)scene.size());
+
+  double var = noise * noise;
+  Matrix3f cov = Matrix3f::Identity() * var;
+
+  frame.keypoints.resize(n_features);
+  frame.kp_valid.resize(n_features);
+  frame.kp_means.resize(n_features);
+  frame.kp_covariances.resize(n_features);
+
+  for (int i = 0; i < n_features; ++i)
+  {
+    int idx = begin + rand() % std::max(1, end - begin);
+    Vector3f point = pose_inv * scene[idx];
+    point += Vector3f(gaussian(noise), gaussian(noise), gaussian(noise));
+
+    frame.kp_valid[i] = true;
+    frame.kp_means[i] = point;
+    frame.kp_covariances[i] = cov;
+  }
+
+  frame.n_valid_keypoints = n_features;
+}
+
+template <typename T>
+void configureModel(T& motion_estimation, int max_model_size)
+{
+  motion_estimation.setTfEpsilonLinear(1e-4);
+  motion_estimation.setTfEpsilonAngular(1.7e-3);
+  motion_estimation.setMaxIterations(10);
+  motion_estimation.setMinCorrespondences(15);
+  motion_estimation.setMaxModelSize(max_model_size);
+  motion_estimation.setMaxCorrespondenceDistEuclidean(0.15);
+  motion_estimation.setMaxAssociationDistMahalanobis(10.0);
+  motion_estimation.setNNearestNeighbors(4);
+}
+
+template <typename T>
+void runSequence(
+  const OptionMap& options,
+  const Vector3fVector& scene,
+  double length,
+  int max_model_size,
+  T& motion_estimation,
+  ModelBenchmarkResult& result)
+{
+  int n_frames   = getOption<int>(options, "n_frames", 800);
+  int n_features = getOption<int>(options, "n_features", 400);
+  double noise   = getOption<double>(options, "noise", 0.003);
+
+  // the same frames for every run
+  srand(getOption<int>(options, "seed", 1));
+
+  configureModel(motion_estimation, max_model_size);
+
+  // the model is built in the frame of the first pose
+  AffineTransform f2b = AffineTransform::Identity();
+  motion_estimation.setBaseToCameraTf(AffineTransform::Identity());
+
+  result.reg.clear();
+
+  for (int frame_idx = 0; frame_idx < n_frames; ++frame_idx)
+  {
+    AffineTransform pose = getGroundTruthPose(frame_idx);
+
+    rgbdtools::RGBDFrame frame;
+    createFrame(scene, length, pose, n_features, noise, frame);
+
+    bool full = motion_estimation.getModelSize() >= max_model_size;
+
+    ros::WallTime start_reg = ros::WallTime::now();
+    AffineTransform motion = motion_estimation.getMotionEstimation(frame);
+    double d_reg = getMsDuration(start_reg);
+
+    f2b = motion * f2b;
+
+    if (full) result.reg.push_back(d_reg);
+  }
+
+  AffineTransform pose = getGroundTruthPose(0).inverse() * getGroundTruthPose(n_frames - 1);
+
+  result.model_size = motion_estimation.getModelSize();
+  result.position_error = (pose.translation() - f2b.translation()).norm();
+}
+
+void printResult(
+  const char * index_type, int max_model_size, ModelBenchmarkResult result)
+{
+  std::sort(result.reg.begin(), result.reg.end());
+
+  double sum = 0.0;
+  for (unsigned int i = 0; i < result.reg.size(); ++i)
+    sum += result.reg[i];
+  double mean = result.reg.empty() ? 0.0 : sum / result.reg.size();
+
+  printf("%-11s %8d %8d %6d %8.2f %8.2f %8.2f %8.3f\n",
+    index_type, max_model_size, result.model_size, (int)result.reg.size(),
+    mean,
+    getPercentile(result.reg, 50.0),
+    getPercentile(result.reg, 95.0),
+    result.position_error);
+}
+
+int runBenchmark(const OptionMap& options)
+{
+  std::vector<int> model_sizes;
+
+  std::stringstream ss(getOption<std::string>(options, "model_sizes", "3000,5000,20000"));
+  std::string item;
+  while (std::getline(ss, item, ','))
+    model_sizes.push_back(boost::lexical_cast<int>(item));
+
+  int n_frames = getOption<int>(options, "n_frames", 800);
+  double voxel_size = getOption<double>(options, "voxel_size", 0.15);
+  double max_search_dist = getOption<double>(options, "max_search_dist", 0.5);
+  double density = getOption<double>(options, "density", 1500.0);
+
+  // long enough for the camera to keep discovering new points
+  double length = 0.02 * n_frames + 2.0;
+  Vector3fVector scene;
+  createScene((int)(length * density), length, scene);
+
+  printf("%-11s %8s %8s %6s %8s %8s %8s %8s\n",
+    "Index", "max size", "size", "frames", "mean", "p50", "p95", "error");
+  printf("%-11s %8s %8s %6s %8s %8s %8s %8s\n",
+    "", "", "", "", "[ms]", "[ms]", "[ms]", "[m]");
+
+  for (unsigned int i = 0; i < model_sizes.size(); ++i)
+  {
+    int max_model_size = model_sizes[i];
+    ModelBenchmarkResult result;
+
+    rgbdtools::MotionEstimationICPProbModel kdtree_model;
+    runSequence(options, scene, length, max_model_size, kdtree_model, result);
+    printResult("kdtree", max_model_size, result);
+
+    IncrementalICPProbModel voxel_hash_model;
+    voxel_hash_model.setVoxelSize(voxel_size);
+    voxel_hash_model.setMaxSearchDist(max_search_dist);
+    runSequence(options, scene, length, max_model_size, voxel_hash_model, result);
+    printResult("voxel_hash", max_model_size, result);
+  }
+
+  printf("\nLatencies are for frames registered with a full model.\n");
+
+  return 0;
+}
+
+} // namespace ccny_rgbd
+
+int main(int argc, char** argv)
+{
+  ccny_rgbd::OptionMap options;
+
+  if (!ccny_rgbd::parseOptions(argc, argv, 1, options))
+  {
+    ccny_rgbd::printUsage();
+    return 1;
+  }
+
+  // no ROS master, but ros::WallTime still needs initializing
+  ros::Time::init();
+
+  try
+  {
+    return ccny_rgbd::runBenchmark(options);
+  }
+  catch (boost::bad_lexical_cast& ex)
+  {
+    fprintf(stderr, "Invalid option value: %s\n", ex.what());
+    return 1;
+  }
+}
@@ -0,0 +1,238 @@
+/**
+ *  @file unwarp_benchmark.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @brief Micro-benchmark of the depth unwarping, at VGA and QVGA.
+ *
+ * Unwarps synthetic depth images (random depths with holes, random
+ * coefficients close to the identity) with rgbdtools::unwarpDepthImage
+ * (three double coefficient images) and with DepthRegistration::unwarp
+ * (packed float coefficients, SSE2), for each fit mode. Reports the
+ * latencies, and how many pixels of the two results differ.
+ *
+ * Usage: unwarp_benchmark [--option value ...]
+ *
+ * Run with an invalid option (for example --help) for the list of options.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <boost/lexical_cast.hpp>
+#include <rgbdtools/rgbdtools.h>
+
+#include "ccny_rgbd/types.h"
+#include "ccny_rgbd/util.h"
+#include "ccny_rgbd/depth_registration.h"
+
+namespace ccny_rgbd {
+
+/** @brief Result of one benchmark run
+ */
+struct UnwarpBenchmarkResult
+{
+  std::vector<double> rgbdtools_dur;  ///< rgbdtools::unwarpDepthImage durations (ms)
+  std::vector<double> packed_dur;     ///< DepthRegistration::unwarp durations (ms)
+  int n_pixels;                       ///< pixels compared
+  int n_different;                    ///< pixels where the results differ
+  int max_difference;                 ///< max. difference of the results (mm)
+};
+
+void printUsage()
+{
+  printf("Usage: unwarp_benchmark [--option value ...]\n\n");
+  printf("Options (defaults in brackets):\n");
+  printf("  --n_frames             frames per run [200]\n");
+  printf("  --hole_ratio           ratio of pixels without depth [0.2]\n");
+  printf("  --seed                 random seed [1]\n");
+}
+
+/** @brief Random depth image (mm), with holes
+ */
+void createDepthImage(const cv::Size& size, double hole_ratio, cv::Mat& depth_img)
+{
+  depth_img.create(size, CV_16UC1);
+
+  for (int v = 0; v < size.height; ++v)
+  for (int u = 0; u < size.width;  ++u)
+  {
+    if (uniform() < hole_ratio)
+      depth_img.at<uint16_t>(v, u) = 0;
+    else
+      depth_img.at<uint16_t>(v, u) = 500 + uniform() * 5000;
+  }
+}
+
+/** @brief Random coefficient images, close to the identity, with
+ * magnitudes like those of a typical warp.yml
+ */
+void createCoefficients(const cv::Size& size, cv::Mat& coeff_0, cv::Mat& coeff_1, cv::Mat& coeff_2)
+{
+  coeff_0.create(size, CV_64FC1);
+  coeff_1.create(size, CV_64FC1);
+  coeff_2.create(size, CV_64FC1);
+
+  for (int v = 0; v < size.height; ++v)
+  for (int u = 0; u < size.width;  ++u)
+  {
+    coeff_0.at<double>(v, u) = 40.0   * (uniform() - 0.5);
+    coeff_1.at<double>(v, u) = 1.0 + 0.04 * (uniform() - 0.5);
+    coeff_2.at<double>(v, u) = 2e-6   * (uniform() - 0.5);
+  }
+}
+
+void runSequence(
+  const OptionMap& options,
+  const cv::Size& size,
+  int fit_mode,
+  UnwarpBenchmarkResult& result)
+{
+  int n_frames = getOption<int>(options, "n_frames", 200);
+  double hole_ratio = getOption<double>(options, "hole_ratio", 0.2);
+
+  cv::Mat coeff_0, coeff_1, coeff_2;
+  createCoefficients(size, coeff_0, coeff_1, coeff_2);
+
+  DepthRegistration depth_registration;
+  depth_registration.setUnwarpCoefficients(coeff_0, coeff_1, coeff_2, fit_mode);
+
+  result.rgbdtools_dur.clear();
+  result.packed_dur.clear();
+  result.n_pixels = 0;
+  result.n_different = 0;
+  result.max_difference = 0;
+
+  cv::Mat depth_img, depth_img_rgbdtools, depth_img_packed;
+
+  for (int i = 0; i < n_frames; ++i)
+  {
+    createDepthImage(size, hole_ratio, depth_img);
+
+    // rgbdtools unwarps in place
+    depth_img_rgbdtools = depth_img.clone();
+    ros::WallTime start_rgbdtools = ros::WallTime::now();
+    rgbdtools::unwarpDepthImage(
+      depth_img_rgbdtools, coeff_0, coeff_1, coeff_2, fit_mode);
+    result.rgbdtools_dur.push_back(getMsDuration(start_rgbdtools));
+
+    ros::WallTime start_packed = ros::WallTime::now();
+    depth_registration.unwarp(depth_img, depth_img_packed);
+    result.packed_dur.push_back(getMsDuration(start_packed));
+
+    for (int v = 0; v < size.height; ++v)
+    for (int u = 0; u < size.width;  ++u)
+    {
+      int diff = abs((int)depth_img_rgbdtools.at<uint16_t>(v, u) -
+                     (int)depth_img_packed.at<uint16_t>(v, u));
+      if (diff > 0) result.n_different++;
+      result.max_difference = std::max(result.max_difference, diff);
+    }
+
+    result.n_pixels += size.area();
+  }
+}
+
+double getMean(const std::vector<double>& values)
+{
+  double sum = 0.0;
+  for (unsigned int i = 0; i < values.size(); ++i)
+    sum += values[i];
+  return values.empty() ? 0.0 : sum / values.size();
+}
+
+void printResult(
+  const char * size_name, const char * fit_mode_name, UnwarpBenchmarkResult result)
+{
+  std::sort(result.rgbdtools_dur.begin(), result.rgbdtools_dur.end());
+  std::sort(result.packed_dur.begin(), result.packed_dur.end());
+
+  double rgbdtools_mean = getMean(result.rgbdtools_dur);
+  double packed_mean = getMean(result.packed_dur);
+
+  printf("%-5s %-15s %8.3f %8.3f %8.3f %8.3f %6.1fx %8.4f %6d\n",
+    size_name, fit_mode_name,
+    rgbdtools_mean,
+    getPercentile(result.rgbdtools_dur, 95.0),
+    packed_mean,
+    getPercentile(result.packed_dur, 95.0),
+    packed_mean > 0.0 ? rgbdtools_mean / packed_mean : 0.0,
+    100.0 * result.n_different / std::max(result.n_pixels, 1),
+    result.max_difference);
+}
+
+int runBenchmark(const OptionMap& options)
+{
+  srand(getOption<int>(options, "seed", 1));
+
+  const char * size_names[] = { "VGA", "QVGA" };
+  const cv::Size sizes[] = { cv::Size(640, 480), cv::Size(320, 240) };
+
+  const char * fit_mode_names[] = {
+    "LINEAR", "LINEAR_ZERO", "QUADRATIC", "QUADRATIC_ZERO" };
+  const int fit_modes[] = {
+    rgbdtools::DEPTH_FIT_LINEAR,
+    rgbdtools::DEPTH_FIT_LINEAR_ZERO,
+    rgbdtools::DEPTH_FIT_QUADRATIC,
+    rgbdtools::DEPTH_FIT_QUADRATIC_ZERO };
+
+  printf("%-5s %-15s %8s %8s %8s %8s %7s %8s %6s\n",
+    "size", "fit mode", "rgbdt", "rgbdt95", "packed", "packed95", "speedup", "diff", "max");
+  printf("%-5s %-15s %8s %8s %8s %8s %7s %8s %6s\n",
+    "", "", "[ms]", "[ms]", "[ms]", "[ms]", "", "[%]", "[mm]");
+
+  for (int s = 0; s < 2; ++s)
+  for (int m = 0; m < 4; ++m)
+  {
+    UnwarpBenchmarkResult result;
+    runSequence(options, sizes[s], fit_modes[m], result);
+    printResult(size_names[s], fit_mode_names[m], result);
+  }
+
+  return 0;
+}
+
+} // namespace ccny_rgbd
+
+int main(int argc, char** argv)
+{
+  ccny_rgbd::OptionMap options;
+
+  if (!ccny_rgbd::parseOptions(argc, argv, 1, options))
+  {
+    ccny_rgbd::printUsage();
+    return 1;
+  }
+
+  // no ROS master, but ros::WallTime still needs initializing
+  ros::Time::init();
+
+  try
+  {
+    return ccny_rgbd::runBenchmark(options);
+  }
+  catch (boost::bad_lexical_cast& ex)
+  {
+    fprintf(stderr, "Invalid option value: %s\n", ex.what());
+    return 1;
+  }
+}
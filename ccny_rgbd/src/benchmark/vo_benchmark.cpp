@@ -0,0 +1,603 @@
+/**
+ *  @file vo_benchmark.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @brief Offline benchmark of the visual odometry core.
+ *
+ * Reads RGB, depth and camera info messages from a bag file and runs
+ * them through the same frame creation, feature detection and
+ * ICPProbModel registration as the VisualOdometry app, without a ROS
+ * master, tf or a message synchronizer. Reports per-stage latency
+ * percentiles and throughput, and writes the trajectory in TUM format.
+ *
+ * Usage: vo_benchmark <bag file> [--option value ...]
+ *
+ * Run with no arguments for the list of options.
+ */
+
+#include <cstdio>
+#include <deque>
+#include <sstream>
+#include <algorithm>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <rgbdtools/rgbdtools.h>
+
+#include "ccny_rgbd/types.h"
+#include "ccny_rgbd/util.h"
+#include "ccny_rgbd/incremental_icp_prob_model.h"
+#include "ccny_rgbd/motion_predictor.h"
+#include "ccny_rgbd/coarse_to_fine.h"
+#include "ccny_rgbd/rgbd_frame_factory.h"
+
+namespace ccny_rgbd {
+
+/** @brief A synchronized set of RGB, depth and camera info messages
+ */
+struct RGBDMessages
+{
+  ImageMsg::ConstPtr rgb_msg;
+  ImageMsg::ConstPtr depth_msg;
+  CameraInfoMsg::ConstPtr info_msg;
+};
+
+/** @brief Per-frame stage durations, in ms
+ */
+struct StageDurations
+{
+  std::vector<double> frame;
+  std::vector<double> features;
+  std::vector<double> reg;
+  std::vector<double> total;
+};
+
+void printUsage()
+{
+  printf("Usage: vo_benchmark <bag file> [--option value ...]\n\n");
+  printf("Options (defaults in brackets):\n");
+  printf("  --rgb_topic            [/rgbd/rgb]\n");
+  printf("  --depth_topic          [/rgbd/depth]\n");
+  printf("  --info_topic           [/rgbd/info]\n");
+  printf("  --sync_tolerance       max. stamp difference within a frame, s [0.02]\n");
+  printf("  --max_frames           stop after this many frames, 0 = all [0]\n");
+  printf("  --trajectory           output trajectory file, TUM format [trajectory.tum.txt]\n");
+  printf("  --b2c                  base to camera tf, \"x y z roll pitch yaw\" [identity]\n");
+  printf("  --detector_type        GFT, STAR or ORB [GFT]\n");
+  printf("  --n_features           GFT, ORB [400]\n");
+  printf("  --min_distance         GFT, STAR [GFT: 1, STAR: 2]\n");
+  printf("  --threshold            STAR, ORB [STAR: 32.0, ORB: 31.0]\n");
+  printf("  --smooth               [0]\n");
+  printf("  --max_range            [5.5]\n");
+  printf("  --max_stdev            [0.03]\n");
+  printf("  --motion_constraint    [0]\n");
+  printf("  --tf_epsilon_linear    [1e-4]\n");
+  printf("  --tf_epsilon_angular   [1.7e-3]\n");
+  printf("  --max_iterations       [10]\n");
+  printf("  --min_correspondences  [15]\n");
+  printf("  --max_model_size       [3000]\n");
+  printf("  --max_corresp_dist_eucl [0.15]\n");
+  printf("  --max_assoc_dist_mah   [10.0]\n");
+  printf("  --n_nearest_neighbors  [4]\n");
+  printf("  --index_type           kdtree or voxel_hash [kdtree]\n");
+  printf("  --voxel_size           voxel_hash [0.15]\n");
+  printf("  --max_search_dist      voxel_hash [0.5]\n");
+  printf("  --max_keyframes        voxel_hash: keyframes kept in the model, 0 = no limit [0]\n");
+  printf("  --max_keyframe_dist    voxel_hash: max. distance of a kept keyframe, m, 0 = no limit [0.0]\n");
+  printf("  --kf_dist_eps          voxel_hash: motion starting a new keyframe, m [0.25]\n");
+  printf("  --kf_angle_eps         voxel_hash: rotation starting a new keyframe, rad [0.35]\n");
+  printf("  --motion_prediction    voxel_hash: none, constant_velocity or decaying_velocity [none]\n");
+  printf("  --decay_time           decaying_velocity time constant, s [0.5]\n");
+  printf("  --max_dt               max. time between frames for a prediction, s [0.2]\n");
+  printf("  --compare_prediction   also register without the prediction, 0 or 1 [0]\n");
+  printf("  --coarse_to_fine       voxel_hash: detect and register at a lower scale first, 0 or 1 [0]\n");
+  printf("  --c2f_scale            scale of the coarse level [0.5]\n");
+  printf("  --fine_features        keypoints refined at full resolution, 0 = all [150]\n");
+  printf("  --refine_window        half size of the refinement window, pixels [3]\n");
+}
+
+rgbdtools::FeatureDetectorPtr createFeatureDetector(const OptionMap& options)
+{
+  std::string detector_type = getOption<std::string>(options, "detector_type", "GFT");
+
+  rgbdtools::FeatureDetectorPtr feature_detector;
+
+  if (detector_type == "ORB")
+  {
+    rgbdtools::OrbDetectorPtr orb_detector(new rgbdtools::OrbDetector());
+    orb_detector->setNFeatures(getOption<int>(options, "n_features", 400));
+    orb_detector->setThreshold(getOption<double>(options, "threshold", 31.0));
+    feature_detector = orb_detector;
+  }
+  else if (detector_type == "STAR")
+  {
+    rgbdtools::StarDetectorPtr star_detector(new rgbdtools::StarDetector());
+    star_detector->setThreshold(getOption<double>(options, "threshold", 32.0));
+    star_detector->setMinDistance(getOption<int>(options, "min_distance", 2));
+    feature_detector = star_detector;
+  }
+  else
+  {
+    if (detector_type != "GFT")
+      fprintf(stderr, "%s is not a valid detector type! Using GFT\n", detector_type.c_str());
+
+    rgbdtools::GftDetectorPtr gft_detector(new rgbdtools::GftDetector());
+    gft_detector->setNFeatures(getOption<int>(options, "n_features", 400));
+    gft_detector->setMinDistance(getOption<int>(options, "min_distance", 1));
+    feature_detector = gft_detector;
+  }
+
+  feature_detector->setSmooth(getOption<int>(options, "smooth", 0));
+  feature_detector->setMaxRange(getOption<double>(options, "max_range", 5.5));
+  feature_detector->setMaxStDev(getOption<double>(options, "max_stdev", 0.03));
+
+  return feature_detector;
+}
+
+template <typename T>
+void configureMotionEstimation(
+  const OptionMap& options,
+  T& motion_estimation)
+{
+  motion_estimation.setMotionConstraint(
+    getOption<int>(options, "motion_constraint", 0));
+  motion_estimation.setTfEpsilonLinear(
+    getOption<double>(options, "tf_epsilon_linear", 1e-4));
+  motion_estimation.setTfEpsilonAngular(
+    getOption<double>(options, "tf_epsilon_angular", 1.7e-3));
+  motion_estimation.setMaxIterations(
+    getOption<int>(options, "max_iterations", 10));
+  motion_estimation.setMinCorrespondences(
+    getOption<int>(options, "min_correspondences", 15));
+  motion_estimation.setMaxModelSize(
+    getOption<int>(options, "max_model_size", 3000));
+  motion_estimation.setMaxCorrespondenceDistEuclidean(
+    getOption<double>(options, "max_corresp_dist_eucl", 0.15));
+  motion_estimation.setMaxAssociationDistMahalanobis(
+    getOption<double>(options, "max_assoc_dist_mah", 10.0));
+  motion_estimation.setNNearestNeighbors(
+    getOption<int>(options, "n_nearest_neighbors", 4));
+}
+
+tf::Transform getBaseToCameraTf(const OptionMap& options)
+{
+  tf::Transform b2c;
+  b2c.setIdentity();
+
+  OptionMap::const_iterator it = options.find("b2c");
+  if (it == options.end()) return b2c;
+
+  double x, y, z, roll, pitch, yaw;
+  std::istringstream is(it->second);
+  if (!(is >> x >> y >> z >> roll >> pitch >> yaw))
+  {
+    fprintf(stderr, "Invalid b2c transform, using identity\n");
+    return b2c;
+  }
+
+  b2c.setOrigin(tf::Vector3(x, y, z));
+  b2c.setRotation(tf::createQuaternionFromRPY(roll, pitch, yaw));
+  return b2c;
+}
+
+/** @brief Pairs up the oldest messages in the queues whose stamps are
+ * within tolerance of each other, discarding messages which cannot
+ * be paired.
+ *
+ * @return true if a synchronized set was found
+ */
+bool popSynchronizedMessages(
+  std::deque<ImageMsg::ConstPtr>& rgb_queue,
+  std::deque<ImageMsg::ConstPtr>& depth_queue,
+  std::deque<CameraInfoMsg::ConstPtr>& info_queue,
+  double tolerance,
+  RGBDMessages& messages)
+{
+  while (!rgb_queue.empty())
+  {
+    double t = rgb_queue.front()->header.stamp.toSec();
+
+    // drop messages which are too old to match this (or any later) rgb message
+    while (!depth_queue.empty() && depth_queue.front()->header.stamp.toSec() < t - tolerance)
+      depth_queue.pop_front();
+    while (!info_queue.empty() && info_queue.front()->header.stamp.toSec() < t - tolerance)
+      info_queue.pop_front();
+
+    if (depth_queue.empty() || info_queue.empty()) return false;
+
+    double t_depth = depth_queue.front()->header.stamp.toSec();
+    double t_info  = info_queue.front()->header.stamp.toSec();
+
+    if (t_depth > t + tolerance || t_info > t + tolerance)
+    {
+      // no match for this rgb message
+      rgb_queue.pop_front();
+      continue;
+    }
+
+    messages.rgb_msg   = rgb_queue.front();
+    messages.depth_msg = depth_queue.front();
+    messages.info_msg  = info_queue.front();
+
+    rgb_queue.pop_front();
+    depth_queue.pop_front();
+    info_queue.pop_front();
+    return true;
+  }
+
+  return false;
+}
+
+void printStage(const char * name, std::vector<double> durations)
+{
+  std::sort(durations.begin(), durations.end());
+
+  double sum = 0.0;
+  for (unsigned int i = 0; i < durations.size(); ++i)
+    sum += durations[i];
+  double mean = durations.empty() ? 0.0 : sum / durations.size();
+
+  printf("%-14s %8.2f %8.2f %8.2f %8.2f %8.2f\n", name, mean,
+    getPercentile(durations, 50.0),
+    getPercentile(durations, 95.0),
+    getPercentile(durations, 99.0),
+    durations.empty() ? 0.0 : durations.back());
+}
+
+bool writeTrajectory(const std::string& filename, const PathMsg& path_msg)
+{
+  FILE * file = fopen(filename.c_str(), "w");
+  if (file == NULL) return false;
+
+  fprintf(file, "# stamp x y z qx qy qz qw\n");
+
+  for (unsigned int idx = 0; idx < path_msg.poses.size(); ++idx)
+  {
+    const geometry_msgs::PoseStamped& pose = path_msg.poses[idx];
+
+    fprintf(file, "%d.%09d %f %f %f %f %f %f %f\n",
+      pose.header.stamp.sec, pose.header.stamp.nsec,
+      pose.pose.position.x, pose.pose.position.y, pose.pose.position.z,
+      pose.pose.orientation.x, pose.pose.orientation.y,
+      pose.pose.orientation.z, pose.pose.orientation.w);
+  }
+
+  fclose(file);
+  return true;
+}
+
+int runBenchmark(const std::string& bag_filename, const OptionMap& options)
+{
+  std::string rgb_topic   = getOption<std::string>(options, "rgb_topic",   "/rgbd/rgb");
+  std::string depth_topic = getOption<std::string>(options, "depth_topic", "/rgbd/depth");
+  std::string info_topic  = getOption<std::string>(options, "info_topic",  "/rgbd/info");
+  std::string trajectory_filename =
+    getOption<std::string>(options, "trajectory", "trajectory.tum.txt");
+  double sync_tolerance = getOption<double>(options, "sync_tolerance", 0.02);
+  int max_frames = getOption<int>(options, "max_frames", 0);
+
+  // **** set up the VO core
+
+  rgbdtools::FeatureDetectorPtr feature_detector = createFeatureDetector(options);
+
+  std::string index_type = getOption<std::string>(options, "index_type", "kdtree");
+
+  rgbdtools::MotionEstimationICPProbModel kdtree_motion_estimation;
+  IncrementalICPProbModel voxel_hash_motion_estimation;
+  rgbdtools::MotionEstimation * motion_estimation;
+
+  if (index_type == "voxel_hash")
+  {
+    voxel_hash_motion_estimation.setVoxelSize(
+      getOption<double>(options, "voxel_size", 0.15));
+    voxel_hash_motion_estimation.setMaxSearchDist(
+      getOption<double>(options, "max_search_dist", 0.5));
+    voxel_hash_motion_estimation.setComparePrediction(
+      getOption<int>(options, "compare_prediction", 0) != 0);
+    voxel_hash_motion_estimation.setKeyframeWindow(
+      getOption<int>(options, "max_keyframes", 0),
+      getOption<double>(options, "max_keyframe_dist", 0.0));
+    voxel_hash_motion_estimation.setKeyframeThresholds(
+      getOption<double>(options, "kf_dist_eps", 0.25),
+      getOption<double>(options, "kf_angle_eps", 0.35));
+    configureMotionEstimation(options, voxel_hash_motion_estimation);
+    motion_estimation = &voxel_hash_motion_estimation;
+  }
+  else
+  {
+    if (index_type != "kdtree")
+      fprintf(stderr, "%s is not a valid index type! Using kdtree\n", index_type.c_str());
+
+    configureMotionEstimation(options, kdtree_motion_estimation);
+    motion_estimation = &kdtree_motion_estimation;
+  }
+
+  MotionPredictor motion_predictor;
+  std::string prediction_mode = 
+    getOption<std::string>(options, "motion_prediction", "none");
+
+  if (!motion_predictor.setMode(prediction_mode))
+    fprintf(stderr, "%s is not a valid motion prediction mode! Using none\n", 
+      prediction_mode.c_str());
+
+  if (motion_predictor.getMode() != MotionPredictor::NONE && index_type != "voxel_hash")
+  {
+    fprintf(stderr, "Motion prediction requires index_type voxel_hash, disabling\n");
+    motion_predictor.setMode(MotionPredictor::NONE);
+  }
+
+  motion_predictor.setDecayTime(getOption<double>(options, "decay_time", 0.5));
+  motion_predictor.setMaxDt(getOption<double>(options, "max_dt", 0.2));
+
+  bool coarse_to_fine = getOption<int>(options, "coarse_to_fine", 0) != 0;
+
+  if (coarse_to_fine && index_type != "voxel_hash")
+  {
+    fprintf(stderr, "Coarse-to-fine registration requires index_type voxel_hash, disabling\n");
+    coarse_to_fine = false;
+  }
+
+  // same frame creation as VisualOdometry, including its buffer reuse
+  RGBDFrameFactory frame_factory;
+
+  CoarseToFine pyramid;
+  pyramid.setScale(getOption<double>(options, "c2f_scale", 0.5));
+  pyramid.setNFineFeatures(getOption<int>(options, "fine_features", 150));
+  pyramid.setRefineWindow(getOption<int>(options, "refine_window", 3));
+  pyramid.setMaxRange(feature_detector->getMaxRange());
+  pyramid.setMaxStDev(feature_detector->getMaxStDev());
+
+  tf::Transform b2c = getBaseToCameraTf(options);
+  motion_estimation->setBaseToCameraTf(eigenAffineFromTf(b2c));
+
+  tf::Transform f2b;
+  f2b.setIdentity();
+
+  // **** open the bag
+
+  rosbag::Bag bag;
+  try
+  {
+    bag.open(bag_filename, rosbag::bagmode::Read);
+  }
+  catch (rosbag::BagException& ex)
+  {
+    fprintf(stderr, "Could not open %s: %s\n", bag_filename.c_str(), ex.what());
+    return 1;
+  }
+
+  std::vector<std::string> topics;
+  topics.push_back(rgb_topic);
+  topics.push_back(depth_topic);
+  topics.push_back(info_topic);
+
+  rosbag::View view(bag, rosbag::TopicQuery(topics));
+
+  std::deque<ImageMsg::ConstPtr> rgb_queue, depth_queue;
+  std::deque<CameraInfoMsg::ConstPtr> info_queue;
+
+  StageDurations durations;
+  PathMsg path_msg;
+  int n_frames = 0;
+
+  int n_iterations = 0;             // voxel_hash only
+  int n_failed = 0;
+  int n_compared = 0;
+  int n_iterations_saved = 0;
+  int n_unpredicted_failed = 0;
+
+  ros::WallTime start_run = ros::WallTime::now();
+
+  BOOST_FOREACH(const rosbag::MessageInstance& m, view)
+  {
+    if (max_frames > 0 && n_frames >= max_frames) break;
+
+    if (m.getTopic() == rgb_topic)
+    {
+      ImageMsg::ConstPtr msg = m.instantiate<ImageMsg>();
+      if (msg) rgb_queue.push_back(msg);
+    }
+    else if (m.getTopic() == depth_topic)
+    {
+      ImageMsg::ConstPtr msg = m.instantiate<ImageMsg>();
+      if (msg) depth_queue.push_back(msg);
+    }
+    else if (m.getTopic() == info_topic)
+    {
+      CameraInfoMsg::ConstPtr msg = m.instantiate<CameraInfoMsg>();
+      if (msg) info_queue.push_back(msg);
+    }
+
+    RGBDMessages messages;
+    while (popSynchronizedMessages(
+             rgb_queue, depth_queue, info_queue, sync_tolerance, messages))
+    {
+      ros::WallTime start = ros::WallTime::now();
+
+      // **** create frame
+
+      ros::WallTime start_frame = ros::WallTime::now();
+      rgbdtools::RGBDFrame frame;
+      frame_factory.createFrame(
+        messages.rgb_msg, messages.depth_msg, messages.info_msg, frame);
+      double d_frame = getMsDuration(start_frame);
+
+      // **** find features
+
+      ros::WallTime start_features = ros::WallTime::now();
+      rgbdtools::RGBDFrame coarse_frame;
+
+      if (coarse_to_fine)
+      {
+        pyramid.createCoarseFrame(frame, coarse_frame);
+        feature_detector->findFeatures(coarse_frame);
+        pyramid.refineFeatures(coarse_frame, frame);
+      }
+      else
+        feature_detector->findFeatures(frame);
+
+      double d_features = getMsDuration(start_features);
+
+      // **** registration
+
+      ros::WallTime start_reg = ros::WallTime::now();
+      AffineTransform motion;
+
+      if (index_type == "voxel_hash")
+      {
+        double stamp = messages.rgb_msg->header.stamp.toSec();
+
+        AffineTransform prediction;
+        motion_predictor.predict(stamp, prediction);
+
+        if (coarse_to_fine)
+        {
+          AffineTransform coarse_correction;
+          int n_iterations_coarse;
+          if (voxel_hash_motion_estimation.alignFrame(
+                coarse_frame, prediction, coarse_correction, n_iterations_coarse))
+            prediction = coarse_correction;
+        }
+
+        bool result = voxel_hash_motion_estimation.getMotionEstimation(
+          frame, prediction, motion);
+        f2b = tfFromEigenAffine(motion) * f2b;
+        motion_predictor.update(stamp, eigenAffineFromTf(f2b), result);
+
+        if (!result) n_failed++;
+        n_iterations += voxel_hash_motion_estimation.getNIterations();
+
+        int n_iterations_unpredicted = 
+          voxel_hash_motion_estimation.getNIterationsUnpredicted();
+        if (n_iterations_unpredicted >= 0)
+        {
+          n_compared++;
+          n_iterations_saved += n_iterations_unpredicted - 
+            voxel_hash_motion_estimation.getNIterations();
+          if (!voxel_hash_motion_estimation.getUnpredictedResult()) 
+            n_unpredicted_failed++;
+        }
+      }
+      else
+      {
+        motion = motion_estimation->getMotionEstimation(frame);
+        f2b = tfFromEigenAffine(motion) * f2b;
+      }
+
+      double d_reg = getMsDuration(start_reg);
+
+      double d_total = getMsDuration(start);
+
+      durations.frame.push_back(d_frame);
+      durations.features.push_back(d_features);
+      durations.reg.push_back(d_reg);
+      durations.total.push_back(d_total);
+
+      geometry_msgs::PoseStamped pose;
+      pose.header.stamp = messages.rgb_msg->header.stamp;
+      tf::poseTFToMsg(f2b, pose.pose);
+      path_msg.poses.push_back(pose);
+
+      n_frames++;
+    }
+  }
+
+  double d_run = getMsDuration(start_run);
+
+  bag.close();
+
+  // **** report
+
+  double d_processing = 0.0;
+  for (unsigned int i = 0; i < durations.total.size(); ++i)
+    d_processing += durations.total[i];
+
+  printf("Frames: %d\n\n", n_frames);
+  printf("%-14s %8s %8s %8s %8s %8s   [ms]\n",
+    "Stage", "mean", "p50", "p95", "p99", "max");
+  printStage("frame",        durations.frame);
+  printStage("features",     durations.features);
+  printStage("registration", durations.reg);
+  printStage("total",        durations.total);
+  printf("\n");
+
+  if (index_type == "voxel_hash" && n_frames > 0)
+  {
+    printf("ICP iterations: %.2f per frame, failed registrations: %d\n",
+      (double)n_iterations / n_frames, n_failed);
+
+    if (n_compared > 0)
+    {
+      printf("Without the prediction (%d frames): %.2f more iterations per frame, "
+        "%d failed registrations\n", n_compared, 
+        (double)n_iterations_saved / n_compared, n_unpredicted_failed);
+    }
+
+    printf("\n");
+  }
+
+  if (n_frames > 0)
+  {
+    printf("Throughput: %.1f fps (processing), %.1f fps (including bag reading)\n",
+      1000.0 * n_frames / d_processing, 1000.0 * n_frames / d_run);
+  }
+
+  if (writeTrajectory(trajectory_filename, path_msg))
+    printf("Trajectory saved to %s\n", trajectory_filename.c_str());
+  else
+  {
+    fprintf(stderr, "Could not write trajectory to %s\n", trajectory_filename.c_str());
+    return 1;
+  }
+
+  return 0;
+}
+
+} // namespace ccny_rgbd
+
+int main(int argc, char** argv)
+{
+  std::string bag_filename;
+  ccny_rgbd::OptionMap options;
+
+  if (argc < 2 || !ccny_rgbd::parseOptions(argc, argv, 2, options))
+  {
+    ccny_rgbd::printUsage();
+    return 1;
+  }
+
+  bag_filename = argv[1];
+
+  // no ROS master, but ros::Time still needs initializing
+  ros::Time::init();
+
+  try
+  {
+    return ccny_rgbd::runBenchmark(bag_filename, options);
+  }
+  catch (boost::bad_lexical_cast& ex)
+  {
+    fprintf(stderr, "Invalid option value: %s\n", ex.what());
+    return 1;
+  }
+}
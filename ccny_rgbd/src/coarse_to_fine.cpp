@@ -0,0 +1,130 @@
+/**
+ *  @file coarse_to_fine.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/coarse_to_fine.h"
+
+namespace ccny_rgbd {
+
+CoarseToFine::CoarseToFine():
+  scale_(0.5),
+  n_fine_features_(150),
+  refine_window_(3),
+  max_range_(5.5),
+  max_stdev_(0.03)
+{
+
+}
+
+void CoarseToFine::setScale(double scale)
+{
+  scale_ = std::min(std::max(scale, 0.1), 1.0);
+}
+
+void CoarseToFine::createCoarseFrame(
+  const rgbdtools::RGBDFrame& frame,
+  rgbdtools::RGBDFrame& coarse_frame) const
+{
+  cv::resize(frame.rgb_img, coarse_frame.rgb_img,
+    cv::Size(), scale_, scale_, cv::INTER_AREA);
+  cv::resize(frame.depth_img, coarse_frame.depth_img,
+    cv::Size(), scale_, scale_, cv::INTER_NEAREST);
+
+  // pixel centers: u_coarse + 0.5 = scale * (u + 0.5)
+  coarse_frame.intr = frame.intr.clone();
+  coarse_frame.intr.at<double>(0, 0) *= scale_;
+  coarse_frame.intr.at<double>(1, 1) *= scale_;
+  coarse_frame.intr.at<double>(0, 2) = (frame.intr.at<double>(0, 2) + 0.5) * scale_ - 0.5;
+  coarse_frame.intr.at<double>(1, 2) = (frame.intr.at<double>(1, 2) + 0.5) * scale_ - 0.5;
+
+  coarse_frame.header = frame.header;
+  coarse_frame.keypoints.clear();
+  coarse_frame.descriptors = cv::Mat();
+}
+
+void CoarseToFine::refineFeatures(
+  const rgbdtools::RGBDFrame& coarse_frame,
+  rgbdtools::RGBDFrame& frame) const
+{
+  // **** an evenly spread subset of the valid coarse keypoints
+
+  std::vector<int> valid_indices;
+  valid_indices.reserve(coarse_frame.keypoints.size());
+
+  for (unsigned int i = 0; i < coarse_frame.kp_valid.size(); ++i)
+    if (coarse_frame.kp_valid[i]) valid_indices.push_back(i);
+
+  int n_valid = valid_indices.size();
+  int n_fine = n_fine_features_ > 0 ?
+    std::min(n_fine_features_, n_valid) : n_valid;
+
+  float scale_inv = 1.0 / scale_;
+
+  frame.keypoints.resize(n_fine);
+  std::vector<cv::Point2f> points(n_fine);
+
+  for (int j = 0; j < n_fine; ++j)
+  {
+    const cv::KeyPoint& keypoint =
+      coarse_frame.keypoints[valid_indices[(j * n_valid) / n_fine]];
+
+    frame.keypoints[j] = keypoint;
+    frame.keypoints[j].size *= scale_inv;
+
+    points[j].x = (keypoint.pt.x + 0.5f) * scale_inv - 0.5f;
+    points[j].y = (keypoint.pt.y + 0.5f) * scale_inv - 0.5f;
+  }
+
+  // **** sub-pixel refinement on the full resolution image
+
+  if (refine_window_ > 0 && n_fine > 0)
+  {
+    cv::Mat gray_img;
+    if (frame.rgb_img.type() != CV_8UC1)
+      cv::cvtColor(frame.rgb_img, gray_img, CV_BGR2GRAY);
+    else
+      gray_img = frame.rgb_img;
+
+    cv::cornerSubPix(gray_img, points,
+      cv::Size(refine_window_, refine_window_), cv::Size(-1, -1),
+      cv::TermCriteria(CV_TERMCRIT_EPS | CV_TERMCRIT_ITER, 10, 0.03));
+  }
+
+  float max_x = frame.rgb_img.cols - 1;
+  float max_y = frame.rgb_img.rows - 1;
+
+  for (int j = 0; j < n_fine; ++j)
+  {
+    frame.keypoints[j].pt.x = std::min(std::max(points[j].x, 0.0f), max_x);
+    frame.keypoints[j].pt.y = std::min(std::max(points[j].y, 0.0f), max_y);
+  }
+
+  frame.descriptors = cv::Mat();
+
+  // **** 3D distributions from the full resolution depth
+
+  FeatureDistributions distributions;
+  computeFeatureDistributions(frame, max_range_, max_stdev_, distributions);
+  copyFeatureDistributions(distributions, frame);
+}
+
+} // namespace ccny_rgbd
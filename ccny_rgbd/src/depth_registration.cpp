@@ -0,0 +1,408 @@
+/**
+ *  @file depth_registration.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/depth_registration.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace ccny_rgbd {
+
+/** @brief Keeps the nearest depth in a registered pixel:
+ * *target = z if *target is 0 (no depth) or further than z
+ */
+static inline void minDepth(uint16_t* target, uint16_t z)
+{
+  uint16_t old_z = *target;
+  if (old_z == 0 || old_z > z) *target = z;
+}
+
+/** @brief Like minDepth, but safe against concurrent writers
+ */
+static inline void minDepthAtomic(uint16_t* target, uint16_t z)
+{
+  uint16_t old_z = *target;
+
+  while (old_z == 0 || old_z > z)
+  {
+    uint16_t prev_z = __sync_val_compare_and_swap(target, old_z, z);
+    if (prev_z == old_z) return;
+    old_z = prev_z;
+  }
+}
+
+DepthRegistration::DepthRegistration():
+  round_(false),
+  unwarp_(false),
+  t_x_(0.0f),
+  t_y_(0.0f),
+  t_z_(0.0f),
+  n_bands_(1)
+{
+
+}
+
+void DepthRegistration::setRectificationMap(const cv::Mat& map)
+{
+  map_ = map;
+}
+
+void DepthRegistration::setUnwarpCoefficients(
+  const cv::Mat& coeff_0,
+  const cv::Mat& coeff_1,
+  const cv::Mat& coeff_2,
+  int fit_mode)
+{
+  const int w = coeff_0.cols;
+  const int h = coeff_0.rows;
+
+  // the *_ZERO modes go through cv::Mat::convertTo in rgbdtools,
+  // which rounds and saturates; the others truncate
+  round_ = (fit_mode == rgbdtools::DEPTH_FIT_LINEAR_ZERO ||
+            fit_mode == rgbdtools::DEPTH_FIT_QUADRATIC_ZERO);
+
+  // the linear modes have no c2, the *_ZERO modes no c0
+  bool use_c0 = (fit_mode == rgbdtools::DEPTH_FIT_LINEAR ||
+                 fit_mode == rgbdtools::DEPTH_FIT_QUADRATIC);
+  bool use_c2 = (fit_mode == rgbdtools::DEPTH_FIT_QUADRATIC ||
+                 fit_mode == rgbdtools::DEPTH_FIT_QUADRATIC_ZERO);
+
+  coeff_.create(h, 3 * w, CV_32FC1);
+
+  for (int v = 0; v < h; ++v)
+  {
+    float* c0_row = coeff_.ptr<float>(v);
+    float* c1_row = c0_row + w;
+    float* c2_row = c1_row + w;
+
+    for (int u = 0; u < w; ++u)
+    {
+      c0_row[u] = use_c0 ? coeff_0.at<double>(v, u) : 0.0f;
+      c1_row[u] = coeff_1.at<double>(v, u);
+      c2_row[u] = use_c2 ? coeff_2.at<double>(v, u) : 0.0f;
+    }
+  }
+
+  unwarp_ = true;
+}
+
+void DepthRegistration::disableUnwarp()
+{
+  coeff_ = cv::Mat();
+  unwarp_ = false;
+}
+
+void DepthRegistration::setTransform(
+  const cv::Mat& intr_rect_depth,
+  const cv::Mat& intr_rect_rgb,
+  const cv::Mat& ir2rgb)
+{
+  // same composition as rgbdtools::buildRegisteredDepthImage:
+  // H = K_rgb * [R|t] * [K_ir^-1 0; 0 1]
+  cv::Mat intr_rect_depth_inv = cv::Mat::eye(4, 4, CV_64FC1);
+  cv::Mat(intr_rect_depth.inv()).copyTo(
+    intr_rect_depth_inv(cv::Rect(0, 0, 3, 3)));
+
+  cv::Mat H = intr_rect_rgb * ir2rgb(cv::Rect(0, 0, 4, 3)) * intr_rect_depth_inv;
+
+  // **** ray tables
+
+  const int w = map_.cols;
+  const int h = map_.rows;
+
+  ray_x_.create(h, w, CV_32FC1);
+  ray_y_.create(h, w, CV_32FC1);
+  ray_z_.create(h, w, CV_32FC1);
+
+  for (int v = 0; v < h; ++v)
+  {
+    float* ray_x_row = ray_x_.ptr<float>(v);
+    float* ray_y_row = ray_y_.ptr<float>(v);
+    float* ray_z_row = ray_z_.ptr<float>(v);
+
+    for (int u = 0; u < w; ++u)
+    {
+      ray_x_row[u] = H.at<double>(0, 0) * u + H.at<double>(0, 1) * v + H.at<double>(0, 2);
+      ray_y_row[u] = H.at<double>(1, 0) * u + H.at<double>(1, 1) * v + H.at<double>(1, 2);
+      ray_z_row[u] = H.at<double>(2, 0) * u + H.at<double>(2, 1) * v + H.at<double>(2, 2);
+    }
+  }
+
+  t_x_ = H.at<double>(0, 3);
+  t_y_ = H.at<double>(1, 3);
+  t_z_ = H.at<double>(2, 3);
+}
+
+void DepthRegistration::getTables(MapCache::MatMap& tables) const
+{
+  cv::Mat params(1, 5, CV_32FC1);
+  params.at<float>(0, 0) = round_  ? 1.0f : 0.0f;
+  params.at<float>(0, 1) = unwarp_ ? 1.0f : 0.0f;
+  params.at<float>(0, 2) = t_x_;
+  params.at<float>(0, 3) = t_y_;
+  params.at<float>(0, 4) = t_z_;
+
+  tables["reg_params"] = params;
+  tables["reg_coeff"]  = coeff_;
+  tables["reg_ray_x"]  = ray_x_;
+  tables["reg_ray_y"]  = ray_y_;
+  tables["reg_ray_z"]  = ray_z_;
+}
+
+bool DepthRegistration::setTables(const MapCache::MatMap& tables)
+{
+  MapCache::MatMap::const_iterator params_it = tables.find("reg_params");
+  MapCache::MatMap::const_iterator coeff_it  = tables.find("reg_coeff");
+  MapCache::MatMap::const_iterator ray_x_it  = tables.find("reg_ray_x");
+  MapCache::MatMap::const_iterator ray_y_it  = tables.find("reg_ray_y");
+  MapCache::MatMap::const_iterator ray_z_it  = tables.find("reg_ray_z");
+
+  if (params_it == tables.end() || coeff_it == tables.end() ||
+      ray_x_it  == tables.end() || ray_y_it == tables.end() ||
+      ray_z_it  == tables.end())
+    return false;
+
+  const cv::Mat& params = params_it->second;
+  if (params.type() != CV_32FC1 || params.total() != 5) return false;
+
+  bool unwarp = params.at<float>(0, 1) != 0.0f;
+
+  // every table has the size of the map; the coefficients 3x its width
+  const cv::Size size = map_.size();
+  if (ray_x_it->second.size() != size || ray_x_it->second.type() != CV_32FC1 ||
+      ray_y_it->second.size() != size || ray_y_it->second.type() != CV_32FC1 ||
+      ray_z_it->second.size() != size || ray_z_it->second.type() != CV_32FC1)
+    return false;
+
+  if (unwarp && (coeff_it->second.type() != CV_32FC1 ||
+      coeff_it->second.size() != cv::Size(3 * size.width, size.height)))
+    return false;
+
+  round_  = params.at<float>(0, 0) != 0.0f;
+  unwarp_ = unwarp;
+  t_x_    = params.at<float>(0, 2);
+  t_y_    = params.at<float>(0, 3);
+  t_z_    = params.at<float>(0, 4);
+
+  coeff_ = unwarp_ ? coeff_it->second : cv::Mat();
+  ray_x_ = ray_x_it->second;
+  ray_y_ = ray_y_it->second;
+  ray_z_ = ray_z_it->second;
+
+  return true;
+}
+
+void DepthRegistration::setPool(ThreadPoolPtr pool, int n_bands)
+{
+  pool_ = pool;
+  n_bands_ = pool ? std::max(1, n_bands) : 1;
+}
+
+void DepthRegistration::process(
+  const cv::Mat& depth_img,
+  cv::Mat& depth_img_reg) const
+{
+  // in place if the output is already allocated (for example, wrapping
+  // the buffer of an outgoing message)
+  depth_img_reg.create(map_.rows, map_.cols, CV_16UC1);
+  depth_img_reg.setTo(0);
+
+  if (n_bands_ > 1)
+  {
+    pool_->parallelFor(n_bands_, boost::bind(
+      &DepthRegistration::processBand<true>, this, _1,
+      boost::cref(depth_img), boost::ref(depth_img_reg)));
+  }
+  else
+    processBand<false>(0, depth_img, depth_img_reg);
+}
+
+void DepthRegistration::unwarp(
+  const cv::Mat& depth_img_rect,
+  cv::Mat& depth_img_unwarped) const
+{
+  const int w = depth_img_rect.cols;
+  const int h = depth_img_rect.rows;
+
+  depth_img_unwarped.create(h, w, CV_16UC1);
+
+  std::vector<float> z_buf(w);
+  float* z_row = &z_buf[0];
+
+  for (int v = 0; v < h; ++v)
+  {
+    const uint16_t* src_row = depth_img_rect.ptr<uint16_t>(v);
+    uint16_t* dst_row = depth_img_unwarped.ptr<uint16_t>(v);
+
+    for (int u = 0; u < w; ++u) z_row[u] = src_row[u];
+    if (unwarp_) unwarpRow(v, z_row);
+    for (int u = 0; u < w; ++u) dst_row[u] = (uint16_t)z_row[u];
+  }
+}
+
+void DepthRegistration::unwarpRow(int v, float* z_row) const
+{
+  const int w = coeff_.cols / 3;
+
+  const float* c0_row = coeff_.ptr<float>(v);
+  const float* c1_row = c0_row + w;
+  const float* c2_row = c1_row + w;
+
+  int u = 0;
+
+#ifdef __SSE2__
+  const __m128 zero4 = _mm_setzero_ps();
+  const __m128 max4  = _mm_set1_ps(65535.0f);
+  const __m128i mask16 = _mm_set1_epi32(0xFFFF);
+
+  for (; u + 4 <= w; u += 4)
+  {
+    __m128 z  = _mm_loadu_ps(z_row + u);
+    __m128 c0 = _mm_loadu_ps(c0_row + u);
+    __m128 c1 = _mm_loadu_ps(c1_row + u);
+    __m128 c2 = _mm_loadu_ps(c2_row + u);
+
+    // c0 + z * (c1 + z * c2)
+    __m128 r = _mm_add_ps(c0, _mm_mul_ps(z, _mm_add_ps(c1, _mm_mul_ps(z, c2))));
+
+    __m128i r_int;
+    if (round_)
+    {
+      // saturate, then round to nearest (even)
+      r = _mm_min_ps(_mm_max_ps(r, zero4), max4);
+      r_int = _mm_cvtps_epi32(r);
+    }
+    else
+    {
+      // (uint16_t)(int)r
+      r_int = _mm_and_si128(_mm_cvttps_epi32(r), mask16);
+    }
+
+    // no depth stays no depth
+    __m128 valid = _mm_cmpgt_ps(z, zero4);
+    _mm_storeu_ps(z_row + u, _mm_and_ps(_mm_cvtepi32_ps(r_int), valid));
+  }
+#endif
+
+  for (; u < w; ++u)
+  {
+    float z = z_row[u];
+    if (z == 0.0f) continue;
+
+    float r = c0_row[u] + z * (c1_row[u] + z * c2_row[u]);
+
+    if (round_)
+      z_row[u] = cv::saturate_cast<uint16_t>(r);
+    else
+      z_row[u] = (uint16_t)(int)r;
+  }
+}
+
+template <bool ATOMIC>
+void DepthRegistration::processBand(
+  int band,
+  const cv::Mat& depth_img,
+  cv::Mat& depth_img_reg) const
+{
+  const int w = map_.cols;
+  const int h = map_.rows;
+
+  const int v_start = (band       * h) / n_bands_;
+  const int v_end   = ((band + 1) * h) / n_bands_;
+
+  const unsigned int src_w = depth_img.cols;
+  const unsigned int src_h = depth_img.rows;
+
+  // per-row buffers, reused for all the rows of the band
+  std::vector<float> z_buf(w);
+  std::vector<int> qu_buf(w), qv_buf(w), z_reg_buf(w);
+
+  float* z_row = &z_buf[0];
+  int* qu_row = &qu_buf[0];
+  int* qv_row = &qv_buf[0];
+  int* z_reg_row = &z_reg_buf[0];
+
+  for (int v = v_start; v < v_end; ++v)
+  {
+    // **** gather: rectify (nearest neighbor, 0 outside the raw image),
+    // then unwarp
+
+    const short* map_row = map_.ptr<short>(v);
+
+    for (int u = 0; u < w; ++u)
+    {
+      int src_u = map_row[2 * u];
+      int src_v = map_row[2 * u + 1];
+
+      if ((unsigned int)src_u < src_w && (unsigned int)src_v < src_h)
+        z_row[u] = depth_img.ptr<uint16_t>(src_v)[src_u];
+      else
+        z_row[u] = 0.0f;
+    }
+
+    if (unwarp_) unwarpRow(v, z_row);
+
+    // **** transform: table-driven, without branches
+
+    const float* ray_x_row = ray_x_.ptr<float>(v);
+    const float* ray_y_row = ray_y_.ptr<float>(v);
+    const float* ray_z_row = ray_z_.ptr<float>(v);
+
+    for (int u = 0; u < w; ++u)
+    {
+      float z = z_row[u];
+
+      float px = z * ray_x_row[u] + t_x_;
+      float py = z * ray_y_row[u] + t_y_;
+      float pz = z * ray_z_row[u] + t_z_;
+
+      // no depth, or behind (or at) the RGB camera: z_reg = 0
+      bool valid = z > 0.0f && pz >= 1.0f;
+      float pz_inv = valid ? 1.0f / pz : 0.0f;
+
+      qu_row[u] = (int)(px * pz_inv);
+      qv_row[u] = (int)(py * pz_inv);
+      z_reg_row[u] = valid ? (int)pz : 0;
+    }
+
+    // **** scatter, keeping the nearest depth
+
+    for (int u = 0; u < w; ++u)
+    {
+      int z_reg = z_reg_row[u];
+      int qu = qu_row[u];
+      int qv = qv_row[u];
+
+      if (z_reg == 0 || z_reg > 65535) continue;
+      if (qu < 0 || qu >= w || qv < 0 || qv >= h) continue;
+
+      uint16_t* target = depth_img_reg.ptr<uint16_t>(qv) + qu;
+
+      if (ATOMIC) minDepthAtomic(target, (uint16_t)z_reg);
+      else        minDepth(target, (uint16_t)z_reg);
+    }
+  }
+}
+
+} // namespace ccny_rgbd
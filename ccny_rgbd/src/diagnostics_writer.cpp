@@ -0,0 +1,202 @@
+/**
+ *  @file diagnostics_writer.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/diagnostics_writer.h"
+
+namespace ccny_rgbd {
+
+DiagnosticsWriter::DiagnosticsWriter(
+  const std::string& label,
+  const std::string& detector_type,
+  bool verbose,
+  int capacity,
+  int window_size):
+  label_(label),
+  detector_type_(detector_type),
+  verbose_(verbose),
+  window_size_(std::max(1, window_size)),
+  buffer_(std::max(1, capacity)),
+  n_dropped_(0),
+  file_(NULL),
+  stop_(false)
+{
+  thread_ = boost::thread(&DiagnosticsWriter::writerLoop, this);
+}
+
+DiagnosticsWriter::~DiagnosticsWriter()
+{
+  stop_ = true;
+  thread_.join();
+
+  if (file_ != NULL) fclose(file_);
+}
+
+bool DiagnosticsWriter::openFile(const std::string& filename)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+
+  if (file_ != NULL) fclose(file_);
+
+  file_ = fopen(filename.c_str(), "wb");
+
+  if (file_ == NULL)
+  {
+    ROS_ERROR("Can't create diagnostic file %s", filename.c_str());
+    return false;
+  }
+
+  // file header
+  const char magic[8] = {'C', 'C', 'N', 'Y', 'V', 'O', 'D', '\0'};
+  uint32_t version = kFormatVersion;
+  uint32_t record_size = sizeof(DiagnosticsRecord);
+
+  fwrite(magic,        sizeof(magic),       1, file_);
+  fwrite(&version,     sizeof(version),     1, file_);
+  fwrite(&record_size, sizeof(record_size), 1, file_);
+
+  return true;
+}
+
+bool DiagnosticsWriter::record(const DiagnosticsRecord& record)
+{
+  if (buffer_.push(record)) return true;
+
+  n_dropped_ = n_dropped_ + 1;
+  return false;
+}
+
+void DiagnosticsWriter::writerLoop()
+{
+  while (!stop_)
+  {
+    drain();
+    boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+  }
+
+  // the producer is done by now - write out what is left
+  drain();
+}
+
+void DiagnosticsWriter::drain()
+{
+  DiagnosticsRecord record;
+
+  boost::mutex::scoped_lock lock(mutex_);
+
+  while (buffer_.pop(record))
+  {
+    if (file_ != NULL)
+      fwrite(&record, sizeof(DiagnosticsRecord), 1, file_);
+
+    if (verbose_ && record.n_iterations >= 0)
+    {
+      ROS_INFO("[%s %d] %s[%d]: %.1f Reg[%d]: %.1f IT[%d/-%d]%s TOT: %.1f",
+        label_.c_str(), record.frame,
+        detector_type_.c_str(), record.n_valid_features, record.d_features,
+        record.n_model_pts, record.d_reg, 
+        record.n_iterations, record.n_iterations_saved,
+        record.reg_failed ? " FAILED" : "",
+        record.d_total);
+    }
+    else if (verbose_)
+    {
+      ROS_INFO("[%s %d] %s[%d]: %.1f Reg[%d]: %.1f TOT: %.1f",
+        label_.c_str(), record.frame,
+        detector_type_.c_str(), record.n_valid_features, record.d_features,
+        record.n_model_pts, record.d_reg,
+        record.d_total);
+    }
+
+    window_.push_back(record);
+    if ((int)window_.size() > window_size_) window_.pop_front();
+  }
+}
+
+void DiagnosticsWriter::getSummary(DiagnosticsSummary& summary)
+{
+  std::vector<double> d_frame, d_features, d_reg, d_total;
+
+  int n_failed = 0;
+  int n_iterations_records = 0;
+  double iterations_sum = 0.0;
+  double iterations_saved_sum = 0.0;
+
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    d_frame.reserve(window_.size());
+    d_features.reserve(window_.size());
+    d_reg.reserve(window_.size());
+    d_total.reserve(window_.size());
+
+    for (unsigned int i = 0; i < window_.size(); ++i)
+    {
+      d_frame.push_back(window_[i].d_frame);
+      d_features.push_back(window_[i].d_features);
+      d_reg.push_back(window_[i].d_reg);
+      d_total.push_back(window_[i].d_total);
+
+      n_failed += window_[i].reg_failed;
+
+      if (window_[i].n_iterations >= 0)
+      {
+        n_iterations_records++;
+        iterations_sum       += window_[i].n_iterations;
+        iterations_saved_sum += window_[i].n_iterations_saved;
+      }
+    }
+  }
+
+  summary.n_records = d_total.size();
+  summary.n_dropped = n_dropped_;
+  summary.n_failed  = n_failed;
+
+  if (n_iterations_records > 0)
+  {
+    summary.mean_iterations       = iterations_sum       / n_iterations_records;
+    summary.mean_iterations_saved = iterations_saved_sum / n_iterations_records;
+  }
+  else
+  {
+    summary.mean_iterations = -1.0;
+    summary.mean_iterations_saved = 0.0;
+  }
+
+  computeStats(d_frame,    summary.frame);
+  computeStats(d_features, summary.features);
+  computeStats(d_reg,      summary.reg);
+  computeStats(d_total,    summary.total);
+}
+
+void DiagnosticsWriter::computeStats(
+  std::vector<double>& values, DurationStats& stats)
+{
+  std::sort(values.begin(), values.end());
+
+  stats.p50 = getPercentile(values, 50.0);
+  stats.p95 = getPercentile(values, 95.0);
+  stats.p99 = getPercentile(values, 99.0);
+  stats.max = values.empty() ? 0.0 : values.back();
+}
+
+} // namespace ccny_rgbd
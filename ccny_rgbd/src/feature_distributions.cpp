@@ -0,0 +1,291 @@
+/**
+ *  @file feature_distributions.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/feature_distributions.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace ccny_rgbd {
+
+// z standard deviation model: Z_STDEV_CONSTANT * z^2
+static const double Z_STDEV_CONSTANT = 0.001425;
+
+// variance of the keypoint image coordinates (pixels^2)
+static const float PIXEL_VAR = 1.0f;
+
+void FeatureDistributions::resize(int n)
+{
+  this->n = n;
+  int n_padded = (n + 3) & ~3;
+
+  u.resize(n_padded);
+  v.resize(n_padded);
+  z.resize(n_padded);
+  var_z.resize(n_padded);
+  x.resize(n_padded);
+  y.resize(n_padded);
+  s_xx.resize(n_padded);
+  s_xy.resize(n_padded);
+  s_xz.resize(n_padded);
+  s_yy.resize(n_padded);
+  s_yz.resize(n_padded);
+  s_zz.resize(n_padded);
+  valid.resize(n_padded);
+}
+
+/** @brief z mean and variance over the 3x3 depth window around (u, v)
+ */
+static inline void getGaussianMixtureDistribution(
+  const cv::Mat& depth_img, int u, int v, double& z_mean, double& z_var)
+{
+  int u_start = std::max(u - 1, 0);
+  int v_start = std::max(v - 1, 0);
+  int u_end   = std::min(u + 1, depth_img.cols - 1);
+  int v_end   = std::min(v + 1, depth_img.rows - 1);
+
+  double weight_sum = 0.0;
+  double mean_sum   = 0.0;
+  double alpha_sum  = 0.0;
+
+  for (int vv = v_start; vv <= v_end; ++vv)
+  {
+    const uint16_t* row = depth_img.ptr<uint16_t>(vv);
+
+    for (int uu = u_start; uu <= u_end; ++uu)
+    {
+      uint16_t z_neighbor_raw = row[uu];
+      if (z_neighbor_raw == 0) continue;
+
+      double z_neighbor = z_neighbor_raw * 0.001;
+
+      double weight;
+      if      (u == uu && v == vv) weight = 4.0;
+      else if (u == uu || v == vv) weight = 2.0;
+      else                         weight = 1.0;
+
+      double std_dev_z_neighbor = Z_STDEV_CONSTANT * z_neighbor * z_neighbor;
+      double var_z_neighbor = std_dev_z_neighbor * std_dev_z_neighbor;
+
+      weight_sum += weight;
+      mean_sum   += weight * z_neighbor;
+      alpha_sum  += weight * (var_z_neighbor + z_neighbor * z_neighbor);
+    }
+  }
+
+  z_mean = mean_sum  / weight_sum;
+  z_var  = alpha_sum / weight_sum - z_mean * z_mean;
+}
+
+void computeFeatureDistributions(
+  const rgbdtools::RGBDFrame& frame,
+  double max_z,
+  double max_stdev_z,
+  FeatureDistributions& d)
+{
+  const cv::Mat& depth_img = frame.depth_img;
+  int n = frame.keypoints.size();
+
+  d.resize(n);
+
+  double max_var_z = max_stdev_z * max_stdev_z;
+
+  // **** gather: z distribution from the depth window (scalar)
+
+  for (int i = 0; i < n; ++i)
+  {
+    const cv::Point2f& pt = frame.keypoints[i].pt;
+    int u = (int)pt.x;
+    int v = (int)pt.y;
+
+    d.u[i] = pt.x;
+    d.v[i] = pt.y;
+
+    if (depth_img.at<uint16_t>(v, u) == 0)
+    {
+      d.valid[i] = 0;
+      d.z[i] = 0.0f;
+      d.var_z[i] = 0.0f;
+      continue;
+    }
+
+    double z, var_z;
+    getGaussianMixtureDistribution(depth_img, u, v, z, var_z);
+
+    d.valid[i] = (z <= max_z && var_z <= max_var_z) ? 1 : 0;
+    d.z[i] = z;
+    d.var_z[i] = var_z;
+  }
+
+  // zero the padding, so the vector lanes are well defined
+  for (unsigned int i = n; i < d.u.size(); ++i)
+  {
+    d.u[i] = d.v[i] = d.z[i] = d.var_z[i] = 0.0f;
+    d.valid[i] = 0;
+  }
+
+  // **** projection and covariance propagation (4 keypoints at a time)
+
+  const float cx = frame.intr.at<double>(0, 2);
+  const float cy = frame.intr.at<double>(1, 2);
+  const float fx_inv = 1.0 / frame.intr.at<double>(0, 0);
+  const float fy_inv = 1.0 / frame.intr.at<double>(1, 1);
+
+  int n_padded = d.u.size();
+  int i = 0;
+
+#ifdef __SSE2__
+  const __m128 cx4     = _mm_set1_ps(cx);
+  const __m128 cy4     = _mm_set1_ps(cy);
+  const __m128 fx_inv4 = _mm_set1_ps(fx_inv);
+  const __m128 fy_inv4 = _mm_set1_ps(fy_inv);
+  const __m128 fxy_inv4 = _mm_set1_ps(fx_inv * fy_inv);
+  const __m128 fxx_inv4 = _mm_set1_ps(fx_inv * fx_inv);
+  const __m128 fyy_inv4 = _mm_set1_ps(fy_inv * fy_inv);
+  const __m128 pixel_var4 = _mm_set1_ps(PIXEL_VAR);
+
+  for (; i < n_padded; i += 4)
+  {
+    __m128 z     = _mm_loadu_ps(&d.z[i]);
+    __m128 var_z = _mm_loadu_ps(&d.var_z[i]);
+    __m128 umcx  = _mm_sub_ps(_mm_loadu_ps(&d.u[i]), cx4);
+    __m128 vmcy  = _mm_sub_ps(_mm_loadu_ps(&d.v[i]), cy4);
+
+    // mean
+    _mm_storeu_ps(&d.x[i], _mm_mul_ps(_mm_mul_ps(z, umcx), fx_inv4));
+    _mm_storeu_ps(&d.y[i], _mm_mul_ps(_mm_mul_ps(z, vmcy), fy_inv4));
+
+    // covariance
+    __m128 pixel_term = _mm_mul_ps(pixel_var4,
+      _mm_add_ps(_mm_mul_ps(z, z), var_z));
+
+    __m128 s_xx = _mm_mul_ps(fxx_inv4, _mm_add_ps(
+      _mm_mul_ps(var_z, _mm_mul_ps(umcx, umcx)), pixel_term));
+    __m128 s_yy = _mm_mul_ps(fyy_inv4, _mm_add_ps(
+      _mm_mul_ps(var_z, _mm_mul_ps(vmcy, vmcy)), pixel_term));
+    __m128 s_xy = _mm_mul_ps(fxy_inv4,
+      _mm_mul_ps(var_z, _mm_mul_ps(umcx, vmcy)));
+    __m128 s_xz = _mm_mul_ps(fx_inv4, _mm_mul_ps(var_z, umcx));
+    __m128 s_yz = _mm_mul_ps(fy_inv4, _mm_mul_ps(var_z, vmcy));
+
+    _mm_storeu_ps(&d.s_xx[i], s_xx);
+    _mm_storeu_ps(&d.s_xy[i], s_xy);
+    _mm_storeu_ps(&d.s_xz[i], s_xz);
+    _mm_storeu_ps(&d.s_yy[i], s_yy);
+    _mm_storeu_ps(&d.s_yz[i], s_yz);
+    _mm_storeu_ps(&d.s_zz[i], var_z);
+  }
+#endif
+
+  for (; i < n_padded; ++i)
+  {
+    float z = d.z[i];
+    float var_z = d.var_z[i];
+    float umcx = d.u[i] - cx;
+    float vmcy = d.v[i] - cy;
+
+    d.x[i] = z * umcx * fx_inv;
+    d.y[i] = z * vmcy * fy_inv;
+
+    float pixel_term = PIXEL_VAR * (z * z + var_z);
+
+    d.s_xx[i] = fx_inv * fx_inv * (var_z * (umcx * umcx) + pixel_term);
+    d.s_yy[i] = fy_inv * fy_inv * (var_z * (vmcy * vmcy) + pixel_term);
+    d.s_xy[i] = fx_inv * fy_inv * (var_z * (umcx * vmcy));
+    d.s_xz[i] = fx_inv * (var_z * umcx);
+    d.s_yz[i] = fy_inv * (var_z * vmcy);
+    d.s_zz[i] = var_z;
+  }
+}
+
+void copyFeatureDistributions(
+  const FeatureDistributions& d,
+  rgbdtools::RGBDFrame& frame)
+{
+  frame.kp_valid.resize(d.n);
+  frame.kp_means.resize(d.n);
+  frame.kp_covariances.resize(d.n);
+  frame.n_valid_keypoints = 0;
+
+  for (int i = 0; i < d.n; ++i)
+  {
+    frame.kp_valid[i] = d.valid[i];
+    if (!d.valid[i]) continue;
+
+    frame.n_valid_keypoints++;
+
+    Vector3f& mean = frame.kp_means[i];
+    mean(0) = d.x[i];
+    mean(1) = d.y[i];
+    mean(2) = d.z[i];
+
+    Matrix3f& cov = frame.kp_covariances[i];
+    cov(0,0) = d.s_xx[i];
+    cov(0,1) = d.s_xy[i];
+    cov(0,2) = d.s_xz[i];
+    cov(1,0) = d.s_xy[i];
+    cov(1,1) = d.s_yy[i];
+    cov(1,2) = d.s_yz[i];
+    cov(2,0) = d.s_xz[i];
+    cov(2,1) = d.s_yz[i];
+    cov(2,2) = d.s_zz[i];
+  }
+}
+
+int compareFeatureDistributions(
+  const rgbdtools::RGBDFrame& frame,
+  double max_z,
+  double max_stdev_z,
+  double& max_mean_error,
+  double& max_cov_error)
+{
+  rgbdtools::RGBDFrame reference = frame;
+  reference.computeDistributions(max_z, max_stdev_z);
+
+  int n_mismatched = 0;
+  max_mean_error = 0.0;
+  max_cov_error = 0.0;
+
+  for (unsigned int i = 0; i < frame.keypoints.size(); ++i)
+  {
+    if (frame.kp_valid[i] != reference.kp_valid[i])
+    {
+      n_mismatched++;
+      continue;
+    }
+    if (!frame.kp_valid[i]) continue;
+
+    double mean_error =
+      (frame.kp_means[i] - reference.kp_means[i]).cwiseAbs().maxCoeff();
+    double cov_error =
+      (frame.kp_covariances[i] - reference.kp_covariances[i]).cwiseAbs().maxCoeff();
+
+    max_mean_error = std::max(max_mean_error, mean_error);
+    max_cov_error  = std::max(max_cov_error,  cov_error);
+  }
+
+  return n_mismatched;
+}
+
+} // namespace ccny_rgbd
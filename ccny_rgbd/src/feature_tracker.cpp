@@ -0,0 +1,120 @@
+/**
+ *  @file feature_tracker.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/feature_tracker.h"
+
+namespace ccny_rgbd {
+
+FeatureTracker::FeatureTracker():
+  min_features_(150),
+  detection_period_(10),
+  window_size_(21),
+  max_level_(3),
+  max_range_(5.5),
+  max_stdev_(0.03),
+  n_tracked_frames_(0)
+{
+
+}
+
+void FeatureTracker::reset()
+{
+  prev_pyramid_.clear();
+  prev_keypoints_.clear();
+  n_tracked_frames_ = 0;
+}
+
+bool FeatureTracker::needsDetection() const
+{
+  return prev_pyramid_.empty() ||
+         (int)prev_keypoints_.size() < min_features_ ||
+         n_tracked_frames_ >= detection_period_;
+}
+
+void FeatureTracker::setFrame(const rgbdtools::RGBDFrame& frame)
+{
+  buildPyramid(frame.rgb_img, prev_pyramid_);
+  prev_keypoints_ = frame.keypoints;
+  n_tracked_frames_ = 0;
+}
+
+void FeatureTracker::track(rgbdtools::RGBDFrame& frame)
+{
+  buildPyramid(frame.rgb_img, pyramid_);
+
+  prev_points_.resize(prev_keypoints_.size());
+  for (unsigned int i = 0; i < prev_keypoints_.size(); ++i)
+    prev_points_[i] = prev_keypoints_[i].pt;
+
+  cv::calcOpticalFlowPyrLK(
+    prev_pyramid_, pyramid_, prev_points_, points_, status_, error_,
+    cv::Size(window_size_, window_size_), max_level_);
+
+  // **** keep the keypoints which were found inside the image
+
+  float max_x = frame.rgb_img.cols;
+  float max_y = frame.rgb_img.rows;
+
+  frame.keypoints.clear();
+  frame.descriptors = cv::Mat();
+
+  for (unsigned int i = 0; i < points_.size(); ++i)
+  {
+    const cv::Point2f& pt = points_[i];
+    if (!status_[i] || pt.x < 0.0f || pt.y < 0.0f || pt.x >= max_x || pt.y >= max_y)
+      continue;
+
+    cv::KeyPoint keypoint = prev_keypoints_[i];
+    keypoint.pt = pt;
+    frame.keypoints.push_back(keypoint);
+  }
+
+  // **** 3D distributions
+
+  computeFeatureDistributions(frame, max_range_, max_stdev_, distributions_);
+  copyFeatureDistributions(distributions_, frame);
+
+  // the current frame becomes the previous one; 
+  // its old pyramid buffers are reused next time
+  prev_pyramid_.swap(pyramid_);
+  prev_keypoints_ = frame.keypoints;
+  n_tracked_frames_++;
+}
+
+void FeatureTracker::buildPyramid(
+  const cv::Mat& rgb_img, 
+  std::vector<cv::Mat>& pyramid)
+{
+  const cv::Mat * gray_img = &rgb_img;
+
+  if (rgb_img.type() != CV_8UC1)
+  {
+    cv::cvtColor(rgb_img, gray_img_, CV_BGR2GRAY);
+    gray_img = &gray_img_;
+  }
+
+  cv::buildOpticalFlowPyramid(
+    *gray_img, pyramid, cv::Size(window_size_, window_size_), max_level_);
+}
+
+} // namespace ccny_rgbd
@@ -0,0 +1,95 @@
+/**
+ *  @file image_msg_pool.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/image_msg_pool.h"
+
+namespace ccny_rgbd {
+
+ImageMsgPool::ImageMsgPool(int max_size):
+  max_size_(max_size),
+  n_allocated_(0)
+{
+
+}
+
+void ImageMsgPool::setMaxSize(int max_size)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  max_size_ = max_size;
+  if ((int)msgs_.size() > max_size_) msgs_.resize(max_size_);
+}
+
+ImageMsg::Ptr ImageMsgPool::acquire(
+  const std_msgs::Header& header,
+  const std::string& encoding,
+  int height, int width, int type)
+{
+  ImageMsg::Ptr msg;
+
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    // a pooled message nobody else references. The count can only
+    // drop while we hold the pool's reference, so this is safe.
+    for (unsigned int i = 0; i < msgs_.size(); ++i)
+    {
+      if (msgs_[i].unique())
+      {
+        msg = msgs_[i];
+        break;
+      }
+    }
+
+    if (!msg)
+    {
+      msg.reset(new ImageMsg());
+      n_allocated_++;
+      if ((int)msgs_.size() < max_size_) msgs_.push_back(msg);
+    }
+  }
+
+  msg->header       = header;
+  msg->encoding     = encoding;
+  msg->height       = height;
+  msg->width        = width;
+  msg->step         = width * CV_ELEM_SIZE(type);
+  msg->is_bigendian = 0;
+
+  // keeps the capacity when the size does not grow
+  msg->data.resize(msg->height * msg->step);
+
+  return msg;
+}
+
+cv::Mat ImageMsgPool::wrap(const ImageMsg::Ptr& msg, int type)
+{
+  return cv::Mat(msg->height, msg->width, type, &msg->data[0], msg->step);
+}
+
+int ImageMsgPool::getNAllocated()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return n_allocated_;
+}
+
+} // namespace ccny_rgbd
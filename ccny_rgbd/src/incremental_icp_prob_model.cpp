@@ -0,0 +1,609 @@
+/**
+ *  @file incremental_icp_prob_model.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/incremental_icp_prob_model.h"
+
+namespace ccny_rgbd {
+
+/** @brief Transforms the means and covariances of a set of distributions
+ */
+static void transformDistributions(
+  Vector3fVector& means,
+  Matrix3fVector& covariances,
+  const AffineTransform& transform)
+{
+  Matrix3f R = transform.rotation();
+
+  for (unsigned int i = 0; i < means.size(); ++i)
+  {
+    means[i] = transform * means[i];
+    covariances[i] = R * covariances[i] * R.transpose();
+  }
+}
+
+static inline PointFeature pointFromMean(const Vector3f& mean)
+{
+  PointFeature point;
+  point.x = mean(0);
+  point.y = mean(1);
+  point.z = mean(2);
+  return point;
+}
+
+IncrementalICPProbModel::IncrementalICPProbModel():
+  rgbdtools::MotionEstimation(),
+  tf_epsilon_linear_(1e-4),
+  tf_epsilon_angular_(1.7e-3),
+  max_iterations_(10),
+  min_correspondences_(15),
+  n_nearest_neighbors_(4),
+  max_model_size_(3000),
+  max_corresp_dist_eucl_(0.15),
+  max_assoc_dist_mah_sq_(100.0),
+  max_search_dist_(0.5),
+  compare_prediction_(false),
+  max_keyframes_(0),
+  max_keyframe_dist_(0.0),
+  kf_dist_eps_(0.25),
+  kf_angle_eps_(0.35),
+  index_(0.15),
+  model_size_(0),
+  model_idx_(0),
+  windowed_(false),
+  n_iterations_(0),
+  n_iterations_unpredicted_(-1),
+  unpredicted_result_(false)
+{
+  f2b_.setIdentity();
+}
+
+IncrementalICPProbModel::~IncrementalICPProbModel()
+{
+
+}
+
+bool IncrementalICPProbModel::getMotionEstimationImpl(
+  rgbdtools::RGBDFrame& frame,
+  const AffineTransform& prediction,
+  AffineTransform& motion)
+{
+  // **** the valid distributions, in the fixed frame
+
+  Vector3fVector data_means;
+  Matrix3fVector data_covariances;
+
+  data_means.reserve(frame.n_valid_keypoints);
+  data_covariances.reserve(frame.n_valid_keypoints);
+
+  for (unsigned int i = 0; i < frame.kp_valid.size(); ++i)
+  {
+    if (!frame.kp_valid[i]) continue;
+    data_means.push_back(frame.kp_means[i]);
+    data_covariances.push_back(frame.kp_covariances[i]);
+  }
+
+  transformDistributions(data_means, data_covariances, f2b_ * b2c_);
+
+  // **** registration
+
+  n_iterations_ = 0;
+  n_iterations_unpredicted_ = -1;
+
+  if (model_size_ == 0)
+  {
+    motion.setIdentity();
+    if (windowed_) updateKeyframes();
+    updateModelFromData(data_means, data_covariances);
+    return true;
+  }
+
+  if (compare_prediction_ && !prediction.matrix().isIdentity())
+  {
+    AffineTransform unpredicted_correction;
+    unpredicted_result_ = alignICPEuclidean(
+      data_means, AffineTransform::Identity(), 
+      unpredicted_correction, n_iterations_unpredicted_);
+  }
+
+  AffineTransform correction;
+  if (!alignICPEuclidean(data_means, prediction, correction, n_iterations_)) 
+    return false;
+
+  constrainMotion(correction);
+  f2b_ = correction * f2b_;
+
+  transformDistributions(data_means, data_covariances, correction);
+  if (windowed_) updateKeyframes();
+  updateModelFromData(data_means, data_covariances);
+
+  motion = correction;
+  return true;
+}
+
+bool IncrementalICPProbModel::getMotionEstimation(
+  rgbdtools::RGBDFrame& frame,
+  const AffineTransform& prediction,
+  AffineTransform& motion)
+{
+  n_iterations_ = 0;
+  n_iterations_unpredicted_ = -1;
+
+  bool result = frame.n_valid_keypoints > 0 &&
+    getMotionEstimationImpl(frame, prediction, motion);
+
+  if (!result) motion.setIdentity();
+
+  return result;
+}
+
+bool IncrementalICPProbModel::alignFrame(
+  const rgbdtools::RGBDFrame& frame,
+  const AffineTransform& initial,
+  AffineTransform& correction,
+  int& n_iterations)
+{
+  n_iterations = 0;
+  if (model_size_ == 0) return false;
+
+  AffineTransform f2c = f2b_ * b2c_;
+
+  Vector3fVector data_means;
+  data_means.reserve(frame.n_valid_keypoints);
+
+  for (unsigned int i = 0; i < frame.kp_valid.size(); ++i)
+  {
+    if (!frame.kp_valid[i]) continue;
+    data_means.push_back(f2c * frame.kp_means[i]);
+  }
+
+  return alignICPEuclidean(data_means, initial, correction, n_iterations);
+}
+
+bool IncrementalICPProbModel::alignICPEuclidean(
+  const Vector3fVector& data_means,
+  const AffineTransform& initial,
+  AffineTransform& correction,
+  int& n_iterations)
+{
+  TransformationEstimationSVD svd;
+
+  Vector3fVector data = data_means;
+  for (unsigned int i = 0; i < data.size(); ++i)
+    data[i] = initial * data[i];
+
+  PointCloudFeature data_cloud, model_cloud;
+  data_cloud.points.reserve(data.size());
+  model_cloud.points.reserve(data.size());
+
+  IntVector indices;
+  FloatVector dists_sq;
+
+  AffineTransform final_transformation = initial;
+
+  n_iterations = 0;
+
+  for (int iteration = 0; iteration < max_iterations_; ++iteration)
+  {
+    n_iterations++;
+
+    // **** correspondences: nearest model point within max_corresp_dist_eucl_
+
+    data_cloud.points.clear();
+    model_cloud.points.clear();
+
+    for (unsigned int i = 0; i < data.size(); ++i)
+    {
+      if (index_.nearestKSearch(
+            data[i], means_, 1, max_corresp_dist_eucl_, indices, dists_sq) == 0)
+        continue;
+
+      data_cloud.points.push_back(pointFromMean(data[i]));
+      model_cloud.points.push_back(pointFromMean(means_[indices[0]]));
+    }
+
+    if ((int)data_cloud.points.size() < min_correspondences_) return false;
+
+    data_cloud.width  = model_cloud.width  = data_cloud.points.size();
+    data_cloud.height = model_cloud.height = 1;
+
+    // **** transformation
+
+    Eigen::Matrix4f transform_eigen;
+    svd.estimateRigidTransformation(data_cloud, model_cloud, transform_eigen);
+    AffineTransform transform(transform_eigen);
+
+    for (unsigned int i = 0; i < data.size(); ++i)
+      data[i] = transform * data[i];
+
+    final_transformation = transform * final_transformation;
+
+    // **** convergence
+
+    double dist, angle;
+    getTfDifference(tfFromEigenAffine(transform), dist, angle);
+    if (dist < tf_epsilon_linear_ && angle < tf_epsilon_angular_) break;
+  }
+
+  correction = final_transformation;
+  return true;
+}
+
+void IncrementalICPProbModel::updateModelFromData(
+  const Vector3fVector& data_means,
+  const Matrix3fVector& data_covariances)
+{
+  IntVector indices;
+  FloatVector dists_sq;
+
+  // slots of the new points. They are indexed after all the features
+  // are associated, so that features are only associated with points
+  // which were in the model before this frame.
+  IntVector added_slots;
+
+  for (unsigned int idx = 0; idx < data_means.size(); ++idx)
+  {
+    const Vector3f& data_mean = data_means[idx];
+    const Matrix3f& data_cov  = data_covariances[idx];
+
+    int mah_nn_idx;
+    double mah_dist_sq;
+
+    if (getNNMahalanobis(data_mean, data_cov, mah_nn_idx, mah_dist_sq, 
+                         indices, dists_sq) &&
+        mah_dist_sq < max_assoc_dist_mah_sq_)
+    {
+      // **** KF update
+
+      Vector3f& model_mean = means_[mah_nn_idx];
+      Matrix3f& model_cov  = covariances_[mah_nn_idx];
+
+      Matrix3f cov_sum = data_cov + model_cov;
+      Matrix3f K = model_cov * cov_sum.inverse();
+
+      index_.remove(mah_nn_idx, model_mean);
+
+      model_mean = model_mean + K * (data_mean - model_mean);
+      model_cov  = (Matrix3f::Identity() - K) * model_cov;
+
+      index_.insert(mah_nn_idx, model_mean);
+    }
+    else
+    {
+      int slot = addToModel(data_mean, data_cov);
+      if (slot >= 0) added_slots.push_back(slot);
+    }
+  }
+
+  // a slot can be replaced twice if the frame has more new
+  // points than the model size
+  std::sort(added_slots.begin(), added_slots.end());
+  added_slots.erase(
+    std::unique(added_slots.begin(), added_slots.end()), added_slots.end());
+
+  for (unsigned int i = 0; i < added_slots.size(); ++i)
+    index_.insert(added_slots[i], means_[added_slots[i]]);
+}
+
+int IncrementalICPProbModel::addToModel(
+  const Vector3f& data_mean,
+  const Matrix3f& data_cov)
+{
+  int slot;
+
+  if (windowed_)
+  {
+    if (keyframes_.empty()) updateKeyframes();
+
+    // make room by evicting the oldest keyframe, but never the latest
+    if (model_size_ >= max_model_size_)
+    {
+      if (keyframes_.size() < 2) return -1;
+      evictKeyframe(keyframes_.begin());
+    }
+
+    if (!free_slots_.empty())
+    {
+      slot = free_slots_.back();
+      free_slots_.pop_back();
+      means_[slot] = data_mean;
+      covariances_[slot] = data_cov;
+      slot_used_[slot] = true;
+    }
+    else
+    {
+      slot = means_.size();
+      means_.push_back(data_mean);
+      covariances_.push_back(data_cov);
+      slot_used_.push_back(true);
+    }
+
+    keyframes_.back().slots.push_back(slot);
+    model_size_++;
+  }
+  else if (model_size_ < max_model_size_)
+  {
+    slot = model_size_;
+    means_.push_back(data_mean);
+    covariances_.push_back(data_cov);
+    model_size_++;
+
+    if (model_size_ == max_model_size_) model_idx_ = 0;
+  }
+  else
+  {
+    // replace the oldest point
+    slot = model_idx_;
+    index_.remove(slot, means_[slot]);
+    means_[slot] = data_mean;
+    covariances_[slot] = data_cov;
+
+    model_idx_ = (model_idx_ + 1) % max_model_size_;
+  }
+
+  return slot;
+}
+
+void IncrementalICPProbModel::updateKeyframes()
+{
+  Vector3f position = f2b_.translation();
+  Matrix3f rotation = f2b_.linear();
+
+  bool new_keyframe = keyframes_.empty();
+
+  if (!new_keyframe)
+  {
+    const KeyframeGroup& latest = keyframes_.back();
+
+    double dist = (position - latest.position).norm();
+    double angle = Eigen::AngleAxisf(latest.rotation.transpose() * rotation).angle();
+
+    new_keyframe = dist > kf_dist_eps_ || angle > kf_angle_eps_;
+  }
+
+  if (new_keyframe)
+  {
+    keyframes_.push_back(KeyframeGroup());
+    keyframes_.back().position = position;
+    keyframes_.back().rotation = rotation;
+  }
+
+  // **** evict the keyframes outside the window, except the latest
+
+  if (max_keyframe_dist_ > 0.0)
+  {
+    KeyframeGroupList::iterator last = --keyframes_.end();
+    KeyframeGroupList::iterator it = keyframes_.begin();
+
+    while (it != last)
+    {
+      KeyframeGroupList::iterator next = it; 
+      ++next;
+      if ((it->position - position).norm() > max_keyframe_dist_) 
+        evictKeyframe(it);
+      it = next;
+    }
+  }
+
+  if (max_keyframes_ > 0)
+  {
+    while ((int)keyframes_.size() > max_keyframes_)
+      evictKeyframe(keyframes_.begin());
+  }
+}
+
+void IncrementalICPProbModel::evictKeyframe(KeyframeGroupList::iterator it)
+{
+  const IntVector& slots = it->slots;
+
+  for (unsigned int i = 0; i < slots.size(); ++i)
+  {
+    int slot = slots[i];
+    index_.remove(slot, means_[slot]);
+    slot_used_[slot] = false;
+    free_slots_.push_back(slot);
+  }
+
+  model_size_ -= slots.size();
+  keyframes_.erase(it);
+}
+
+bool IncrementalICPProbModel::getNNMahalanobis(
+  const Vector3f& data_mean, const Matrix3f& data_cov,
+  int& mah_nn_idx, double& mah_dist_sq,
+  IntVector& indices, FloatVector& dists_sq)
+{
+  int n = index_.nearestKSearch(
+    data_mean, means_, n_nearest_neighbors_, max_search_dist_, indices, dists_sq);
+
+  if (n == 0) return false;
+
+  mah_nn_idx = -1;
+  mah_dist_sq = -1.0;
+
+  for (int i = 0; i < n; ++i)
+  {
+    int idx = indices[i];
+
+    Vector3f diff = data_mean - means_[idx];
+    Matrix3f cov_sum = covariances_[idx] + data_cov;
+
+    double dist_sq = diff.transpose() * cov_sum.inverse() * diff;
+
+    if (mah_nn_idx == -1 || dist_sq < mah_dist_sq)
+    {
+      mah_nn_idx = idx;
+      mah_dist_sq = dist_sq;
+    }
+  }
+
+  return true;
+}
+
+PointCloudFeature::Ptr IncrementalICPProbModel::getModel()
+{
+  PointCloudFeature::Ptr model_ptr = boost::make_shared<PointCloudFeature>();
+  model_ptr->points.reserve(model_size_);
+
+  for (unsigned int i = 0; i < means_.size(); ++i)
+  {
+    if (windowed_ && !slot_used_[i]) continue;
+    model_ptr->points.push_back(pointFromMean(means_[i]));
+  }
+
+  model_ptr->width = model_size_;
+  model_ptr->height = 1;
+  model_ptr->is_dense = true;
+
+  return model_ptr;
+}
+
+void IncrementalICPProbModel::setMaxModelSize(int max_model_size)
+{
+  max_model_size = std::max(1, max_model_size);
+  if (max_model_size == max_model_size_) return;
+
+  if (windowed_)
+  {
+    // drop the oldest keyframes which don't fit
+    while (model_size_ > max_model_size && keyframes_.size() > 1)
+      evictKeyframe(keyframes_.begin());
+
+    max_model_size_ = max_model_size;
+    return;
+  }
+
+  bool reindex = false;
+
+  // once the model is full, it is a ring starting at model_idx_:
+  // move the oldest point to slot 0
+  if (model_size_ == max_model_size_ && model_idx_ != 0)
+  {
+    std::rotate(means_.begin(), means_.begin() + model_idx_, means_.end());
+    std::rotate(covariances_.begin(), covariances_.begin() + model_idx_, covariances_.end());
+    model_idx_ = 0;
+    reindex = true;
+  }
+
+  // drop the oldest points which don't fit
+  if (model_size_ > max_model_size)
+  {
+    int n_removed = model_size_ - max_model_size;
+    means_.erase(means_.begin(), means_.begin() + n_removed);
+    covariances_.erase(covariances_.begin(), covariances_.begin() + n_removed);
+    model_size_ = max_model_size;
+    reindex = true;
+  }
+
+  max_model_size_ = max_model_size;
+  model_idx_ = 0;
+
+  if (reindex) rebuildIndex();
+}
+
+void IncrementalICPProbModel::setVoxelSize(double voxel_size)
+{
+  index_.setVoxelSize(voxel_size);
+  rebuildIndex();
+}
+
+void IncrementalICPProbModel::rebuildIndex()
+{
+  index_.clear();
+  for (unsigned int i = 0; i < means_.size(); ++i)
+  {
+    if (windowed_ && !slot_used_[i]) continue;
+    index_.insert(i, means_[i]);
+  }
+}
+
+void IncrementalICPProbModel::setKeyframeWindow(
+  int max_keyframes, double max_keyframe_dist)
+{
+  max_keyframes_ = std::max(0, max_keyframes);
+  max_keyframe_dist_ = std::max(0.0, max_keyframe_dist);
+  windowed_ = max_keyframes_ > 0 || max_keyframe_dist_ > 0.0;
+
+  // the slot layout differs between the ring and the window
+  means_.clear();
+  covariances_.clear();
+  keyframes_.clear();
+  free_slots_.clear();
+  slot_used_.clear();
+  model_size_ = 0;
+  model_idx_ = 0;
+  index_.clear();
+}
+
+void IncrementalICPProbModel::setKeyframeThresholds(
+  double kf_dist_eps, double kf_angle_eps)
+{
+  kf_dist_eps_ = kf_dist_eps;
+  kf_angle_eps_ = kf_angle_eps;
+}
+
+void IncrementalICPProbModel::setTfEpsilonLinear(double tf_epsilon_linear)
+{
+  tf_epsilon_linear_ = tf_epsilon_linear;
+}
+
+void IncrementalICPProbModel::setTfEpsilonAngular(double tf_epsilon_angular)
+{
+  tf_epsilon_angular_ = tf_epsilon_angular;
+}
+
+void IncrementalICPProbModel::setMaxIterations(int max_iterations)
+{
+  max_iterations_ = max_iterations;
+}
+
+void IncrementalICPProbModel::setMinCorrespondences(int min_correspondences)
+{
+  min_correspondences_ = min_correspondences;
+}
+
+void IncrementalICPProbModel::setNNearestNeighbors(int n_nearest_neighbors)
+{
+  n_nearest_neighbors_ = n_nearest_neighbors;
+}
+
+void IncrementalICPProbModel::setMaxCorrespondenceDistEuclidean(double max_corresp_dist_eucl)
+{
+  max_corresp_dist_eucl_ = max_corresp_dist_eucl;
+}
+
+void IncrementalICPProbModel::setMaxAssociationDistMahalanobis(double max_assoc_dist_mah)
+{
+  max_assoc_dist_mah_sq_ = max_assoc_dist_mah * max_assoc_dist_mah;
+}
+
+void IncrementalICPProbModel::setMaxSearchDist(double max_search_dist)
+{
+  max_search_dist_ = max_search_dist;
+}
+
+void IncrementalICPProbModel::setComparePrediction(bool compare_prediction)
+{
+  compare_prediction_ = compare_prediction;
+}
+
+} // namespace ccny_rgbd
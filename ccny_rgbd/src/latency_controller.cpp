@@ -0,0 +1,112 @@
+/**
+ *  @file latency_controller.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/latency_controller.h"
+
+namespace ccny_rgbd {
+
+LatencyController::LatencyController():
+  budget_(33.0),
+  deadband_(0.1),
+  gain_(0.5),
+  period_(10),
+  min_features_(100),
+  max_features_(1000),
+  min_model_size_(1000),
+  max_model_size_limit_(10000),
+  n_features_(400),
+  max_model_size_(3000),
+  n_frames_(0),
+  duration_sum_(0.0),
+  mean_duration_(0.0)
+{
+
+}
+
+void LatencyController::setFeatureLimits(int min_features, int max_features)
+{
+  min_features_ = std::max(1, min_features);
+  max_features_ = std::max(min_features_, max_features);
+  setNFeatures(n_features_);
+}
+
+void LatencyController::setModelSizeLimits(int min_model_size, int max_model_size)
+{
+  min_model_size_ = std::max(1, min_model_size);
+  max_model_size_limit_ = std::max(min_model_size_, max_model_size);
+  setMaxModelSize(max_model_size_);
+}
+
+void LatencyController::setNFeatures(int n_features)
+{
+  n_features_ = std::min(std::max(n_features, min_features_), max_features_);
+}
+
+void LatencyController::setMaxModelSize(int max_model_size)
+{
+  max_model_size_ = std::min(
+    std::max(max_model_size, min_model_size_), max_model_size_limit_);
+}
+
+bool LatencyController::update(double duration)
+{
+  duration_sum_ += duration;
+  n_frames_++;
+
+  if (n_frames_ < period_) return false;
+
+  mean_duration_ = duration_sum_ / n_frames_;
+  duration_sum_ = 0.0;
+  n_frames_ = 0;
+
+  if (mean_duration_ <= 0.0) return false;
+
+  double ratio = budget_ / mean_duration_;
+
+  // within the deadband: hold
+  if (ratio > 1.0 / (1.0 + deadband_) && ratio < 1.0 + deadband_)
+    return false;
+
+  double scale = 1.0 + gain_ * (ratio - 1.0);
+  scale = std::min(std::max(scale, 0.8), 1.25);
+
+  int old_n_features = n_features_;
+  int old_max_model_size = max_model_size_;
+
+  setNFeatures((int)(n_features_ * scale + 0.5));
+
+  // the feature count saturated - adjust the model size instead
+  if (n_features_ == old_n_features)
+  {
+    bool under_budget = scale > 1.0 && n_features_ == max_features_;
+    bool over_budget  = scale < 1.0 && n_features_ == min_features_;
+
+    if (under_budget || over_budget)
+      setMaxModelSize((int)(max_model_size_ * scale + 0.5));
+  }
+
+  return n_features_ != old_n_features ||
+         max_model_size_ != old_max_model_size;
+}
+
+} // namespace ccny_rgbd
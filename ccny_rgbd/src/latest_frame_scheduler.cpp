@@ -0,0 +1,167 @@
+/**
+ *  @file latest_frame_scheduler.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/latest_frame_scheduler.h"
+
+namespace ccny_rgbd {
+
+LatestFrameScheduler::LatestFrameScheduler(const Callback& callback):
+  callback_(callback),
+  n_received_(0),
+  n_dropped_(0),
+  stop_(false),
+  busy_(false)
+{
+  worker_ = boost::thread(boost::bind(&LatestFrameScheduler::workerLoop, this));
+}
+
+LatestFrameScheduler::LatestFrameScheduler(
+  const Callback& callback, 
+  ThreadPoolPtr pool):
+  callback_(callback),
+  n_received_(0),
+  n_dropped_(0),
+  stop_(false),
+  busy_(false),
+  pool_(pool)
+{
+
+}
+
+LatestFrameScheduler::~LatestFrameScheduler()
+{
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    stop_ = true;
+
+    // the pool task refers to this object - wait for it to finish
+    while (busy_)
+      cond_.wait(lock);
+  }
+  cond_.notify_all();
+  if (worker_.joinable()) worker_.join();
+}
+
+void LatestFrameScheduler::push(
+  const ImageMsg::ConstPtr& rgb_msg,
+  const ImageMsg::ConstPtr& depth_msg,
+  const CameraInfoMsg::ConstPtr& info_msg)
+{
+  bool post_task = false;
+
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    n_received_++;
+    if (rgb_msg_) n_dropped_++;
+
+    rgb_msg_   = rgb_msg;
+    depth_msg_ = depth_msg;
+    info_msg_  = info_msg;
+
+    if (pool_ && !busy_ && !stop_)
+    {
+      busy_ = true;
+      post_task = true;
+    }
+  }
+
+  if (post_task)
+    pool_->post(boost::bind(&LatestFrameScheduler::poolTask, this));
+  else
+    cond_.notify_one();
+}
+
+int LatestFrameScheduler::getNDropped()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return n_dropped_;
+}
+
+int LatestFrameScheduler::getNReceived()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return n_received_;
+}
+
+void LatestFrameScheduler::workerLoop()
+{
+  while(true)
+  {
+    ImageMsg::ConstPtr rgb_msg, depth_msg;
+    CameraInfoMsg::ConstPtr info_msg;
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      while (!rgb_msg_ && !stop_)
+        cond_.wait(lock);
+
+      if (stop_) return;
+
+      // take the frame, leaving the slot empty
+      rgb_msg.swap(rgb_msg_);
+      depth_msg.swap(depth_msg_);
+      info_msg.swap(info_msg_);
+    }
+
+    callback_(rgb_msg, depth_msg, info_msg);
+  }
+}
+
+void LatestFrameScheduler::poolTask()
+{
+  ImageMsg::ConstPtr rgb_msg, depth_msg;
+  CameraInfoMsg::ConstPtr info_msg;
+
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    if (!stop_)
+    {
+      // take the frame, leaving the slot empty
+      rgb_msg.swap(rgb_msg_);
+      depth_msg.swap(depth_msg_);
+      info_msg.swap(info_msg_);
+    }
+  }
+
+  if (rgb_msg) callback_(rgb_msg, depth_msg, info_msg);
+
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    // requeue behind the other streams' tasks, rather than looping here
+    if (rgb_msg_ && !stop_)
+    {
+      lock.unlock();
+      pool_->post(boost::bind(&LatestFrameScheduler::poolTask, this));
+      return;
+    }
+
+    busy_ = false;
+  }
+  cond_.notify_all();
+}
+
+} // namespace ccny_rgbd
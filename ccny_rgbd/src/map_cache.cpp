@@ -0,0 +1,282 @@
+/**
+ *  @file map_cache.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/map_cache.h"
+
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <boost/filesystem.hpp>
+
+namespace ccny_rgbd {
+
+static const char MAGIC[8] = { 'C', 'C', 'N', 'Y', 'M', 'A', 'P', 'S' };
+static const size_t ALIGNMENT = 16;
+
+/** @brief File header
+ */
+struct MapCacheHeader
+{
+  char magic[8];     ///< MAGIC
+  uint32_t version;  ///< MapCache::VERSION
+  uint32_t n_mats;   ///< number of images
+  uint64_t key;      ///< key of the images
+};
+
+/** @brief Header of one image, followed by its name, then by its data
+ * at the next aligned offset
+ */
+struct MapCacheEntry
+{
+  uint32_t name_size;  ///< length of the name, in bytes
+  int32_t rows;        ///< image rows
+  int32_t cols;        ///< image columns
+  int32_t type;        ///< OpenCV image type
+};
+
+static size_t align(size_t offset)
+{
+  return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+MapCache::MapCache():
+  data_(NULL),
+  size_(0),
+  key_(0)
+{
+
+}
+
+MapCache::~MapCache()
+{
+  unload();
+}
+
+void MapCache::unload()
+{
+  mats_.clear();
+
+  if (data_) munmap(data_, size_);
+  data_ = NULL;
+  size_ = 0;
+  key_  = 0;
+}
+
+bool MapCache::load(const std::string& filename, uint64_t key)
+{
+  unload();
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(MapCacheHeader))
+  {
+    close(fd);
+    return false;
+  }
+
+  // private and writable: the images behave like regular ones, but
+  // a write never reaches the file. Prefault the pages, so the first
+  // frame does not pay for the page faults.
+  int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+  flags |= MAP_POPULATE;
+#endif
+
+  void * data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, flags, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) return false;
+
+  data_ = data;
+  size_ = st.st_size;
+
+  // **** header
+
+  const char * bytes = (const char *)data_;
+
+  MapCacheHeader header;
+  memcpy(&header, bytes, sizeof(header));
+
+  if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header.version != VERSION || header.key != key)
+  {
+    unload();
+    return false;
+  }
+
+  // **** images, checking every size against the file size
+
+  size_t offset = sizeof(header);
+
+  for (uint32_t i = 0; i < header.n_mats; ++i)
+  {
+    MapCacheEntry entry;
+    if (offset + sizeof(entry) > size_)
+    {
+      unload();
+      return false;
+    }
+    memcpy(&entry, bytes + offset, sizeof(entry));
+    offset += sizeof(entry);
+
+    if (entry.name_size > size_ - offset ||
+        entry.rows < 0 || entry.cols < 0 ||
+        CV_MAT_DEPTH(entry.type) > CV_64F)
+    {
+      unload();
+      return false;
+    }
+    std::string name(bytes + offset, entry.name_size);
+    offset = align(offset + entry.name_size);
+
+    uint64_t data_size = (uint64_t)entry.rows * entry.cols * CV_ELEM_SIZE(entry.type);
+    if (offset > size_ || data_size > size_ - offset)
+    {
+      unload();
+      return false;
+    }
+
+    if (data_size > 0)
+      mats_[name] = cv::Mat(entry.rows, entry.cols, entry.type,
+                            (char *)data_ + offset);
+    else
+      mats_[name] = cv::Mat();
+
+    offset = align(offset + data_size);
+  }
+
+  key_ = key;
+  return true;
+}
+
+bool MapCache::save(
+  const std::string& filename,
+  uint64_t key,
+  const MatMap& mats)
+{
+  boost::filesystem::path path(filename);
+
+  // unique temporary name, in case two threads save the same file
+  boost::filesystem::path tmp_path = path;
+  tmp_path.replace_extension(
+    boost::filesystem::unique_path(".%%%%-%%%%.tmp"));
+
+  try
+  {
+    if (path.has_parent_path())
+      boost::filesystem::create_directories(path.parent_path());
+
+    std::ofstream file(tmp_path.string().c_str(),
+                       std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+
+    MapCacheHeader header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.n_mats  = mats.size();
+    header.key     = key;
+
+    file.write((const char *)&header, sizeof(header));
+    size_t offset = sizeof(header);
+
+    const char padding[ALIGNMENT] = { 0 };
+
+    for (MatMap::const_iterator it = mats.begin(); it != mats.end(); ++it)
+    {
+      const std::string& name = it->first;
+      cv::Mat mat = it->second.isContinuous() ? it->second : it->second.clone();
+
+      MapCacheEntry entry;
+      entry.name_size = name.size();
+      entry.rows      = mat.rows;
+      entry.cols      = mat.cols;
+      entry.type      = mat.type();
+
+      file.write((const char *)&entry, sizeof(entry));
+      file.write(name.data(), name.size());
+      offset += sizeof(entry) + name.size();
+
+      file.write(padding, align(offset) - offset);
+      offset = align(offset);
+
+      size_t data_size = mat.total() * mat.elemSize();
+      if (data_size > 0) file.write((const char *)mat.data, data_size);
+      offset += data_size;
+
+      file.write(padding, align(offset) - offset);
+      offset = align(offset);
+    }
+
+    file.close();
+    if (!file)
+    {
+      boost::filesystem::remove(tmp_path);
+      return false;
+    }
+
+    // atomic: readers see either no file, or the whole file
+    boost::filesystem::rename(tmp_path, path);
+  }
+  catch (boost::filesystem::filesystem_error&)
+  {
+    boost::system::error_code ec;
+    boost::filesystem::remove(tmp_path, ec);
+    return false;
+  }
+
+  return true;
+}
+
+uint64_t MapCache::hash(const void * data, size_t size, uint64_t hash)
+{
+  const unsigned char * bytes = (const unsigned char *)data;
+
+  for (size_t i = 0; i < size; ++i)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+bool MapCache::hashFile(const std::string& filename, uint64_t& hash)
+{
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!file) return false;
+
+  char buffer[4096];
+  while (file)
+  {
+    file.read(buffer, sizeof(buffer));
+    hash = MapCache::hash(buffer, file.gcount(), hash);
+  }
+
+  return true;
+}
+
+} // namespace ccny_rgbd
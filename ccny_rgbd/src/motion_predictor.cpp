@@ -0,0 +1,120 @@
+/**
+ *  @file motion_predictor.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/motion_predictor.h"
+
+#include <cmath>
+#include <Eigen/Geometry>
+
+namespace ccny_rgbd {
+
+/** @brief Scales the rotation angle and the translation of a transform
+ */
+static AffineTransform scaleTransform(const AffineTransform& t, double scale)
+{
+  Eigen::AngleAxisf angle_axis(t.rotation());
+  angle_axis.angle() *= scale;
+
+  AffineTransform scaled(angle_axis);
+  scaled.translation() = t.translation() * scale;
+  return scaled;
+}
+
+MotionPredictor::MotionPredictor():
+  mode_(NONE),
+  decay_time_(0.5),
+  max_dt_(0.2)
+{
+  reset();
+}
+
+bool MotionPredictor::setMode(const std::string& mode)
+{
+  if      (mode == "none")              mode_ = NONE;
+  else if (mode == "constant_velocity") mode_ = CONSTANT_VELOCITY;
+  else if (mode == "decaying_velocity") mode_ = DECAYING_VELOCITY;
+  else
+  {
+    mode_ = NONE;
+    return false;
+  }
+
+  return true;
+}
+
+void MotionPredictor::reset()
+{
+  initialized_ = false;
+  has_velocity_ = false;
+  last_stamp_ = 0.0;
+  last_dt_ = 0.0;
+  last_f2b_.setIdentity();
+  delta_.setIdentity();
+}
+
+bool MotionPredictor::predict(double stamp, AffineTransform& prediction) const
+{
+  prediction.setIdentity();
+
+  if (mode_ == NONE || !has_velocity_) return false;
+
+  double dt = stamp - last_stamp_;
+  if (dt <= 0.0 || dt > max_dt_) return false;
+
+  double scale;
+  if (mode_ == CONSTANT_VELOCITY)
+    scale = dt / last_dt_;
+  else
+    scale = decay_time_ * (1.0 - exp(-dt / decay_time_)) / last_dt_;
+
+  // predicted increment in the base frame, expressed in the fixed frame
+  prediction = last_f2b_ * scaleTransform(delta_, scale) * last_f2b_.inverse();
+  return true;
+}
+
+void MotionPredictor::update(double stamp, const AffineTransform& f2b, bool valid)
+{
+  if (!valid)
+  {
+    // the motion of this frame is unknown
+    reset();
+    return;
+  }
+
+  double dt = stamp - last_stamp_;
+
+  if (initialized_ && dt > 0.0 && dt <= max_dt_)
+  {
+    delta_ = last_f2b_.inverse() * f2b;
+    last_dt_ = dt;
+    has_velocity_ = true;
+  }
+  else
+    has_velocity_ = false;
+
+  last_f2b_ = f2b;
+  last_stamp_ = stamp;
+  initialized_ = true;
+}
+
+} // namespace ccny_rgbd
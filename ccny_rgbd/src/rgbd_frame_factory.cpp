@@ -0,0 +1,192 @@
+/**
+ *  @file rgbd_frame_factory.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/rgbd_frame_factory.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace ccny_rgbd {
+
+RGBDFrameFactory::RGBDFrameFactory(int max_pool_size):
+  max_pool_size_(std::max(1, max_pool_size)),
+  n_allocated_(0)
+{
+  cached_K_.assign(0.0);
+}
+
+void RGBDFrameFactory::createFrame(
+  const ImageMsg::ConstPtr& rgb_msg,
+  const ImageMsg::ConstPtr& depth_msg,
+  const CameraInfoMsg::ConstPtr& info_msg,
+  rgbdtools::RGBDFrame& frame)
+{
+  // **** images: rgb and 16UC1 depth share the message data
+
+  frame.rgb_img = cv_bridge::toCvShare(rgb_msg)->image;
+
+  const std::string& enc = depth_msg->encoding; 
+  if (enc.compare("16UC1") == 0)
+    frame.depth_img = cv_bridge::toCvShare(depth_msg)->image;
+  else if (enc.compare("32FC1") == 0)
+  {
+    cv::Mat depth_img_float = cv_bridge::toCvShare(depth_msg)->image;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      frame.depth_img = getDepthBuffer(
+        depth_img_float.rows, depth_img_float.cols);
+    }
+    depthImageFloatTo16bitFast(depth_img_float, frame.depth_img);
+  }
+  else
+    frame.depth_img = cv::Mat();
+
+  // **** intrinsics: shared, rebuilt only if the camera info changed
+
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    frame.intr = getIntrinsics(*info_msg);
+  }
+
+  // **** header
+
+  frame.header.seq        = rgb_msg->header.seq;
+  frame.header.frame_id   = rgb_msg->header.frame_id;
+  frame.header.stamp.sec  = rgb_msg->header.stamp.sec;
+  frame.header.stamp.nsec = rgb_msg->header.stamp.nsec;
+}
+
+int RGBDFrameFactory::getNAllocated()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return n_allocated_;
+}
+
+const cv::Mat& RGBDFrameFactory::getIntrinsics(const CameraInfoMsg& info_msg)
+{
+  bool changed = intr_.empty() || 
+    !std::equal(cached_K_.begin(), cached_K_.end(), info_msg.K.begin()) ||
+    cached_D_.size() != info_msg.D.size() ||
+    !std::equal(cached_D_.begin(), cached_D_.end(), info_msg.D.begin());
+
+  if (changed)
+  {
+    std::copy(info_msg.K.begin(), info_msg.K.end(), cached_K_.begin());
+    cached_D_.assign(info_msg.D.begin(), info_msg.D.end());
+
+    // new matrices, so that older frames keep their own intrinsics
+    intr_ = cv::Mat(3, 3, CV_64FC1);
+    for (int idx = 0; idx < 9; ++idx)
+      intr_.at<double>(idx / 3, idx % 3) = info_msg.K[idx];
+
+    int d_size = info_msg.D.size();
+    dist_ = cv::Mat(1, d_size, CV_64FC1);
+    for (int idx = 0; idx < d_size; ++idx)
+      dist_.at<double>(0, idx) = info_msg.D[idx];
+    /// @todo assert that distortion (dist) is 0
+  }
+
+  return intr_;
+}
+
+cv::Mat RGBDFrameFactory::getDepthBuffer(int rows, int cols)
+{
+  // a buffer only referenced by the pool is free
+  for (unsigned int i = 0; i < depth_pool_.size(); ++i)
+  {
+    cv::Mat& buffer = depth_pool_[i];
+    if (buffer.rows == rows && buffer.cols == cols && 
+        buffer.refcount && *buffer.refcount == 1)
+      return buffer;
+  }
+
+  // all buffers in use, or of a different size: allocate
+  cv::Mat buffer(rows, cols, CV_16UC1);
+  n_allocated_++;
+
+  if ((int)depth_pool_.size() < max_pool_size_)
+    depth_pool_.push_back(buffer);
+  else
+  {
+    // replace a free buffer of a different size, if there is one
+    for (unsigned int i = 0; i < depth_pool_.size(); ++i)
+    {
+      if (depth_pool_[i].refcount && *depth_pool_[i].refcount == 1)
+      {
+        depth_pool_[i] = buffer;
+        break;
+      }
+    }
+  }
+
+  return buffer;
+}
+
+void depthImageFloatTo16bitFast(
+  const cv::Mat& depth_img_in,
+  cv::Mat& depth_img_out)
+{
+  for (int v = 0; v < depth_img_in.rows; ++v)
+  {
+    const float* in_row = depth_img_in.ptr<float>(v);
+    uint16_t* out_row = depth_img_out.ptr<uint16_t>(v);
+
+    int u = 0;
+
+#ifdef __SSE2__
+    const __m128 scale4 = _mm_set1_ps(1000.0f);
+    const __m128 zero4  = _mm_setzero_ps();
+    const __m128 max4   = _mm_set1_ps(65535.0f);
+    const __m128i bias4 = _mm_set1_epi32(32768);
+    const __m128i flip8 = _mm_set1_epi16((short)0x8000);
+
+    for (; u + 8 <= depth_img_in.cols; u += 8)
+    {
+      // max(NaN, 0) returns 0, so NaN maps to 0
+      __m128 a = _mm_mul_ps(_mm_loadu_ps(in_row + u),     scale4);
+      __m128 b = _mm_mul_ps(_mm_loadu_ps(in_row + u + 4), scale4);
+      a = _mm_min_ps(_mm_max_ps(a, zero4), max4);
+      b = _mm_min_ps(_mm_max_ps(b, zero4), max4);
+
+      // round to nearest, then pack to uint16 via a signed pack
+      __m128i ia = _mm_sub_epi32(_mm_cvtps_epi32(a), bias4);
+      __m128i ib = _mm_sub_epi32(_mm_cvtps_epi32(b), bias4);
+      __m128i packed = _mm_xor_si128(_mm_packs_epi32(ia, ib), flip8);
+
+      _mm_storeu_si128((__m128i*)(out_row + u), packed);
+    }
+#endif
+
+    for (; u < depth_img_in.cols; ++u)
+    {
+      float z = in_row[u] * 1000.0f;
+
+      if (!(z > 0.0f))         out_row[u] = 0;  // also NaN
+      else if (z >= 65535.0f)  out_row[u] = 65535;
+      else                     out_row[u] = cvRound(z);
+    }
+  }
+}
+
+} // namespace ccny_rgbd
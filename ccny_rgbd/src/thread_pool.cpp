@@ -0,0 +1,120 @@
+/**
+ *  @file thread_pool.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/thread_pool.h"
+
+namespace ccny_rgbd {
+
+ThreadPool::ThreadPool(int n_threads):
+  n_threads_(std::max(1, n_threads)),
+  stop_(false)
+{
+  for (int i = 0; i < n_threads_; ++i)
+    workers_.create_thread(boost::bind(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_all();
+  workers_.join_all();
+}
+
+void ThreadPool::post(const Task& task)
+{
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    tasks_.push_back(task);
+  }
+  cond_.notify_one();
+}
+
+void ThreadPool::parallelFor(int n, const IndexedTask& body)
+{
+  if (n <= 0) return;
+
+  ParallelForStatePtr state = boost::make_shared<ParallelForState>();
+  state->n      = n;
+  state->body   = body;
+  state->next   = 0;
+  state->n_done = 0;
+
+  // helpers which start after all iterations are claimed return right away
+  int n_helpers = std::min(n_threads_, n - 1);
+  for (int i = 0; i < n_helpers; ++i)
+    post(boost::bind(&ThreadPool::parallelForWorker, state));
+
+  parallelForWorker(state);
+
+  boost::mutex::scoped_lock lock(state->mutex);
+  while (state->n_done < n)
+    state->cond.wait(lock);
+}
+
+void ThreadPool::parallelForWorker(ParallelForStatePtr state)
+{
+  int n_done = 0;
+
+  while(true)
+  {
+    int i = __sync_fetch_and_add(&state->next, 1);
+    if (i >= state->n) break;
+
+    state->body(i);
+    n_done++;
+  }
+
+  if (n_done == 0) return;
+
+  boost::mutex::scoped_lock lock(state->mutex);
+  state->n_done += n_done;
+  if (state->n_done == state->n) state->cond.notify_all();
+}
+
+void ThreadPool::workerLoop()
+{
+  while(true)
+  {
+    Task task;
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      while (tasks_.empty() && !stop_)
+        cond_.wait(lock);
+
+      // finish the remaining tasks before exiting
+      if (tasks_.empty()) return;
+
+      task = tasks_.front();
+      tasks_.pop_front();
+    }
+
+    task();
+  }
+}
+
+} // namespace ccny_rgbd
@@ -0,0 +1,232 @@
+/**
+ *  @file tiled_feature_detector.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/tiled_feature_detector.h"
+
+namespace ccny_rgbd {
+
+TiledFeatureDetector::TiledFeatureDetector(
+  const std::string& detector_type,
+  ThreadPoolPtr pool):
+  detector_type_(detector_type),
+  pool_(pool),
+  grid_rows_(1),
+  grid_cols_(1),
+  n_features_(400),
+  min_distance_(2.0),
+  threshold_(31.0),
+  smooth_(0),
+  max_range_(5.5),
+  max_stdev_(0.03)
+{
+  setGrid(grid_rows_, grid_cols_);
+}
+
+TiledFeatureDetector::~TiledFeatureDetector()
+{
+
+}
+
+void TiledFeatureDetector::setGrid(int grid_rows, int grid_cols)
+{
+  grid_rows_ = std::max(1, grid_rows);
+  grid_cols_ = std::max(1, grid_cols);
+
+  int n_cells = getNCells();
+
+  cell_detectors_.clear();
+  cell_detect_.clear();
+  cell_frames_.clear();
+  cell_frames_.resize(n_cells);
+
+  for (int i = 0; i < n_cells; ++i)
+  {
+    if (detector_type_ == "ORB")
+    {
+      boost::shared_ptr<DetectionOnly<rgbdtools::OrbDetector> > detector(
+        new DetectionOnly<rgbdtools::OrbDetector>());
+      cell_detectors_.push_back(detector);
+      cell_detect_.push_back(boost::bind(
+        &DetectionOnly<rgbdtools::OrbDetector>::detect, detector.get(), _1, _2));
+    }
+    else if (detector_type_ == "STAR")
+    {
+      boost::shared_ptr<DetectionOnly<rgbdtools::StarDetector> > detector(
+        new DetectionOnly<rgbdtools::StarDetector>());
+      cell_detectors_.push_back(detector);
+      cell_detect_.push_back(boost::bind(
+        &DetectionOnly<rgbdtools::StarDetector>::detect, detector.get(), _1, _2));
+    }
+    else
+    {
+      boost::shared_ptr<DetectionOnly<rgbdtools::GftDetector> > detector(
+        new DetectionOnly<rgbdtools::GftDetector>());
+      cell_detectors_.push_back(detector);
+      cell_detect_.push_back(boost::bind(
+        &DetectionOnly<rgbdtools::GftDetector>::detect, detector.get(), _1, _2));
+    }
+  }
+
+  configureCells();
+}
+
+void TiledFeatureDetector::setNFeatures(int n_features)
+{
+  n_features_ = n_features;
+  configureCells();
+}
+
+void TiledFeatureDetector::setMinDistance(double min_distance)
+{
+  min_distance_ = min_distance;
+  configureCells();
+}
+
+void TiledFeatureDetector::setThreshold(double threshold)
+{
+  threshold_ = threshold;
+  configureCells();
+}
+
+void TiledFeatureDetector::configureCells()
+{
+  int n_cells = getNCells();
+
+  // round up, so that the cells ask for at least n_features in total
+  int cell_n_features = (n_features_ + n_cells - 1) / n_cells;
+
+  for (int i = 0; i < n_cells; ++i)
+  {
+    if (detector_type_ == "ORB")
+    {
+      rgbdtools::OrbDetectorPtr orb_detector =
+        boost::static_pointer_cast<rgbdtools::OrbDetector>(cell_detectors_[i]);
+      orb_detector->setNFeatures(cell_n_features);
+      orb_detector->setThreshold(threshold_);
+    }
+    else if (detector_type_ == "STAR")
+    {
+      rgbdtools::StarDetectorPtr star_detector =
+        boost::static_pointer_cast<rgbdtools::StarDetector>(cell_detectors_[i]);
+      star_detector->setThreshold(threshold_);
+      star_detector->setMinDistance(min_distance_);
+    }
+    else
+    {
+      rgbdtools::GftDetectorPtr gft_detector =
+        boost::static_pointer_cast<rgbdtools::GftDetector>(cell_detectors_[i]);
+      gft_detector->setNFeatures(cell_n_features);
+      gft_detector->setMinDistance(min_distance_);
+    }
+  }
+}
+
+void TiledFeatureDetector::findFeatures(rgbdtools::RGBDFrame& frame)
+{
+  // **** grayscale conversion and smoothing, once for the whole image
+
+  const cv::Mat& input_img = frame.rgb_img;
+  cv::Mat gray_img;
+
+  if (input_img.type() != CV_8UC1)
+    cv::cvtColor(input_img, gray_img, CV_BGR2GRAY);
+  else
+    gray_img = input_img;
+
+  if (smooth_ > 0)
+  {
+    int size = smooth_ * 2 + 1;
+    cv::Mat smooth_img;
+    cv::GaussianBlur(gray_img, smooth_img, cv::Size(size, size), 0);
+    gray_img = smooth_img;
+  }
+
+  // **** detect the cells in parallel
+
+  int n_cells = getNCells();
+
+  pool_->parallelFor(n_cells, boost::bind(
+    &TiledFeatureDetector::detectCell, this, _1,
+    boost::cref(frame), boost::cref(gray_img)));
+
+  // **** merge, in cell order, so the output is deterministic
+
+  frame.keypoints.clear();
+  frame.descriptors = cv::Mat();
+
+  for (int i = 0; i < n_cells; ++i)
+  {
+    cv::Rect rect = getCellRect(i, gray_img.cols, gray_img.rows);
+    const rgbdtools::RGBDFrame& cell_frame = cell_frames_[i];
+
+    for (unsigned int kp_idx = 0; kp_idx < cell_frame.keypoints.size(); ++kp_idx)
+    {
+      cv::KeyPoint keypoint = cell_frame.keypoints[kp_idx];
+      keypoint.pt.x += rect.x;
+      keypoint.pt.y += rect.y;
+      frame.keypoints.push_back(keypoint);
+    }
+
+    if (!cell_frame.descriptors.empty())
+      frame.descriptors.push_back(cell_frame.descriptors);
+  }
+
+  // **** 3D distributions
+
+  computeFeatureDistributions(frame, max_range_, max_stdev_, distributions_);
+  copyFeatureDistributions(distributions_, frame);
+}
+
+void TiledFeatureDetector::detectCell(
+  int cell_idx,
+  const rgbdtools::RGBDFrame& frame,
+  const cv::Mat& gray_img)
+{
+  cv::Rect rect = getCellRect(cell_idx, gray_img.cols, gray_img.rows);
+
+  // the cell frame shares the image data with the full frame
+  rgbdtools::RGBDFrame& cell_frame = cell_frames_[cell_idx];
+  cell_frame.rgb_img   = frame.rgb_img(rect);
+  cell_frame.depth_img = frame.depth_img(rect);
+  cell_frame.header    = frame.header;
+  cell_frame.keypoints.clear();
+  cell_frame.descriptors = cv::Mat();
+
+  cell_detect_[cell_idx](cell_frame, gray_img(rect));
+}
+
+cv::Rect TiledFeatureDetector::getCellRect(
+  int cell_idx, int width, int height) const
+{
+  int row = cell_idx / grid_cols_;
+  int col = cell_idx % grid_cols_;
+
+  int x0 = (col       * width)  / grid_cols_;
+  int x1 = ((col + 1) * width)  / grid_cols_;
+  int y0 = (row       * height) / grid_rows_;
+  int y1 = ((row + 1) * height) / grid_rows_;
+
+  return cv::Rect(x0, y0, x1 - x0, y1 - y0);
+}
+
+} // namespace ccny_rgbd
@@ -23,6 +23,9 @@
 
 #include "ccny_rgbd/util.h"
 
+#include <cstdio>
+#include <cstdlib>
+
 namespace ccny_rgbd {
 
 void getTfDifference(const tf::Transform& motion, double& dist, double& angle)
@@ -143,6 +146,41 @@ double getMsDuration(const ros::WallTime& start)
   return (ros::WallTime::now() - start).toSec() * 1000.0;
 }
 
+double getPercentile(
+  const std::vector<double>& sorted_values, 
+  double percentile)
+{
+  if (sorted_values.empty()) return 0.0;
+  
+  // nearest rank: smallest value such that at least p% are <= to it
+  int n = sorted_values.size();
+  int rank = (int)ceil(percentile / 100.0 * n);
+  int idx = std::min(std::max(rank - 1, 0), n - 1);
+  
+  return sorted_values[idx];
+}
+
+bool parseOptions(int argc, char** argv, int first, OptionMap& options)
+{
+  for (int i = first; i < argc; i += 2)
+  {
+    std::string key = argv[i];
+    if (key.compare(0, 2, "--") != 0 || i + 1 >= argc)
+    {
+      fprintf(stderr, "Invalid option: %s\n", key.c_str());
+      return false;
+    }
+    options[key.substr(2)] = argv[i + 1];
+  }
+
+  return true;
+}
+
+double uniform()
+{
+  return rand() / (double)RAND_MAX;
+}
+
 void removeInvalidMeans(
   const Vector3fVector& means,
   const BoolVector& valid,
@@ -352,4 +390,17 @@ void pathROSToEigenAffine(
   }
 }
 
+void getPathSegment(
+  const PathMsg& path_msg,
+  int start_index,
+  PathMsg& segment_msg)
+{
+  int size = path_msg.poses.size();
+  start_index = std::max(0, std::min(start_index, size));
+
+  segment_msg.header = path_msg.header;
+  segment_msg.poses.assign(
+    path_msg.poses.begin() + start_index, path_msg.poses.end());
+}
+
 } //namespace ccny_rgbd
@@ -0,0 +1,175 @@
+/**
+ *  @file voxel_hash_index.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/voxel_hash_index.h"
+
+namespace ccny_rgbd {
+
+VoxelHashIndex::VoxelHashIndex(double voxel_size):
+  n_points_(0)
+{
+  setVoxelSize(voxel_size);
+}
+
+void VoxelHashIndex::setVoxelSize(double voxel_size)
+{
+  voxel_size_ = voxel_size;
+  voxel_size_inv_ = 1.0 / voxel_size;
+  clear();
+}
+
+void VoxelHashIndex::clear()
+{
+  voxels_.clear();
+  n_points_ = 0;
+}
+
+int VoxelHashIndex::getVoxelCoordinate(float x) const
+{
+  return (int)floor(x * voxel_size_inv_);
+}
+
+VoxelHashIndex::VoxelKey VoxelHashIndex::getKey(int vx, int vy, int vz)
+{
+  return ((VoxelKey)(vx & 0x1FFFFF) << 42) |
+         ((VoxelKey)(vy & 0x1FFFFF) << 21) |
+          (VoxelKey)(vz & 0x1FFFFF);
+}
+
+void VoxelHashIndex::insert(int id, const Vector3f& point)
+{
+  VoxelKey key = getKey(
+    getVoxelCoordinate(point(0)), 
+    getVoxelCoordinate(point(1)), 
+    getVoxelCoordinate(point(2)));
+
+  voxels_[key].push_back(id);
+  n_points_++;
+}
+
+bool VoxelHashIndex::remove(int id, const Vector3f& point)
+{
+  VoxelKey key = getKey(
+    getVoxelCoordinate(point(0)), 
+    getVoxelCoordinate(point(1)), 
+    getVoxelCoordinate(point(2)));
+
+  VoxelMap::iterator it = voxels_.find(key);
+  if (it == voxels_.end()) return false;
+
+  IntVector& voxel_ids = it->second;
+
+  for (unsigned int i = 0; i < voxel_ids.size(); ++i)
+  {
+    if (voxel_ids[i] != id) continue;
+
+    // order within a voxel does not matter
+    voxel_ids[i] = voxel_ids.back();
+    voxel_ids.pop_back();
+    if (voxel_ids.empty()) voxels_.erase(it);
+
+    n_points_--;
+    return true;
+  }
+
+  return false;
+}
+
+int VoxelHashIndex::nearestKSearch(
+  const Vector3f& query,
+  const Vector3fVector& points,
+  int k,
+  double max_dist,
+  IntVector& ids,
+  FloatVector& dists_sq) const
+{
+  ids.clear();
+  dists_sq.clear();
+
+  if (k <= 0 || n_points_ == 0) return 0;
+
+  float max_dist_sq = max_dist * max_dist;
+
+  int qx = getVoxelCoordinate(query(0));
+  int qy = getVoxelCoordinate(query(1));
+  int qz = getVoxelCoordinate(query(2));
+
+  // voxels further than max_dist can't hold a neighbor
+  int max_shell = (int)ceil(max_dist * voxel_size_inv_);
+
+  for (int shell = 0; shell <= max_shell; ++shell)
+  {
+    // visit the voxels at Chebyshev distance "shell" from the query voxel
+    for (int dx = -shell; dx <= shell; ++dx)
+    for (int dy = -shell; dy <= shell; ++dy)
+    for (int dz = -shell; dz <= shell; ++dz)
+    {
+      if (std::max(std::abs(dx), std::max(std::abs(dy), std::abs(dz))) != shell)
+        continue;
+
+      VoxelMap::const_iterator it = voxels_.find(getKey(qx + dx, qy + dy, qz + dz));
+      if (it == voxels_.end()) continue;
+
+      const IntVector& voxel_ids = it->second;
+
+      for (unsigned int i = 0; i < voxel_ids.size(); ++i)
+      {
+        int id = voxel_ids[i];
+        float dist_sq = (points[id] - query).squaredNorm();
+
+        if (dist_sq > max_dist_sq) continue;
+        if ((int)ids.size() == k && dist_sq >= dists_sq.back()) continue;
+
+        // insertion into the sorted list of the k best
+        if ((int)ids.size() < k)
+        {
+          ids.push_back(id);
+          dists_sq.push_back(dist_sq);
+        }
+        else
+        {
+          ids.back() = id;
+          dists_sq.back() = dist_sq;
+        }
+
+        for (int j = ids.size() - 1; j > 0 && dists_sq[j] < dists_sq[j-1]; --j)
+        {
+          std::swap(ids[j], ids[j-1]);
+          std::swap(dists_sq[j], dists_sq[j-1]);
+        }
+      }
+    }
+
+    // anything outside the visited shells is at least 
+    // shell * voxel_size away from the query
+    if ((int)ids.size() == k)
+    {
+      float reach = shell * voxel_size_;
+      if (dists_sq.back() <= reach * reach) break;
+    }
+  }
+
+  return ids.size();
+}
+
+} // namespace ccny_rgbd